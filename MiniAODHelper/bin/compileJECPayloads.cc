@@ -0,0 +1,72 @@
+// Convert the JEC/JER txt payloads into the binary blobs read by PayloadCache
+//
+// compileJECPayloads [file.txt|directory ...]
+//
+// Without arguments all payloads in $CMSSW_BASE/src/MiniAOD/MiniAODHelper/data/jec
+// are converted. Each X.txt is written to X.bin next to it. Rerun after
+// updating a payload: blobs of modified txt files are ignored by the helper.
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "MiniAOD/MiniAODHelper/interface/PayloadCache.h"
+
+
+namespace {
+  bool isDirectory(const std::string& path) {
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+  }
+
+  void listPayloads(const std::string& directory, std::vector<std::string>& files) {
+    DIR* dir = ::opendir(directory.c_str());
+    if( !dir ) return;
+    std::vector<std::string> names;
+    while( struct dirent* entry = ::readdir(dir) ){
+      const std::string name = entry->d_name;
+      if( name.size() > 4 && name.compare(name.size()-4, 4, ".txt") == 0 ) names.push_back(name);
+    }
+    ::closedir(dir);
+    std::sort(names.begin(), names.end());
+    for( const auto& name: names ) files.push_back(directory + "/" + name);
+  }
+}
+
+
+int main(int argc, char** argv) {
+  std::vector<std::string> paths(argv+1, argv+argc);
+  if( paths.empty() ){
+    const char* base = std::getenv("CMSSW_BASE");
+    if( !base ){
+      std::cerr << "CMSSW_BASE not set, give the payloads to convert" << std::endl;
+      return 1;
+    }
+    paths.push_back(std::string(base) + "/src/MiniAOD/MiniAODHelper/data/jec");
+  }
+
+  std::vector<std::string> files;
+  for( const auto& path: paths ){
+    if( isDirectory(path) ) listPayloads(path, files);
+    else files.push_back(path);
+  }
+
+  unsigned int nFailed = 0;
+  for( const auto& file: files ){
+    std::string error;
+    if( PayloadCache::compile(file, error) ){
+      std::cout << file << " -> " << PayloadCache::blobName(file) << std::endl;
+    } else {
+      std::cerr << file << ": " << error << std::endl;
+      ++nFailed;
+    }
+  }
+  std::cout << files.size()-nFailed << " of " << files.size() << " payloads converted" << std::endl;
+
+  return nFailed == 0 ? 0 : 1;
+}
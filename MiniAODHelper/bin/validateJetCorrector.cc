@@ -0,0 +1,73 @@
+// Compare StandaloneJetCorrector with FactorizedJetCorrector on a grid
+//
+// validateJetCorrector level1.txt [level2.txt ...]
+//
+// The levels are applied in the given order, e.g. L1FastJet L2Relative
+// L3Absolute [L2L3Residual]. Returns 1 if a correction differs by more than
+// the float tolerance.
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "CondFormats/JetMETObjects/interface/FactorizedJetCorrector.h"
+#include "CondFormats/JetMETObjects/interface/JetCorrectorParameters.h"
+
+#include "MiniAOD/MiniAODHelper/interface/StandaloneJetCorrector.h"
+
+
+int main(int argc, char** argv) {
+  if( argc < 2 ){
+    std::cerr << "usage: " << argv[0] << " level1.txt [level2.txt ...]" << std::endl;
+    return 1;
+  }
+  const std::vector<std::string> files(argv+1, argv+argc);
+
+  std::vector<JetCorrectorParameters> levels;
+  for( const auto& file: files ) levels.push_back(JetCorrectorParameters(file));
+  FactorizedJetCorrector reference(levels);
+  const StandaloneJetCorrector corrector(files);
+
+  const double tolerance = 1e-5;
+  std::vector<float> pt, eta, area, out;
+  unsigned int nJets = 0, nFailed = 0;
+  double maxDiff = 0.;
+  for( float rho = 0.; rho <= 60.; rho += 7.5 ){
+    // one "event" per rho: all grid points in one batched call
+    pt.clear();
+    eta.clear();
+    area.clear();
+    for( float e = -5.4; e <= 5.4; e += 0.05 ){
+      for( float logPt = 0.; logPt <= 9.; logPt += 0.1 ){
+	for( float a = 0.1; a <= 1.; a += 0.3 ){
+	  pt.push_back(std::exp(logPt));
+	  eta.push_back(e);
+	  area.push_back(a);
+	}
+      }
+    }
+    corrector.corrections(pt, eta, area, rho, out);
+
+    for( unsigned int i=0; i<pt.size(); ++i ){
+      reference.setJetEta(eta[i]);
+      reference.setJetPt(pt[i]);
+      reference.setJetA(area[i]);
+      reference.setRho(rho);
+      const float expected = reference.getCorrection();
+      const double diff = std::abs(out[i]-expected)/std::max(std::abs(expected),1e-6f);
+      maxDiff = std::max(maxDiff, diff);
+      ++nJets;
+      if( diff > tolerance ){
+	if( ++nFailed <= 10 ){
+	  std::cout << "pt " << pt[i] << " eta " << eta[i] << " area " << area[i] << " rho " << rho
+		    << ": " << out[i] << " instead of " << expected << std::endl;
+	}
+      }
+    }
+  }
+
+  std::cout << nJets << " jets, " << nFailed << " outside of the tolerance, largest relative difference " << maxDiff << std::endl;
+  return nFailed == 0 ? 0 : 1;
+}
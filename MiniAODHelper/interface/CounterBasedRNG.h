@@ -0,0 +1,29 @@
+#ifndef MINIAODHELPER_COUNTERBASEDRNG_H
+#define MINIAODHELPER_COUNTERBASEDRNG_H
+
+// Counter-based random numbers (Philox4x32-10, Salmon et al., "Parallel
+// random numbers: as easy as 1, 2, 3", SC11). The output is a pure function
+// of (counter, key), so the numbers do not depend on the order in which they
+// are requested and there is no generator state to share between threads.
+
+// system include files
+#include <array>
+#include <stdint.h>
+
+
+class CounterBasedRNG {
+public:
+  typedef std::array<uint32_t,4> Counter;
+  typedef std::array<uint32_t,2> Key;
+
+  // 128 random bits for (counter, key)
+  static Counter philox(Counter counter, Key key);
+
+  // Standard normal deviate for (counter, key), from the Box-Muller transform
+  // of two 53 bit uniform deviates
+  static double gaussian(const Counter& counter, const Key& key);
+  // Batched version: out[i] = gaussian(counter, {key0[i], key1})
+  static void gaussians(const Counter& counter, const uint32_t* key0, const uint32_t key1, const unsigned int n, double* out);
+};
+
+#endif
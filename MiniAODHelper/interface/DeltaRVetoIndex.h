@@ -0,0 +1,85 @@
+#ifndef MINIAODHELPER_DELTARVETOINDEX_H
+#define MINIAODHELPER_DELTARVETOINDEX_H
+
+// Eta-sorted index over the objects of any number of veto collections, used
+// for the deltaR cleaning of jets (MiniAODHelper::GetDeltaRCleanedJets). The
+// objects to clean are swept in order of eta, so that each of them only tests
+// the veto objects within its eta window, with deltaR^2 and a wrapped phi
+// difference instead of trigonometric functions.
+
+// system include files
+#include <vector>
+
+
+class DeltaRVetoIndex {
+public:
+  DeltaRVetoIndex() {}
+  // Index over the veto collections, e.g. DeltaRVetoIndex(muons, electrons)
+  template <typename... Collections>
+  explicit DeltaRVetoIndex(const Collections&... vetos) { add(vetos...); }
+
+  void clear();
+  unsigned int size() const { return eta_.size(); }
+
+  // Adds the objects of collections with eta() and phi()
+  template <typename... Collections>
+  void add(const Collections&... vetos) { push(vetos...); sort(); }
+
+  // True if a veto object is within deltaR < dR
+  bool overlaps(const double eta, const double phi, const double dR) const;
+
+  // keep[i] is 1 if objects[i] has no veto object within deltaR < dR
+  template <typename Collection>
+  std::vector<unsigned char> keepMask(const Collection& objects, const double dR) const;
+  // Positions of the objects with keep[i] = 1, in the order of the collection
+  template <typename Collection>
+  std::vector<unsigned int> keptIndices(const Collection& objects, const double dR) const;
+
+private:
+  template <typename Collection, typename... Collections>
+  void push(const Collection& vetos, const Collections&... more);
+  void push() {}
+  void sort();
+  void sweep(const std::vector<double>& eta, const std::vector<double>& phi, const double dR, unsigned char* keep) const;
+
+  // sorted by eta
+  std::vector<double> eta_, phi_;
+};
+
+
+template <typename Collection, typename... Collections>
+void DeltaRVetoIndex::push(const Collection& vetos, const Collections&... more) {
+  for( const auto& veto: vetos ){
+    eta_.push_back(veto.eta());
+    phi_.push_back(veto.phi());
+  }
+  push(more...);
+}
+
+
+template <typename Collection>
+std::vector<unsigned char> DeltaRVetoIndex::keepMask(const Collection& objects, const double dR) const {
+  std::vector<double> eta, phi;
+  eta.reserve(objects.size());
+  phi.reserve(objects.size());
+  for( const auto& object: objects ){
+    eta.push_back(object.eta());
+    phi.push_back(object.phi());
+  }
+  std::vector<unsigned char> keep(eta.size(), 1);
+  sweep(eta, phi, dR, keep.data());
+  return keep;
+}
+
+
+template <typename Collection>
+std::vector<unsigned int> DeltaRVetoIndex::keptIndices(const Collection& objects, const double dR) const {
+  const std::vector<unsigned char> keep = keepMask(objects, dR);
+  std::vector<unsigned int> kept;
+  for( unsigned int i=0; i<keep.size(); ++i ){
+    if( keep[i] ) kept.push_back(i);
+  }
+  return kept;
+}
+
+#endif
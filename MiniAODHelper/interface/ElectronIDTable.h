@@ -0,0 +1,87 @@
+#ifndef MINIAODHELPER_ELECTRONIDTABLE_H
+#define MINIAODHELPER_ELECTRONIDTABLE_H
+
+// Cut-based electron IDs and electron effective areas read from the text
+// files in data/electronID, so that a new ID campaign is a new file rather
+// than new code.
+//
+// A campaign file holds the cuts of all working points of one campaign as
+// upper bounds per variable and region (barrel or endcap). The variables of
+// a set of electrons are gathered once into an ElectronIDTable::Block, a
+// structure of arrays, and evaluate() tests all working points of the
+// campaign in one pass: the inner loops run over the electrons without
+// branches, so that the compiler can vectorise them.
+//
+// The tables are filled once and then only read: shared() hands out one
+// const table per file, which all helpers of the process use without locking.
+
+// system include files
+#include <memory>
+#include <string>
+#include <vector>
+
+
+class EffectiveAreaTable {
+public:
+  // Rows "etaMin etaMax area"; lines starting with # are comments.
+  // Throws a cms::Exception if the file cannot be read.
+  void read(const std::string& fileName);
+  static std::shared_ptr<const EffectiveAreaTable> shared(const std::string& fileName);
+
+  // Area of the first bin with etaMin <= absEta < etaMax, 9999 if there is
+  // none (which removes all neutral isolation)
+  double area(const double absEta) const;
+
+private:
+  std::vector<double> etaMin_, etaMax_, area_;
+};
+
+
+class ElectronIDTable {
+public:
+  // Variables of the cuts. conversion is 1 for electrons that fail the
+  // conversion veto, 0 otherwise.
+  enum Variable { full5x5_sigmaIetaIeta, dEtaIn, dEtaInSeed, dPhiIn, hOverE, ooEmooP,
+		  d0, dZ, missingInnerHits, conversion, relIso, nVariables };
+  // Working points per campaign, bits of the masks of evaluate()
+  static const unsigned int maxWorkingPoints = 32;
+
+  // Variables of n electrons: values[v][i] is variable v of electron i
+  struct Block {
+    void resize(const unsigned int n);
+    unsigned int size() const { return endcap.size(); }
+
+    std::vector<double> values[nVariables];
+    std::vector<unsigned char> endcap; // 0: barrel cuts, 1: endcap cuts
+  };
+
+  // File format, lines starting with # are comments:
+  //   effectiveAreas <name>                 effective areas of relIso, e.g. spring16
+  //   workingPoints <name> <name> ...
+  //   <variable> <EB|EE> <<|<=> <cut of each working point>
+  // A cut can override the comparison of its line, as in <=0.0103 or <0.0103.
+  // Variables without a line are not cut on. Throws a cms::Exception if the
+  // file cannot be read or is malformed.
+  void read(const std::string& fileName);
+  static std::shared_ptr<const ElectronIDTable> shared(const std::string& fileName);
+
+  const std::string& effectiveAreas() const { return effectiveAreas_; }
+  const std::vector<std::string>& workingPoints() const { return workingPoints_; }
+  // Index of the working point, -1 if there is none
+  int workingPoint(const std::string& name) const;
+
+  // masks[i] gets bit w if electron i passes working point w
+  void evaluate(const Block& block, unsigned int* masks) const;
+
+private:
+  static Variable variable(const std::string& name);
+
+  std::string effectiveAreas_;
+  std::vector<std::string> workingPoints_;
+  // upper bounds (x < cut), cuts_[(w*nVariables+v)*2+region]
+  std::vector<double> cuts_;
+  // variables with a cut, per working point
+  std::vector<std::vector<Variable> > variables_;
+};
+
+#endif
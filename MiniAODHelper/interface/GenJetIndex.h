@@ -0,0 +1,34 @@
+#ifndef MINIAODHELPER_GENJETINDEX_H
+#define MINIAODHELPER_GENJETINDEX_H
+
+// Per-event eta-sorted index over the gen jets, used for the gen jet matching
+// of the JER smearing. Only the gen jets within the eta window of the cone
+// are tested, so matching all jets of an event costs O(n log n) instead of
+// O(n_jets * n_genjets).
+
+// system include files
+#include <vector>
+
+#include "DataFormats/JetReco/interface/GenJetCollection.h"
+
+
+class GenJetIndex {
+public:
+  void build(const reco::GenJetCollection& genjets);
+  void clear();
+
+  unsigned int size() const { return index_.size(); }
+
+  // Position in the gen jet collection of the gen jet with deltaR < Rcone/2
+  // and |pt-genpt| < maxDPt that has the smallest |pt-genpt|, -1 if there is
+  // none. Ties are resolved as in MiniAODHelper::GenJet_Match, which scans the
+  // collection in order and keeps the last one.
+  int match(const double pt, const double eta, const double phi, const double Rcone, const double maxDPt) const;
+
+private:
+  // sorted by eta
+  std::vector<double> eta_, phi_, pt_;
+  std::vector<unsigned int> index_;
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef MINIAODHELPER_JECUNCERTAINTYTABLE_H
+#define MINIAODHELPER_JECUNCERTAINTYTABLE_H
+
+// JEC uncertainty sources compiled into flat eta x pt grids. Each pt segment
+// of each eta bin stores the coefficients of the linear interpolation for the
+// up and down variation, so that a lookup is a bin search plus a*pt+b. The
+// sources are addressed by Systematics::Type, and the values agree with the
+// ones of JetCorrectionUncertainty::getUncertainty.
+//
+// A table is filled once and then only read: shared() hands out one const
+// table per payload and set of sources, which all helpers of the process
+// (e.g. the stream copies of a module) use without locking.
+
+// system include files
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CondFormats/JetMETObjects/interface/JetCorrectorParameters.h"
+#include "MiniAOD/MiniAODHelper/interface/Systematics.h"
+
+
+class JECUncertaintyTable {
+public:
+  // Register type for the source label. The source is compiled from
+  // parameters unless a source with this label is already present.
+  void addSource(const Systematics::Type type, const std::string& label, const JetCorrectorParameters& parameters);
+  bool hasSource(const Systematics::Type type) const;
+  // Labels of the compiled sources, in the order they were added
+  std::vector<std::string> labels() const;
+  void clear();
+
+  // Table registered under key, which identifies the payload and the sources.
+  // If there is none, it is filled by build and registered. It is released
+  // with the last user; concurrent callers wait for a single build.
+  static std::shared_ptr<const JECUncertaintyTable> shared(const std::string& key, const std::function<void(JECUncertaintyTable&)>& build);
+
+  // Uncertainty of type for a jet with CORRECTED pt and eta. The value is
+  // signed, scale the JES by (1+value) for both up and down variations.
+  float uncertainty(const Systematics::Type type, const float pt, const float eta) const;
+  // Same for nJets jets and all types in one call: the value of jet i and
+  // types[j] is stored at out[i*types.size()+j]
+  void uncertainties(const float* pt, const float* eta, const unsigned int nJets,
+		     const std::vector<Systematics::Type>& types, float* out) const;
+
+private:
+  // Eta bins and pt nodes, shared by the sources with identical binning
+  struct Layout {
+    std::vector<float> etaMin, etaMax;   // per eta bin, ascending
+    std::vector<unsigned int> ptOffset;  // per eta bin + 1, into ptNodes
+    std::vector<float> ptNodes;
+  };
+  // Interpolation coefficients of one source. Eta bin e with n pt nodes owns
+  // the n+1 segments starting at ptOffset[e]+e: segment 0 and n hold the
+  // constant values below the first and above the last node.
+  struct Source {
+    std::string label;
+    unsigned int layout;
+    std::vector<float> aUp, bUp, aDown, bDown;
+  };
+  struct TypeEntry {
+    int source; // -1: not registered
+    bool up;
+  };
+
+  void compile(Source& source, const JetCorrectorParameters& parameters);
+  unsigned int findLayout(const Layout& layout);
+  // Index of the segment for (pt,eta), -1 if eta is outside of all bins
+  int segment(const Layout& layout, const float pt, const float eta) const;
+  const TypeEntry& entry(const Systematics::Type type) const;
+
+  std::vector<Layout> layouts_;
+  std::vector<Source> sources_;
+  std::vector<TypeEntry> types_; // indexed by Systematics::Type
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef MINIAODHELPER_JERTABLE_H
+#define MINIAODHELPER_JERTABLE_H
+
+// JER pt resolution and scale factor payloads compiled into flat eta/rho
+// grids. The resolution formula is evaluated in closed form, and the nominal,
+// down and up scale factors come out of one lookup. The values agree with
+// JME::JetResolution::getResolution and JME::JetResolutionScaleFactor::getScaleFactor,
+// including their bin definition (first record with min <= value <= max),
+// the clipping of the pt to the record range and the value 1 outside of all bins.
+
+// system include files
+#include <vector>
+
+#include "CondFormats/JetMETObjects/interface/JetResolutionObject.h"
+
+
+class JERTable {
+public:
+  // Compile the payloads. False if the binning or formula is not supported,
+  // in which case the caller keeps using the JME objects.
+  bool compileResolution(const JME::JetResolutionObject& object);
+  bool compileScaleFactor(const JME::JetResolutionObject& object);
+  bool hasResolution() const { return !etaMin_.empty(); }
+  bool hasScaleFactor() const { return !sfEtaMin_.empty(); }
+  void clear();
+
+  float resolution(const float pt, const float eta, const float rho) const;
+  // sf[0], sf[1], sf[2]: nominal, down and up, as in Variation
+  void scaleFactors(const float eta, float sf[3]) const;
+
+private:
+  // Index of the first bin with min <= value <= max in ascending,
+  // non-overlapping bins [begin,end), -1 if there is none
+  static int findBin(const std::vector<float>& min, const std::vector<float>& max,
+		     const unsigned int begin, const unsigned int end, const float value);
+
+  // resolution: eta bins, each with its rho bins
+  std::vector<float> etaMin_, etaMax_;
+  std::vector<unsigned int> rhoOffset_; // per eta bin + 1, into the per rho bin vectors
+  std::vector<float> rhoMin_, rhoMax_, ptMin_, ptMax_;
+  std::vector<float> par_; // 4 per rho bin
+
+  // scale factors: eta bins
+  std::vector<float> sfEtaMin_, sfEtaMax_;
+  std::vector<float> sf_; // 3 per eta bin
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef MINIAODHELPER_JETCORRECTIONFORMULA_H
+#define MINIAODHELPER_JETCORRECTIONFORMULA_H
+
+// Formula of a JetCorrectorParameters payload, compiled once instead of being
+// interpreted by TFormula for every jet. The standard L1FastJet, L1RC,
+// L2Relative and L3Absolute formulas are mapped to C++ functions; any other
+// expression is translated into a flat stack program. Supported are numbers,
+// parameters [i], the variables x, y, z, t, + - * / ^, and the functions
+// max, min, pow, log, log10, exp, sqrt, abs/fabs with or without TMath::.
+
+// system include files
+#include <string>
+#include <vector>
+
+
+class JetCorrectionFormula {
+public:
+  // False if the expression cannot be compiled
+  bool compile(const std::string& expression);
+  bool isNative() const { return native_ != 0; }
+  // Number of variables and parameters the formula reads
+  unsigned int nVariables() const { return nVariables_; }
+  unsigned int nParameters() const { return nParameters_; }
+
+  // x: the variables x, y, z, t; p: the parameters
+  double operator()(const double* x, const double* p) const {
+    return native_ ? native_(x, p) : run(x, p);
+  }
+
+private:
+  enum Op { Const, Var, Par, Neg, Add, Sub, Mul, Div, Pow, Max, Min, Log, Log10, Exp, Sqrt, Abs };
+  struct Instruction {
+    Op op;
+    unsigned int index;
+    double value;
+  };
+
+  double run(const double* x, const double* p) const;
+
+  // recursive descent, appending to program_
+  bool parseSum(const std::string& s, size_t& pos);
+  bool parseProduct(const std::string& s, size_t& pos);
+  bool parseUnary(const std::string& s, size_t& pos);
+  bool parsePower(const std::string& s, size_t& pos);
+  bool parsePrimary(const std::string& s, size_t& pos);
+  void emit(const Op op, const unsigned int index = 0, const double value = 0.);
+
+  double (*native_)(const double*, const double*) = 0;
+  std::vector<Instruction> program_;
+  unsigned int depth_ = 0, stackSize_ = 0;
+  unsigned int nVariables_ = 0, nParameters_ = 0;
+};
+
+#endif
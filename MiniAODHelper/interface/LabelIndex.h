@@ -0,0 +1,78 @@
+#ifndef MINIAODHELPER_LABELINDEX_H
+#define MINIAODHELPER_LABELINDEX_H
+
+// Position of a b-tag discriminator (pat::Jet) or tau ID (pat::Tau) label in
+// the (label, value) pairs of the objects. pat::Jet::bDiscriminator and
+// pat::Tau::tauID compare the label with every stored label on each call;
+// all objects of a collection store the same labels in the same order, so
+// the position is resolved once, on the first object of a collection, and
+// the values are then read by index.
+//
+// resolve() first checks the position found before, so that a cache kept for
+// the whole job costs one label comparison per collection. The value of an
+// object is read at the position only if its label there is the requested
+// one; objects that store their labels in another order, or without the
+// label, fall back to the lookup by name.
+
+// system include files
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "DataFormats/PatCandidates/interface/Jet.h"
+#include "DataFormats/PatCandidates/interface/Tau.h"
+
+
+namespace labelIndex {
+  inline const std::vector<std::pair<std::string, float> >& pairs(const pat::Jet& jet) { return jet.getPairDiscri(); }
+  inline float lookup(const pat::Jet& jet, const std::string& label) { return jet.bDiscriminator(label); }
+
+  inline const std::vector<pat::Tau::IdPair>& pairs(const pat::Tau& tau) { return tau.tauIDs(); }
+  inline float lookup(const pat::Tau& tau, const std::string& label) { return tau.tauID(label); }
+}
+
+
+template <typename T>
+class LabelIndex {
+public:
+  explicit LabelIndex(const std::string& label) : label_(label) {}
+
+  const std::string& label() const { return label_; }
+  bool resolved() const { return index_ >= 0; }
+
+  // Position of the label in the first object of a collection, false if the
+  // label is not present
+  bool resolve(const T& first) {
+    const std::vector<std::pair<std::string, float> >& pairs = labelIndex::pairs(first);
+    if( matches(pairs) ) return true;
+    index_ = -1;
+    for( unsigned int i=0; i<pairs.size(); ++i ){
+      if( pairs[i].first == label_ ){
+	index_ = i;
+	break;
+      }
+    }
+    return index_ >= 0;
+  }
+  bool resolve(const std::vector<T>& collection) { return !collection.empty() && resolve(collection.front()); }
+
+  // Value of the label for an object of the resolved collection
+  float operator()(const T& object) const {
+    const std::vector<std::pair<std::string, float> >& pairs = labelIndex::pairs(object);
+    if( matches(pairs) ) return pairs[index_].second;
+    return labelIndex::lookup(object, label_);
+  }
+
+private:
+  bool matches(const std::vector<std::pair<std::string, float> >& pairs) const {
+    return index_ >= 0 && unsigned(index_) < pairs.size() && pairs[index_].first == label_;
+  }
+
+  std::string label_;
+  int index_ = -1;
+};
+
+typedef LabelIndex<pat::Jet> BTagIndex;
+typedef LabelIndex<pat::Tau> TauIDIndex;
+
+#endif
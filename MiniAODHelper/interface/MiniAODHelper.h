@@ -4,6 +4,7 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <cstdint>
 #include <exception>
 #include <cmath>
 #include <iomanip>
@@ -68,8 +69,19 @@
 #include "FWCore/Framework/interface/Event.h"
 #include "FWCore/Framework/interface/EventSetup.h"
 #include "FWCore/Framework/interface/ESHandle.h"
+#include "FWCore/Utilities/interface/Exception.h"
 
 #include "MiniAOD/MiniAODHelper/interface/PUWeightProducer.h"
+#include "MiniAOD/MiniAODHelper/interface/PackedCandidateIndex.h"
+#include "MiniAOD/MiniAODHelper/interface/JECUncertaintyTable.h"
+#include "MiniAOD/MiniAODHelper/interface/CounterBasedRNG.h"
+#include "MiniAOD/MiniAODHelper/interface/GenJetIndex.h"
+#include "MiniAOD/MiniAODHelper/interface/DeltaRVetoIndex.h"
+#include "MiniAOD/MiniAODHelper/interface/JERTable.h"
+#include "MiniAOD/MiniAODHelper/interface/ElectronIDTable.h"
+#include "MiniAOD/MiniAODHelper/interface/LabelIndex.h"
+#include "MiniAOD/MiniAODHelper/interface/PayloadCache.h"
+#include "MiniAOD/MiniAODHelper/interface/StandaloneJetCorrector.h"
 
 #include "DataFormats/MuonReco/interface/MuonSelectors.h"
 
@@ -90,6 +102,11 @@ typedef std::vector<int> vint;
 
 namespace analysisType{ enum analysisType{ LJ, DIL, TauLJ, TauDIL }; }
 namespace jetID{		enum jetID{			none, jetPU, jetMinimal, jetLooseAOD, jetLoose, jetTight, jetMETcorrection }; }
+// Bits of MiniAODHelper::GetJetIDMask: 1<<id for the jetID working points, and the CSV working points
+namespace jetIDMask{
+  inline unsigned int bit(const jetID::jetID id){ return 1u<<id; }
+  const unsigned int csvL = 1u<<8, csvM = 1u<<9, csvT = 1u<<10;
+}
 namespace tauID { enum tauID{ tauNonIso, tauRaw, tauLoose, tauMedium, tauTight }; }
 namespace tau { enum ID { nonIso, loose, medium, tight }; }
 namespace SelfVetoPolicy { enum SelfVetoPolicy {selfVetoNone=0, selfVetoAll=1, selfVetoFirst=2};}
@@ -126,11 +143,77 @@ namespace electronID{
       electronGeneralPurposeMVA2016WP80,electronGeneralPurposeMVA2016WP90 // MVA IDs for 80X with 80 and 90 percent eff.
    };
 }
+// Bits of MiniAODHelper::EvaluateMuonIDs and EvaluateElectronIDs: 1<<id per working point
+namespace leptonIDMask{
+  inline uint64_t bit(const muonID::muonID id){ return uint64_t(1)<<id; }
+  inline uint64_t bit(const electronID::electronID id){ return uint64_t(1)<<id; }
+  const uint64_t all = ~uint64_t(0);
+}
 namespace hdecayType{	enum hdecayType{ hbb, hcc, hww, hzz, htt, hgg, hjj, hzg }; }
 namespace coneSize{ enum coneSize{miniIso,R03,R04};}
-namespace corrType{ enum corrType{deltaBeta,rhoEA};}
+// puppiWeighted: sums of pt times PUPPI weight over the packed candidates in the
+// cone of coneSize, without pileup correction or effective areas. Muons use the
+// 0.0001 (charged) and 0.01 (neutral, pt > 0.5) vetoes of pfIsolationR03/R04;
+// electrons get the endcap inner radii 0.015 (charged) and 0.08 (photons) only
+// with coneSize::miniIso, plain R03/R04 cones have no inner radius.
+namespace corrType{ enum corrType{deltaBeta,rhoEA,puppiWeighted};}
 namespace effAreaType{ enum effAreaType{fall17,spring16,spring15,phys14};}
 
+// Cone definition for the batched isolation sums (MiniAODHelper::GetIsolationSums).
+// Inner radii and thresholds are given per packed candidate class; the *EE
+// inner radii replace the barrel ones for endcap electrons (< 0: same as barrel).
+struct IsoCone {
+  float dR;                  // outer radius; <= 0 selects the mini-isolation radius 10/min(max(pt,50),200)
+  float innerRCharged, innerRPhoton, innerRNeutralHadron, innerRPileup;
+  float innerRChargedEE, innerRPhotonEE, innerRPileupEE;
+  float thresholdCharged, thresholdNeutral, thresholdPileup;
+  bool includeHF;            // also count the neutral candidates other than photons and neutral hadrons (HF)
+  SelfVetoPolicy::SelfVetoPolicy selfVeto;
+};
+
+// Raw isolation sums of one (lepton, cone) pair
+struct IsoSums {
+  float charged, neutral, pileup;
+};
+
+// Charged packed candidate with its relative track isolation (MiniAODHelper::GetIsolatedTracks)
+struct IsolatedTrack {
+  unsigned int key; // position in the packed candidate collection
+  float pt;
+  float relIso;
+};
+
+// Corrected jet without the pat::Jet payload: index into the source collection,
+// corrected kinematics and the cached CSV value (MiniAODHelper::GetCorrectedJetViews).
+// jes*jer scales the p4 of the source jet to the corrected p4.
+struct CorrectedJetView {
+  unsigned int index;
+  float pt, eta, phi, mass;
+  float jes;  // JES factor, including the uncertainty variation
+  float jer;  // JER factor
+  float csv;  // MiniAODHelper::GetJetCSV of the source jet
+  float factor() const { return jes*jer; }
+};
+
+// Correction metadata of a jet (MiniAODHelper::GetJetCorrectionInfos), in place
+// of the HelperJES* user floats
+struct JetCorrectionInfo {
+  float jes;        // JES of the jet corrector, as HelperJES
+  float jer;        // JER factor
+  float jesUp;      // 1+uncertainty at the corrected pt, 1 unless requested
+  float jesDown;
+  int genJetIndex;  // gen jet matched for the JER, -1 if none
+};
+
+// MVA ID output of an electron without the pat::Electron payload: index into
+// the electron collection and the values of the MVA producer's value maps
+// (MiniAODHelper::GetElectronMVAids)
+struct ElectronMVAid {
+  unsigned int index;
+  float value;
+  int category; // 0-2: pt < 10, 3: |eta| < 0.8, 4: barrel |eta| >= 0.8, 5: endcap
+};
+
 using namespace std;
 
 //To use when the object is either a reference or a pointer
@@ -157,8 +240,18 @@ class MiniAODHelper{
   void SetBoostedJetCorrector(const JetCorrector*);
 
   void UpdateJetCorrectorUncertainties(const edm::EventSetup& iSetup);
+  // Preload the JEC uncertainty table and check that it has the sources of
+  // types (non-JEC types are ignored)
+  void SetJECUncertaintyTypes(const edm::EventSetup& iSetup, const std::vector<Systematics::Type>& types);
+  void SetJECUncertaintyTypes(const edm::EventSetup& iSetup, const SystematicSet& types) { SetJECUncertaintyTypes(iSetup, types.types()); }
 
   void SetJER_SF_Tool(const edm::EventSetup& iSetup );
+  // Attach the HelperJES, HelperJESUp and HelperJESDown user floats to the
+  // corrected jets, as before. On by default; callers that read the
+  // corrections from GetJetCorrectionInfos can turn them off.
+  void SetJetCorrectionUserFloats(const bool addUserFloats) { jetCorrectionUserFloats_ = addUserFloats; }
+  // Seed mixed into the stochastic JER smearing, see GetJERGaussian
+  void SetJERSeed(const unsigned int seed) { jerSeed_ = seed; }
 
   // temporary construction...
   void SetAK8JetCorrectorUncertainty(const edm::EventSetup& iSetup, 
@@ -168,17 +261,85 @@ class MiniAODHelper{
 
   virtual std::vector<pat::Muon> GetSelectedMuons(const std::vector<pat::Muon>&, const float, const muonID::muonID, const coneSize::coneSize = coneSize::R04, const corrType::corrType = corrType::deltaBeta, const float = 2.4);
   virtual std::vector<pat::Electron> GetSelectedElectrons(const std::vector<pat::Electron>&, const float, const electronID::electronID, const float = 2.4);
+  // Working points a lepton passes: leptonIDMask::bit(id) for each of the
+  // requested ids that it passes, including the isolation but not the pt and
+  // eta requirements of the ID. The quantities shared between working points
+  // (isolation, impact parameters, supercluster eta) are computed once.
+  uint64_t EvaluateMuonIDs(const pat::Muon&, const uint64_t ids, const coneSize::coneSize = coneSize::R04, const corrType::corrType = corrType::deltaBeta);
+  std::vector<uint64_t> EvaluateMuonIDs(const std::vector<pat::Muon>&, const uint64_t ids, const coneSize::coneSize = coneSize::R04, const corrType::corrType = corrType::deltaBeta);
+  uint64_t EvaluateElectronIDs(const pat::Electron&, const uint64_t ids);
+  std::vector<uint64_t> EvaluateElectronIDs(const std::vector<pat::Electron>&, const uint64_t ids);
+  // Selection by pt, eta and masks[i] of lepton i
+  std::vector<pat::Muon> GetSelectedMuons(const std::vector<pat::Muon>&, const std::vector<uint64_t>& masks, const float, const muonID::muonID, const float = 2.4);
+  std::vector<pat::Electron> GetSelectedElectrons(const std::vector<pat::Electron>&, const std::vector<uint64_t>& masks, const float, const electronID::electronID, const float = 2.4);
   std::vector<pat::Tau> GetSelectedTaus(const std::vector<pat::Tau>&, const float, const tau::ID);
   std::vector<pat::Jet> GetSelectedJets(const std::vector<pat::Jet>&, const float, const float, const jetID::jetID, const char);
   std::vector<pat::Jet> GetUncorrectedJets(const std::vector<pat::Jet>&);
   std::vector<pat::Jet> GetUncorrectedJets(edm::Handle<pat::JetCollection>);
+  // View variants of the above: no pat::Jet is copied, the views refer to the jets by index
+  std::vector<CorrectedJetView> GetJetViews(const std::vector<pat::Jet>&);
+  std::vector<CorrectedJetView> GetUncorrectedJetViews(const std::vector<pat::Jet>&);
+  std::vector<CorrectedJetView> GetSelectedJetViews(const std::vector<CorrectedJetView>&, const std::vector<pat::Jet>& sourceJets, const float, const float, const jetID::jetID, const char);
+  // Jet ID and CSV working points a jet passes, see jetIDMask. The jet components
+  // are read once for all working points; eta selects the ID region.
+  unsigned int GetJetIDMask(const pat::Jet&, const double eta, const float csv);
+  // GetJetIDMask of each jet. The masks do not change with the jet corrections,
+  // so one array serves all corrected views of the jets.
+  std::vector<unsigned int> GetJetIDMasks(const std::vector<pat::Jet>&);
+  static bool PassesJetIDMask(const unsigned int mask, const jetID::jetID, const char);
+  // Selections as mask tests, masks[i] from GetJetIDMasks for source jet i
+  std::vector<unsigned int> GetSelectedJetIndices(const std::vector<pat::Jet>&, const std::vector<unsigned int>& masks, const float, const float, const jetID::jetID, const char);
+  std::vector<CorrectedJetView> GetSelectedJetViews(const std::vector<CorrectedJetView>&, const std::vector<unsigned int>& masks, const float, const float, const jetID::jetID, const char);
+  CorrectedJetView GetCorrectedJetView(const std::vector<pat::Jet>&, const unsigned int index, const edm::Event&, const edm::EventSetup&, const edm::Handle<reco::GenJetCollection>&, const Systematics::Type iSysType=Systematics::NA, const bool doJES=true, const bool doJER=true, const float corrFactor = 1, const float uncFactor = 1);
+  std::vector<CorrectedJetView> GetCorrectedJetViews(const std::vector<pat::Jet>&, const edm::Event&, const edm::EventSetup&, const edm::Handle<reco::GenJetCollection>&, const Systematics::Type iSysType=Systematics::NA, const bool doJES=true, const bool doJER=true, const float corrFactor = 1, const float uncFactor = 1);
+  // Full pat::Jet for a view, for the few places that need one
+  pat::Jet GetJet(const CorrectedJetView&, const std::vector<pat::Jet>& sourceJets) const;
   pat::Jet GetCorrectedJet(const pat::Jet&, const edm::Event&, const edm::EventSetup&, const edm::Handle<reco::GenJetCollection>&, const Systematics::Type iSysType=Systematics::NA, const bool doJES=true, const bool doJER=true, const float corrFactor = 1, const float uncFactor = 1);
   float GetJetCorrectionFactor(const pat::Jet&, const edm::Event&, const edm::EventSetup&, const edm::Handle<reco::GenJetCollection>&, const Systematics::Type iSysType=Systematics::NA, const bool doJES=true, const bool doJER=true, const float corrFactor = 1, const float uncFactor = 1);
   pat::Jet GetCorrectedAK8Jet(const pat::Jet&, const edm::Event&, const edm::EventSetup&, const edm::Handle<reco::GenJetCollection>&, const Systematics::Type iSysType=Systematics::NA, const bool& doJES=true, const bool& doJER=true, const float& corrFactor = 1, const float& uncFactor = 1);
   float GetAK8JetCorrectionFactor(const pat::Jet&, const edm::Event&, const edm::EventSetup&, const edm::Handle<reco::GenJetCollection>&, const Systematics::Type iSysType=Systematics::NA, const bool& doJES=true, const bool& doJER=true, const float& corrFactor = 1, const float& uncFactor = 1);
   std::vector<pat::Jet> GetCorrectedJets(const std::vector<pat::Jet>&, const edm::Event&, const edm::EventSetup&, const edm::Handle<reco::GenJetCollection>&, const Systematics::Type iSysType=Systematics::NA, const bool& doJES=true, const bool& doJER=true, const float& corrFactor = 1, const float& uncFactor = 1);
-  //  std::vector<pat::Jet> GetCorrectedJets(const std::vector<pat::Jet>&, const Systematics::Type iSysType=Systematics::NA);
+  std::vector<pat::Jet> GetCorrectedJets(const std::vector<pat::Jet>&, const StandaloneJetCorrector&);
+  // Side table of the corrections of GetCorrectedJets, info[i] for jet i. The
+  // JES uncertainties are skipped without withUncertainties.
+  std::vector<JetCorrectionInfo> GetJetCorrectionInfos(const std::vector<pat::Jet>&, const edm::Event&, const edm::EventSetup&, const edm::Handle<reco::GenJetCollection>&, const Systematics::Type iSysType=Systematics::NA, const bool doJES=true, const bool doJER=true, const float corrFactor = 1, const float uncFactor = 1, const bool withUncertainties = true);
+
+  // Corrections of a jet collection for a set of systematics (GetJetCorrectionTable).
+  // factor(i,j) scales the input p4 of jet i to its corrected p4 under systematics[j].
+  struct JetCorrectionTable {
+    std::vector<Systematics::Type> systematics;
+    std::vector<float> jes;                                // nominal JES of the jet corrector, as HelperJES
+    std::vector<float> nominalFactors;                     // one per jet
+    std::vector<reco::Candidate::LorentzVector> nominalP4; // one per jet
+    std::vector<float> factors;                            // njets x systematics.size(), row-major
+    float factor(const unsigned int iJet, const unsigned int iSys) const { return factors[iJet*systematics.size()+iSys]; }
+    // Column of a systematic, -1 if it was not requested
+    int column(const Systematics::Type iSysType) const {
+      std::vector<Systematics::Type>::const_iterator it = std::find(systematics.begin(), systematics.end(), iSysType);
+      return it == systematics.end() ? -1 : int(it-systematics.begin());
+    }
+    // True if the factors of iSysType differ from the nominal ones
+    static bool varies(const Systematics::Type iSysType) {
+      return Systematics::isJECUncertainty(iSysType) || iSysType == Systematics::JERup || iSysType == Systematics::JERdown;
+    }
+    // True if the table holds the factors of iSysType
+    bool has(const Systematics::Type iSysType) const { return !varies(iSysType) || column(iSysType) >= 0; }
+    // Factor of jet iJet under iSysType, throws if the table does not have it
+    float factor(const unsigned int iJet, const Systematics::Type iSysType) const {
+      if( !varies(iSysType) ) return nominalFactors[iJet];
+      const int iSys = column(iSysType);
+      if( iSys < 0 ) throw cms::Exception("MissingJetCorrectionSystematic") << "Jet correction table has no factors for '" << Systematics::toString(iSysType) << "'";
+      return factor(iJet, (unsigned int)iSys);
+    }
+    // Appends the columns of other, a table of the same jets, that this table lacks
+    void merge(const JetCorrectionTable& other);
+  };
+  // The table is kept for the event: GetCorrectedJets, GetCorrectedJet and
+  // GetJetCorrectionFactor read the factors of the same jets from it, and
+  // systematics they ask for later are added to it as extra columns.
+  JetCorrectionTable GetJetCorrectionTable(const std::vector<pat::Jet>&, const edm::Event&, const edm::EventSetup&, const edm::Handle<reco::GenJetCollection>&, const std::vector<Systematics::Type>& sysTypes, const bool doJES=true, const bool doJER=true, const float corrFactor = 1, const float uncFactor = 1);
   std::vector<boosted::BoostedJet> GetCorrectedBoostedJets(const std::vector<boosted::BoostedJet>& inputBoostedJets, const edm::Event&, const edm::EventSetup&, const edm::Handle<reco::GenJetCollection>&, const Systematics::Type iSysType=Systematics::NA, const bool& doJES=true, const bool& doJER=true, const float& corrFactor = 1, const float& uncFactor = 1);
+  void CorrectBoostedJet(boosted::BoostedJet&, const edm::Event&, const edm::EventSetup&, const edm::Handle<reco::GenJetCollection>&, const Systematics::Type iSysType=Systematics::NA, const bool doJES=true, const bool doJER=true, const float corrFactor = 1, const float uncFactor = 1);
   std::vector<boosted::BoostedJet> GetSelectedBoostedJets(const std::vector<boosted::BoostedJet>&, const float, const float, const float, const float, const jetID::jetID, const string);
   std::vector<pat::PackedCandidate> GetPackedCandidates(void);
   bool passesMuonPOGIdTight(const pat::Muon&);
@@ -188,6 +349,7 @@ class MiniAODHelper{
   bool isGoodElectron(const pat::Electron& iElectron, const float iMinPt, const float iMaxEta,const electronID::electronID iElectronID);
   bool isGoodTau(const pat::Tau&, const float, const tau::ID);
   bool isGoodJet(const pat::Jet&, const float, const float, const jetID::jetID, const char);
+  bool isGoodJet(const CorrectedJetView&, const pat::Jet& sourceJet, const float, const float, const jetID::jetID, const char);
   //  virtual float GetMuonRelIso(const pat::Muon&) const;
   float GetMuonRelIso(const pat::Muon&) const;
   float GetMuonRelIso(const pat::Muon&, const coneSize::coneSize, const corrType::corrType, std::map<std::string,double>* miniIso_calculation_params = 0) const;
@@ -197,17 +359,45 @@ class MiniAODHelper{
   float GetElectronRelIso(const pat::Electron&, const coneSize::coneSize, const corrType::corrType, const effAreaType::effAreaType=effAreaType::phys14, std::map<std::string,double>* miniIso_calculation_params = 0) const;
   void AddElectronRelIso(pat::Electron&,const coneSize::coneSize, const corrType::corrType,const effAreaType::effAreaType=effAreaType::phys14,std::string userFloatName="relIso") const;
   void AddElectronRelIso(std::vector<pat::Electron>&,const coneSize::coneSize, const corrType::corrType,const effAreaType::effAreaType=effAreaType::phys14,std::string userFloatName="relIso") const;
+
+  // Standard cone definitions for GetIsolationSums
+  static IsoCone MuonMiniIsoCone();
+  static IsoCone ElectronMiniIsoCone();
+  static IsoCone FixedIsoCone(const float dR, const float innerR = 0);
+  // Charged, neutral and pileup sums for every (lepton, cone) pair, from a single
+  // pass over the packed candidates around each lepton. Muons come first, then
+  // electrons: the sums of lepton i and cone j are at [i*cones.size()+j].
+  std::vector<IsoSums> GetIsolationSums(const std::vector<pat::Muon>&, const std::vector<pat::Electron>&, const std::vector<IsoCone>& cones) const;
+  // Charged candidates from the PV (as selected in SetPackedCandidates) with pt >= minPt
+  // and relative track isolation below maxRelIso. The isolation sums the pt of the
+  // other charged PV candidates within dR, using the per-event charged index.
+  std::vector<IsolatedTrack> GetIsolatedTracks(const float minPt = 5., const float maxRelIso = 0.2, const float dR = 0.3) const;
   static float GetJetCSV(const pat::Jet&, const std::string = "pfCombinedInclusiveSecondaryVertexV2BJetTags");
+  // Same, with the position of the discriminator resolved in index
+  static float GetJetCSV(const pat::Jet&, const BTagIndex& index);
+  // Position of the CSVv2 discriminator, resolved on the first of jets
+  const BTagIndex& csvIndex(const std::vector<pat::Jet>& jets);
   bool PassesCSV(const pat::Jet&, const char);
+  bool PassesCSV(const float csvValue, const char);
+  // Cut-based IDs of the campaigns, with the cuts of data/electronID/cutBasedElectronID_*.txt
   bool PassElectronPhys14Id(const pat::Electron&, const electronID::electronID) const;
   bool PassElectronSpring15Id(const pat::Electron&, const electronID::electronID) const;
   vector<pat::Electron> GetElectronsWithMVAid(edm::Handle<edm::View<pat::Electron> > electrons, edm::Handle<edm::ValueMap<float> > mvaValues, edm::Handle<edm::ValueMap<int> > mvaCategories) const;
+  // MVA values and categories of all electrons, in the order of the collection.
+  // No electron is copied; GetElectronsWithMVAid is the same with copies that
+  // carry the values as user floats.
+  std::vector<ElectronMVAid> GetElectronMVAids(const edm::View<pat::Electron>& electrons, const edm::ValueMap<float>& mvaValues, const edm::ValueMap<int>& mvaCategories) const;
+  // Masks of the MVA IDs of electronID (leptonIDMask bits) for each entry of
+  // mvaIDs, reading the electrons by index
+  std::vector<uint64_t> EvaluateElectronMVAids(const edm::View<pat::Electron>& electrons, const std::vector<ElectronMVAid>& mvaIDs, const uint64_t ids);
   bool PassElectron80XId(const pat::Electron&, const electronID::electronID) const;
 
   bool InECALbarrel(const pat::Electron&) const;
   bool InECALendcap(const pat::Electron&) const;
   bool PassesMVAidPreselection(const pat::Electron&) const;
   bool PassesMVAidCuts(const pat::Electron& el, float cut0, float cut1, float cut2, bool b_requirePreselection = true ) const;
+  // Cut on the MVA value of the category only, without preselection
+  static bool PassesMVAidCuts(const ElectronMVAid& mvaID, float cut0, float cut1, float cut2);
   bool PassesMVAid80(const pat::Electron&) const;
   bool PassesMVAid90(const pat::Electron&) const;
   bool PassesNonTrigMVAid80(const pat::Electron& el) const;
@@ -218,9 +408,18 @@ class MiniAODHelper{
   void addVetos(const reco::Candidate &cand);
   void clearVetos();
   float isoSumRaw(const std::vector<const pat::PackedCandidate *> & cands, const reco::Candidate &cand, float dR, float innerR, float threshold, SelfVetoPolicy::SelfVetoPolicy selfVeto, int pdgId=-1) const;
+  float isoSumRaw(const PackedCandidateIndex & cands, const reco::Candidate &cand, float dR, float innerR, float threshold, SelfVetoPolicy::SelfVetoPolicy selfVeto, int pdgId=-1, bool puppiWeighted=false) const;
   int ttHFCategorization(const std::vector<reco::GenJet>&, const std::vector<int>&, const std::vector<int>&, const std::vector<int>&, const std::vector<int>&, const std::vector<reco::GenParticle>&, const std::vector<std::vector<int> >&, const std::vector<int>&, const std::vector<int>&, const std::vector<int>&, const std::vector<int>&, const std::vector<int>&, const std::vector<int>&, const double, const double);
   int GetHiggsDecay(edm::Handle<std::vector<reco::GenParticle> >&);
   std::vector<pat::Jet> GetDeltaRCleanedJets(const std::vector<pat::Jet>&, const std::vector<pat::Muon>&, const std::vector<pat::Electron>&, const double);
+  // deltaR cleaning against any number of veto collections without copying
+  // jets, e.g. GetDeltaRCleanedJetMask(jets, 0.4, muons, electrons): keep[i]
+  // is 1 if jet i has no veto object within deltaR < deltaRCut
+  template <typename... Vetos>
+  std::vector<unsigned char> GetDeltaRCleanedJetMask(const std::vector<pat::Jet>&, const double deltaRCut, const Vetos&... vetos) const;
+  // Positions of the jets with keep[i] = 1
+  template <typename... Vetos>
+  std::vector<unsigned int> GetDeltaRCleanedJetIndices(const std::vector<pat::Jet>&, const double deltaRCut, const Vetos&... vetos) const;
 
   enum TTbarDecayMode{
     ChNotDefined = 0 ,
@@ -234,7 +433,21 @@ class MiniAODHelper{
 			       TLorentzVector * antitop =0 );
 
   bool GenJet_Match( const pat::Jet&, const edm::Handle<reco::GenJetCollection>&, reco::GenJet&, const double& );
+  // Same, with the gen jet index cached for the event (GetGenJetIndex)
+  bool GenJet_Match( const edm::Event&, const pat::Jet&, const edm::Handle<reco::GenJetCollection>&, reco::GenJet&, const double& );
   bool jetdPtMatched(const pat::Jet& inputJet, const reco::GenJet& genjet);
+  bool jetdPtMatched(const double pt, const double eta, const double genpt);
+  const reco::GenJet* MatchGenJet(const double pt, const double eta, const double phi, const float resolution, const edm::Handle<reco::GenJetCollection>&, const GenJetIndex&, const double Rcone);
+  const GenJetIndex& GetGenJetIndex(const edm::Event&, const edm::Handle<reco::GenJetCollection>&);
+  float GetJERResolution(const double pt, const double eta) const;
+  float GetJERScaleFactor(const double eta, const Systematics::Type iSysType) const;
+  double GetJERRescaleFactor(const double pt, const double eta, const float resolution, const reco::GenJet* matched_genjet, const Systematics::Type iSysType, const double gaus);
+  // Standard normal deviate for the stochastic JER smearing of the jet with the
+  // given uncorrected direction, as a function of (run, lumi, event, jet, seed).
+  // All systematics share it.
+  double GetJERGaussian(const edm::Event&, const float eta, const float phi) const;
+  // Same for all jets of an event in one call
+  void GetJERGaussians(const edm::Event&, const std::vector<pat::Jet>&, std::vector<double>& out) const;
   double getJERfactor( const int, const double, const double, const double );
   std::vector<pat::MET> CorrectMET(const std::vector<pat::Jet>& oldJetsForMET, const std::vector<pat::Jet>& newJetsForMET, const std::vector<pat::MET>& pfMETs);
   // Return weight factor dependent on number of true PU interactions
@@ -270,15 +483,17 @@ class MiniAODHelper{
   double useRho;
   const std::vector<pat::PackedCandidate> * allcands_;
   std::vector<const pat::PackedCandidate *> charged_, neutral_, pileup_;
-  //  mutable std::vector<float> weights_;
+  PackedCandidateIndex chargedIndex_, neutralIndex_, pileupIndex_; // eta-phi grids over charged_, neutral_, pileup_
   std::vector<const reco::Candidate *> vetos_;
+  std::vector<bool> vetoedKeys_; // vetos_ that are part of *allcands_, by position in it
   reco::Vertex vertex;
 
   const JetCorrector* corrector = 0;
   const JetCorrector* ak8corrector = 0;
   FactorizedJetCorrector* useJetCorrector;
   //  std::unique_ptr<JetCorrectionUncertainty> jecUnc_;
-  std::map< std::string, std::unique_ptr<JetCorrectionUncertainty> > jecUncertainties_;
+  std::shared_ptr<const JECUncertaintyTable> jecUncertainties_; // shared, never modified
+  std::string jecUncertaintyPayload_;                            // payload of jecUncertainties_
   std::unique_ptr<JetCorrectionUncertainty> ak8jecUnc_;
   PUWeightProducer puWeightProducer_;
 
@@ -325,13 +540,118 @@ class MiniAODHelper{
   
   std::string jetTypeLabelForJECUncertainty_;
   std::string jecUncertaintyTxtFileName_;
-  JetCorrectionUncertainty* CreateJetCorrectorUncertainty(const edm::EventSetup& iSetup, 
-							  const std::string& jetTypeLabel,
-							  const std::string& uncertaintyLabel) const;
-  void AddJetCorrectorUncertainty(const edm::EventSetup& iSetup, const std::string& uncertaintyLabel);
+  PayloadCache jecUncertaintyCache_; // blob of jecUncertaintyTxtFileName_, if available
+  JetCorrectorParameters CreateJetCorrectorParameters(const edm::EventSetup& iSetup, 
+						      const std::string& jetTypeLabel,
+						      const std::string& uncertaintyLabel) const;
+  void AddJetCorrectorUncertainty(const edm::EventSetup& iSetup, const Systematics::Type iSysType);
+  std::string JECUncertaintyPayloadId(const edm::EventSetup& iSetup) const;
+  void LoadJECUncertainties(const edm::EventSetup& iSetup);
   double GetJECUncertainty(const pat::Jet& jet, const edm::EventSetup& iSetup, const Systematics::Type iSysType);
-
-
+  double GetJECUncertainty(const double pt, const double eta, const edm::EventSetup& iSetup, const Systematics::Type iSysType);
+  // GetJECUncertainty for all jets and types in one call: out[i*sysTypes.size()+j]
+  // for corrected pt[i], eta[i] and sysTypes[j]
+  void GetJECUncertainties(const std::vector<float>& pt, const std::vector<float>& eta, const edm::EventSetup& iSetup, const std::vector<Systematics::Type>& sysTypes, std::vector<float>& out);
+  void GetJetCorrectionFactors(const pat::Jet& jet,
+			       const edm::Event& event,
+			       const edm::EventSetup& setup,
+			       const edm::Handle<reco::GenJetCollection>& genjets,
+			       const Systematics::Type iSysType,
+			       const bool doJES,
+			       const bool doJER,
+			       const float corrFactor,
+			       const float uncFactor,
+			       double& jesFactor,
+			       double& jerFactor,
+			       JetCorrectionInfo* info = 0);
+  // Correction chain of FillJetCorrectionTable: corrector, JEC uncertainties
+  // and JER of the AK4 jets, or ak8corrector, ak8jecUnc_ and getJERfactor
+  enum class JetChain { AK4, AK8 };
+  // Nominal JES of the jet corrector of the chain, 1 without one
+  double GetNominalJES(const pat::Jet& jet, const edm::Event& event, const edm::EventSetup& setup, const JetChain chain = JetChain::AK4);
+  // JER factor on top of the JES factor jes, see the definition
+  double GetJERFactor(const pat::Jet& jet,
+		      const double jes,
+		      const edm::Event& event,
+		      const edm::Handle<reco::GenJetCollection>& genjets,
+		      const GenJetIndex& genJetIndex,
+		      const Systematics::Type iSysType,
+		      const reco::GenJet** matched_genjet = 0);
+  // JER factor of the AK8 chain, on top of the JES factor jes
+  double GetAK8JERFactor(const pat::Jet& jet,
+			 const double jes,
+			 const edm::Handle<reco::GenJetCollection>& genjets,
+			 const GenJetIndex& genJetIndex,
+			 const Systematics::Type iSysType,
+			 const float corrFactor,
+			 const float uncFactor);
+  // GetJECUncertainties for the AK8 chain, which has the JESup and JESdown
+  // uncertainties only (0 for the other sources)
+  void GetAK8JECUncertainties(const std::vector<float>& pt, const std::vector<float>& eta, const std::vector<Systematics::Type>& sysTypes, std::vector<float>& out);
+  void AddJetCorrectionUserFloats(pat::Jet& jet, const double jes, const edm::EventSetup& setup);
+  // Engine of GetJetCorrectionTable, for any set of jets
+  void FillJetCorrectionTable(const std::vector<const pat::Jet*>& jets,
+			      const edm::Event& event,
+			      const edm::EventSetup& setup,
+			      const edm::Handle<reco::GenJetCollection>& genjets,
+			      const std::vector<Systematics::Type>& sysTypes,
+			      const bool doJES,
+			      const bool doJER,
+			      const float corrFactor,
+			      const float uncFactor,
+			      JetCorrectionTable& table,
+			      const JetChain chain = JetChain::AK4);
+  // Factor and nominal JES of a jet under iSysType, from the cached table if
+  // it holds the jet (AK4 chain), else from a table of the jet alone
+  void GetJetCorrection(const pat::Jet& jet,
+			const edm::Event& event,
+			const edm::EventSetup& setup,
+			const edm::Handle<reco::GenJetCollection>& genjets,
+			const Systematics::Type iSysType,
+			const bool doJES,
+			const bool doJER,
+			const float corrFactor,
+			const float uncFactor,
+			float& factor,
+			float& jes,
+			const JetChain chain = JetChain::AK4);
+  // CorrectBoostedJet for several boosted jets: one table for all fat jets and
+  // one for all their constituents
+  void CorrectBoostedJets(const std::vector<boosted::BoostedJet*>&, const edm::Event&, const edm::EventSetup&, const edm::Handle<reco::GenJetCollection>&, const Systematics::Type iSysType, const bool doJES, const bool doJER, const float corrFactor, const float uncFactor);
+  bool PassesJetID(const pat::Jet&, const double eta, const jetID::jetID);
+  static unsigned int JetIDBits(const pat::Jet&, const double eta);
+  static bool InElectronCrack(const pat::Electron&);
+  // Variables of the cut-based electron IDs, except the relIso of the campaign
+  void FillElectronIDBlock(const std::vector<const pat::Electron*>&, ElectronIDTable::Block&) const;
+  // ORs leptonIDMask::bit(id) into masks[i] for the cut-based campaign IDs in
+  // ids that electrons[i] passes, each campaign evaluated for all electrons at once
+  void EvaluateElectronCutTables(const std::vector<const pat::Electron*>& electrons, const uint64_t ids, uint64_t* masks) const;
+  // electronID bits of the MVA IDs, and the ones of ids that the electron
+  // with the MVA output mvaID passes
+  static uint64_t ElectronMVAidIDs();
+  uint64_t EvaluateElectronMVAid(const pat::Electron&, const ElectronMVAid& mvaID, const uint64_t ids) const;
+
+
+
+  // Scratch of the isolation sums
+  struct IsoScratch {
+    std::vector<unsigned int> accepted, recheck;       // index positions
+    std::vector<std::pair<unsigned int,double> > hits; // (rank,pt)
+    std::vector<unsigned int> selfKeys;                // self-veto positions in *allcands_
+    std::vector<bool> self;                            // selfKeys as a bitmap, by position in *allcands_
+  };
+  // Isolation scratch of the event, sized in SetPackedCandidates. Like the
+  // other per-event state it belongs to the stream processing the event; the
+  // isolation functions of one helper must not be called concurrently.
+  mutable IsoScratch isoScratch_;
+  float isoSumRaw(IsoScratch&, const PackedCandidateIndex & cands, const reco::Candidate &cand, float dR, float innerR, float threshold, SelfVetoPolicy::SelfVetoPolicy selfVeto, int pdgId, bool puppiWeighted) const;
+  int PackedCandidateKey(const reco::Candidate *cand) const;
+  int PackedCandidateKey(const pat::PackedCandidate *cand) const;
+  void FillSelfVetoKeys(const reco::Candidate &cand, SelfVetoPolicy::SelfVetoPolicy selfVeto, IsoScratch&) const;
+  bool IsVetoed(const unsigned int key, const IsoScratch&) const;
+  // veto of a candidate outside *allcands_, by address
+  bool IsVetoedCandidate(const reco::Candidate *c, const reco::Candidate &cand, SelfVetoPolicy::SelfVetoPolicy selfVeto) const;
+  void FillIsolationSums(const reco::Candidate& lepton, const bool endcap, const std::vector<IsoCone>& cones, IsoScratch&, IsoSums* sums) const;
 
   void FillTopQuarkDecayInfomration ( const reco::Candidate * c ,
 				      struct _topquarkdecayobjects * topdecayobjects) ;
@@ -340,20 +660,68 @@ class MiniAODHelper{
 
   const reco::Candidate * GetObjectJustBeforeDecay( const reco::Candidate * particle );
 
-  std::vector<double>    JER_etaMin;
-  std::vector<double>    JER_etaMax;
-  std::vector<double>    JER_rhoMin;
-  std::vector<double>    JER_rhoMax;
-  std::vector<double>    JER_PtMin;
-  std::vector<double>    JER_PtMax;
-  std::vector<double>    JER_Par0;
-  std::vector<double>    JER_Par1;
-  std::vector<double>    JER_Par2;
-  std::vector<double>    JER_Par3;
-
   JME::JetResolution            JER_ak4_resolution ;
   JME::JetResolutionScaleFactor JER_ak4_resolutionSF ;
-  TRandom3 JERRandumGenerator ;
+  JERTable jerTable_;
+
+  // Positions of the discriminator labels, kept for the job
+  BTagIndex csvIndex_{"pfCombinedInclusiveSecondaryVertexV2BJetTags"};
+  enum TauIDLabel { tauDecayModeFindingNewDMs, tauAgainstMuonLoose3, tauAgainstMuonTight3,
+		    tauAgainstElectronVLooseMVA6, tauAgainstElectronLooseMVA6, tauAgainstElectronMediumMVA6,
+		    tauByLooseIsolation, tauByMediumIsolation, tauByTightIsolation, nTauIDLabels };
+  std::vector<TauIDIndex> tauIDIndices_; // by TauIDLabel
+  // isGoodTau with the tau IDs resolved
+  bool PassesTauSelection(const pat::Tau&, const float, const tau::ID) const;
+
+  // Cut-based electron ID campaigns, shared between helpers
+  enum ElectronIDCampaign { phys14ElectronID, spring15ElectronID, summer16ElectronID, nElectronIDCampaigns };
+  std::shared_ptr<const ElectronIDTable> electronIDTables_[nElectronIDCampaigns];
+  // electronID working points in the tables
+  struct ElectronCutTableID {
+    electronID::electronID id;
+    ElectronIDCampaign campaign;
+    const char* workingPoint;
+  };
+  static const ElectronCutTableID electronCutTableIDs_[10];
+  static uint64_t ElectronCutTableIDs();
+  bool PassesElectronCutTable(const pat::Electron&, const electronID::electronID, const ElectronIDCampaign) const;
+  // Electron effective areas, indexed by effAreaType
+  std::shared_ptr<const EffectiveAreaTable> electronEffectiveAreas_[4];
+  unsigned int jerSeed_ = 0;
+  bool jetCorrectionUserFloats_ = true;
+
+  // Table of GetJetCorrectionTable and GetCorrectedJets, with the event, input
+  // collection, gen jets, jet corrector and settings it was filled for. The
+  // jets of the table are those of the input collection, by index.
+  struct JetCorrectionCache {
+    edm::EventID event;
+    const pat::Jet* jets = 0;                             // first jet of the input collection
+    std::vector<reco::Candidate::LorentzVector> inputP4; // guards against a reused address
+    const reco::GenJetCollection* genjets = 0;
+    const JetCorrector* corrector = 0;
+    bool doJES = false, doJER = false;
+    float corrFactor = 1, uncFactor = 1;
+    JetCorrectionTable table;
+    bool matches(const edm::Event& iEvent, const edm::Handle<reco::GenJetCollection>& iGenjets, const JetCorrector* iCorrector, const bool iDoJES, const bool iDoJER, const float iCorrFactor, const float iUncFactor) const {
+      return iEvent.id() == event && (iGenjets.isValid() ? iGenjets.product() : 0) == genjets && iCorrector == corrector
+	&& iDoJES == doJES && iDoJER == doJER && iCorrFactor == corrFactor && iUncFactor == uncFactor;
+    }
+    bool holds(const std::vector<pat::Jet>& jets) const;
+    // Index of jet in the input collection, -1 if it is not one of its jets
+    int index(const pat::Jet& jet) const;
+  };
+  JetCorrectionCache jetCorrectionCache_;
+  // Makes jetCorrectionCache_ hold the factors of inputJets for sysTypes. A
+  // table of the same jets and settings only gets the columns it lacks.
+  const JetCorrectionTable& FillCachedJetCorrectionTable(const std::vector<pat::Jet>&, const edm::Event&, const edm::EventSetup&, const edm::Handle<reco::GenJetCollection>&, const std::vector<Systematics::Type>& sysTypes, const bool doJES, const bool doJER, const float corrFactor, const float uncFactor);
+  void AddCachedJetCorrectionColumns(const edm::Event&, const edm::EventSetup&, const edm::Handle<reco::GenJetCollection>&, const std::vector<Systematics::Type>& sysTypes);
+
+  GenJetIndex genJetIndex_;
+  const reco::GenJetCollection* genJetIndexProduct_ = 0;
+  edm::EventID genJetIndexEvent_;
+
+  static uint32_t JERJetKey(const float eta, const float phi);
+  static CounterBasedRNG::Counter JERCounter(const edm::Event&);
 
 }; // End of class prototype
 
@@ -368,7 +736,8 @@ template <typename T> T MiniAODHelper::GetSortedByPt(const T& collection){
 // === Returned sorted input collection, by descending CSV === //
 template <typename T> T MiniAODHelper::GetSortedByCSV(const T& collection){
   T result = collection;
-  std::sort(result.begin(), result.end(), [] (typename T::value_type a, typename T::value_type b) { return GetJetCSV(a,"pfCombinedInclusiveSecondaryVertexV2BJetTags") > GetJetCSV(b,"pfCombinedInclusiveSecondaryVertexV2BJetTags");});
+  const BTagIndex& csv = csvIndex(result);
+  std::sort(result.begin(), result.end(), [&csv] (const typename T::value_type& a, const typename T::value_type& b) { return GetJetCSV(a,csv) > GetJetCSV(b,csv);});
   return result;
 }
 
@@ -504,4 +873,15 @@ double MiniAODHelper::DeltaR( const PATObj2& two, const PATObj1& one ) const {
   return deltaR;
 }
 
+template <typename... Vetos>
+std::vector<unsigned char> MiniAODHelper::GetDeltaRCleanedJetMask(const std::vector<pat::Jet>& inputJets, const double deltaRCut, const Vetos&... vetos) const {
+  return DeltaRVetoIndex(vetos...).keepMask(inputJets, deltaRCut);
+}
+
+
+template <typename... Vetos>
+std::vector<unsigned int> MiniAODHelper::GetDeltaRCleanedJetIndices(const std::vector<pat::Jet>& inputJets, const double deltaRCut, const Vetos&... vetos) const {
+  return DeltaRVetoIndex(vetos...).keptIndices(inputJets, deltaRCut);
+}
+
 #endif // _MiniAODHelper_h
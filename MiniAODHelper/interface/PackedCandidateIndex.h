@@ -0,0 +1,117 @@
+#ifndef MINIAODHELPER_PACKEDCANDIDATEINDEX_H
+#define MINIAODHELPER_PACKEDCANDIDATEINDEX_H
+
+// Per-event eta-phi binned index over one class of packed PF candidates
+// (charged, neutral or pileup), used to restrict isolation sums to the
+// grid cells overlapping the cone. The kinematics are unpacked once into
+// contiguous arrays, which the cone selection reads instead of the packed
+// candidates.
+
+// system include files
+#include <cmath>
+#include <vector>
+
+#include "DataFormats/PatCandidates/interface/PackedCandidate.h"
+
+
+class PackedCandidateIndex {
+public:
+  PackedCandidateIndex();
+
+  // Rebuild the index. The input must be sorted by ascending eta, as done
+  // in MiniAODHelper::SetPackedCandidates; the position of a candidate in
+  // that input is kept as its rank. first points to the start of the event's
+  // packed candidate collection and defines key().
+  void build(const std::vector<const pat::PackedCandidate *>& etaSortedCands, const pat::PackedCandidate * first);
+  void clear();
+
+  unsigned int size() const { return cands_.size(); }
+
+  // Candidates are stored cell by cell, and in eta order within each cell
+  const pat::PackedCandidate * cand(const unsigned int i) const { return cands_[i]; }
+  unsigned int rank(const unsigned int i) const { return rank_[i]; }
+  // Position of the candidate in the event's packed candidate collection
+  unsigned int key(const unsigned int i) const { return key_[i]; }
+  float eta(const unsigned int i) const { return eta_[i]; }
+  float phi(const unsigned int i) const { return phi_[i]; }
+  float pt(const unsigned int i) const { return pt_[i]; }
+  int absPdgId(const unsigned int i) const { return absPdgId_[i]; }
+  float puppiWeight(const unsigned int i) const { return puppiWeight_[i]; }
+
+  // deltaR^2 between the candidate at position i and (eta,phi), in single
+  // precision
+  float deltaR2(const unsigned int i, const float eta, const float phi) const {
+    const float dEta = eta_[i] - eta;
+    float dPhi = phi_[i] - phi;
+    if( dPhi > float(M_PI) ) dPhi -= float(2*M_PI);
+    else if( dPhi < float(-M_PI) ) dPhi += float(2*M_PI);
+    return dEta*dEta + dPhi*dPhi;
+  }
+  // Generous bound on the single precision error of deltaR2 around a cone
+  // of radius^2 dR2, for |deta|,|dphi| < 2pi
+  static float rounding(const float dR2) { return 1.e-5f*(1.f+dR2); }
+
+  // Call f(begin,end) for each contiguous range of stored positions whose
+  // cells overlap the eta band [etaLo,etaHi] and the phi window phi +- dPhi.
+  // Every candidate with etaLo <= eta <= etaHi and |deltaPhi| < dPhi is
+  // guaranteed to be visited exactly once; callers apply the exact cuts.
+  template <typename F> void visitCone(const double etaLo, const double etaHi, const double phi, const double dPhi, F f) const;
+
+  // Select the positions in [begin,end) with innerR2 <= dR2' < dR2 around
+  // (eta,phi), pt >= threshold and |pdgId| == pdgId (pdgId <= 0: any). The
+  // test runs in single precision; positions within rounding distance of
+  // either cone boundary are appended to recheck instead of accepted, so
+  // callers can decide them with the exact cuts.
+  void selectInCone(const unsigned int begin, const unsigned int end,
+		    const float eta, const float phi, const float dR2, const float innerR2,
+		    const float threshold, const int pdgId,
+		    std::vector<unsigned int>& accepted, std::vector<unsigned int>& recheck) const;
+
+private:
+  static const int nEtaBins_ = 100;
+  static const int nPhiBins_ = 64;
+  static constexpr double etaMin_ = -5.;
+  static constexpr double etaMax_ = 5.;
+
+  int etaBin(const double eta) const;
+  int phiBin(const double phi) const;
+
+  std::vector<const pat::PackedCandidate *> cands_;
+  std::vector<unsigned int> rank_;
+  std::vector<unsigned int> key_;
+  std::vector<float> eta_, phi_, pt_, puppiWeight_;
+  std::vector<int> absPdgId_;
+  std::vector<unsigned int> cellStart_; // nEtaBins_*nPhiBins_+1 offsets into cands_
+};
+
+
+template <typename F>
+void PackedCandidateIndex::visitCone(const double etaLo, const double etaHi, const double phi, const double dPhi, F f) const {
+  if( cands_.empty() ) return;
+
+  const double phiWidth = 2*M_PI/nPhiBins_;
+  // one cell of margin on each side absorbs rounding at the cell edges
+  const int p0 = int(std::floor((phi-dPhi+M_PI)/phiWidth)) - 1;
+  const int p1 = int(std::floor((phi+dPhi+M_PI)/phiWidth)) + 1;
+  const bool fullPhi = (p1-p0+1 >= nPhiBins_);
+
+  for( int iEta = etaBin(etaLo), lastEta = etaBin(etaHi); iEta <= lastEta; ++iEta ){
+    const unsigned int row = iEta*nPhiBins_;
+    if( fullPhi ){
+      f(cellStart_[row], cellStart_[row+nPhiBins_]);
+    }
+    else if( p0 < 0 ){
+      f(cellStart_[row+nPhiBins_+p0], cellStart_[row+nPhiBins_]);
+      f(cellStart_[row], cellStart_[row+p1+1]);
+    }
+    else if( p1 >= nPhiBins_ ){
+      f(cellStart_[row+p0], cellStart_[row+nPhiBins_]);
+      f(cellStart_[row], cellStart_[row+p1-nPhiBins_+1]);
+    }
+    else {
+      f(cellStart_[row+p0], cellStart_[row+p1+1]);
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef MINIAODHELPER_PAYLOADCACHE_H
+#define MINIAODHELPER_PAYLOADCACHE_H
+
+// Precompiled binary form of the JEC/JER txt payloads in data/jec. Every
+// payload X.txt can be converted (bin/compileJECPayloads) into X.bin, which
+// holds the parsed values of all its sections. The blob is versioned and
+// checksummed and is read through mmap, so that a job does not have to
+// tokenise the txt file once per requested section. The blob records the size
+// and modification time of the txt file it was made from and is ignored if
+// they changed; the callers then fall back to parsing the txt file. Opening a
+// blob does not read the txt file.
+//
+// Two kinds of payloads are supported:
+//  - JetCorrectorParameters files, a {definitions} line and records, with
+//    optional [section] headers. A file without sections has the section "".
+//  - plain tables of numbers, e.g. the JER pt resolution, as one section "".
+
+// system include files
+#include <memory>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "CondFormats/JetMETObjects/interface/JetCorrectorParameters.h"
+
+
+class PayloadCache {
+public:
+  // Bump when the layout of the blob changes
+  static const unsigned int version = 2;
+
+  struct Section {
+    std::string name;
+    std::string definitions; // between the braces of the {definitions} line, empty for tables
+    std::vector<std::vector<double> > rows; // xMin, xMax and parameters of the records
+  };
+
+  // X.txt -> X.bin
+  static std::string blobName(const std::string& txtFile);
+
+  // Parse the txt payload and write its blob, false with the reason in error
+  // if the payload cannot be converted
+  static bool compile(const std::string& txtFile, std::string& error);
+
+  // Map the blob of txtFile, false if it does not exist, was made by another
+  // version or from another txt file, or is corrupt
+  bool open(const std::string& txtFile);
+  void close();
+  bool isOpen() const { return static_cast<bool>(data_); }
+
+  bool hasSection(const std::string& name) const { return sections_.count(name); }
+  bool rows(const std::string& name, std::vector<std::vector<double> >& out) const;
+  bool jetCorrectorParameters(const std::string& name, JetCorrectorParameters& out) const;
+
+private:
+  struct SectionIndex {
+    std::string definitions;
+    size_t rows; // offset of the row count in the payload
+  };
+
+  static bool readText(const std::string& txtFile, std::vector<Section>& sections, std::string& error);
+
+  std::shared_ptr<const char> data_; // whole mapped blob, shared between copies
+  size_t size_ = 0;
+  std::map<std::string, SectionIndex> sections_;
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef MINIAODHELPER_STANDALONEJETCORRECTOR_H
+#define MINIAODHELPER_STANDALONEJETCORRECTOR_H
+
+// Jet energy corrector that does not need the EventSetup, for FWLite and
+// ntuple-level reprocessing. It reads the JetCorrectorParameters txt payloads
+// of the levels (e.g. L1FastJet, L2Relative, L3Absolute, L2L3Residual) and
+// applies them in the given order, like FactorizedJetCorrector: the pt seen
+// by a level is the pt corrected by the levels before, the parameter
+// variables are clipped to the ranges of the record, and a jet outside of
+// all records of a level gets the factor 1 from it.
+//
+// The formulas are compiled (JetCorrectionFormula), and the records are
+// looked up by binary search in their bins. The binned and parameter
+// variables can be JetEta, JetPt, JetA and Rho; "Response" payloads, which
+// FactorizedJetCorrector inverts numerically, are not supported.
+
+// system include files
+#include <string>
+#include <vector>
+
+#include "CondFormats/JetMETObjects/interface/JetCorrectorParameters.h"
+
+#include "MiniAOD/MiniAODHelper/interface/JetCorrectionFormula.h"
+
+
+class StandaloneJetCorrector {
+public:
+  // Levels from txt files, read from their PayloadCache blob if there is
+  // one. Throws cms::Exception for payloads that are not supported.
+  explicit StandaloneJetCorrector(const std::vector<std::string>& txtFiles);
+  StandaloneJetCorrector() {}
+  // Append a level, e.g. from a JetCorrectorParametersCollection
+  void addLevel(const JetCorrectorParameters& parameters);
+
+  unsigned int nLevels() const { return levels_.size(); }
+
+  // Total correction of the raw jet
+  float correction(const float pt, const float eta, const float area, const float rho) const;
+
+  // Corrections of the n raw jets of an event with energy density rho, out[i]
+  // for jet i. The levels are applied to all jets in turn.
+  void corrections(const unsigned int n, const float* pt, const float* eta, const float* area, const float rho, float* out) const;
+  void corrections(const std::vector<float>& pt, const std::vector<float>& eta, const std::vector<float>& area, const float rho, std::vector<float>& out) const;
+
+private:
+  enum Variable { JetEta, JetPt, JetA, Rho };
+
+  struct Level {
+    std::vector<Variable> binVars, parVars;
+    JetCorrectionFormula formula;
+
+    // records: bin ranges (binVars.size() per record), ranges of the
+    // parameter variables (parVars.size() per record) and formula parameters
+    unsigned int nRecords = 0;
+    std::vector<float> xMin, xMax;
+    std::vector<float> parMin, parMax;
+    unsigned int nPar = 0; // formula parameters per record
+    std::vector<double> par;
+
+    // binary search in the first two bin variables: groups of records with
+    // equal bins in the first variable, ascending and not overlapping
+    bool sorted = false;
+    std::vector<float> groupMin, groupMax;
+    std::vector<unsigned int> groupOffset; // per group + 1, into the records
+  };
+
+  static void sortLevel(Level& level);
+  static int findRecord(const Level& level, const float* values);
+  // values: the jet in the order of Variable
+  static float levelCorrection(const Level& level, const float* values);
+
+  std::vector<Level> levels_;
+};
+
+#endif
@@ -1,8 +1,10 @@
 #ifndef SYSTEMATICS_H
 #define SYSTEMATICS_H
 
-#include <map>
+#include <bitset>
+#include <initializer_list>
 #include <string>
+#include <vector>
 
 class Systematics {
 public:
@@ -155,18 +157,42 @@ public:
     CSVCErr2down 
   };
 
+  enum Family { NoFamily, JES, JER, CSV, TES };
+
+  static constexpr unsigned int nTypes = CSVCErr2down+1;
+  // JEC uncertainty sources: the total (JESup/down) and the individual ones
+  static constexpr unsigned int nJECSources = 55;
+
+  // Properties of a type, see traits_
+  struct Traits {
+    Type type;
+    const char* name;   // toString
+    const char* label;  // GetJECUncertaintyLabel
+    Family family;
+    int direction;      // +1 up, -1 down, 0 for NA
+    int jecSource;      // 0 for JESup/down, 1.. for the individual JEC sources, -1 otherwise
+  };
+  static constexpr const Traits& traits(const Type type) { return traits_[unsigned(type) < nTypes ? type : NA]; }
+
+  static constexpr Family family(const Type type) { return traits(type).family; }
+  static constexpr int direction(const Type type) { return traits(type).direction; }
+  static constexpr bool isUp(const Type type) { return direction(type) > 0; }
+  static constexpr bool isDown(const Type type) { return direction(type) < 0; }
+  // index of the JEC uncertainty source (< nJECSources), -1 if not a JEC uncertainty
+  static constexpr int jecSourceIndex(const Type type) { return traits(type).jecSource; }
+
   // convert between string and int representation
   static Type get(const std::string& name);
   static std::string toString(const Type type);
 
   // true if type is one of the JEC-related uncertainties and up
-  static bool isJECUncertaintyUp(const Type type);
+  static constexpr bool isJECUncertaintyUp(const Type type) { return family(type) == JES && isUp(type); }
 
   // true if type is one of the JEC-related uncertainties and down
-  static bool isJECUncertaintyDown(const Type type);
+  static constexpr bool isJECUncertaintyDown(const Type type) { return family(type) == JES && isDown(type); }
 
   // true if type is one of the JEC-related uncertainties
-  static bool isJECUncertainty(const Type type);
+  static constexpr bool isJECUncertainty(const Type type) { return family(type) == JES; }
 
   // return the label that is used by JetCorrectorParametersCollection
   // to label the uncertainty type. See also:
@@ -175,13 +201,180 @@ public:
 
 
 private:
-  static std::map<Type,std::string> typeStringMap_;
-  static std::map<std::string,Type> stringTypeMap_;
-  static std::map<Type,std::string> typeLabelMap_;
+  // one entry per type, in the order of Type
+  static constexpr Traits traits_[nTypes] = {
+    { NA,                                      "",                                        "",                                  NoFamily,  0, -1 },
+    { JESup,                                   "JESup",                                   "Uncertainty",                       JES,       1,  0 },
+    { JESdown,                                 "JESdown",                                 "Uncertainty",                       JES,      -1,  0 },
+    { JESAbsoluteStatup,                       "JESAbsoluteStatup",                       "AbsoluteStat",                      JES,       1,  1 },
+    { JESAbsoluteScaleup,                      "JESAbsoluteScaleup",                      "AbsoluteScale",                     JES,       1,  2 },
+    { JESAbsoluteFlavMapup,                    "JESAbsoluteFlavMapup",                    "AbsoluteFlavMap",                   JES,       1,  3 },
+    { JESAbsoluteMPFBiasup,                    "JESAbsoluteMPFBiasup",                    "AbsoluteMPFBias",                   JES,       1,  4 },
+    { JESFragmentationup,                      "JESFragmentationup",                      "Fragmentation",                     JES,       1,  5 },
+    { JESSinglePionECALup,                     "JESSinglePionECALup",                     "SinglePionECAL",                    JES,       1,  6 },
+    { JESSinglePionHCALup,                     "JESSinglePionHCALup",                     "SinglePionHCAL",                    JES,       1,  7 },
+    { JESFlavorQCDup,                          "JESFlavorQCDup",                          "FlavorQCD",                         JES,       1,  8 },
+    { JESTimePtEtaup,                          "JESTimePtEtaup",                          "TimePtEta",                         JES,       1,  9 },
+    { JESRelativeJEREC1up,                     "JESRelativeJEREC1up",                     "RelativeJEREC1",                    JES,       1, 10 },
+    { JESRelativeJEREC2up,                     "JESRelativeJEREC2up",                     "RelativeJEREC2",                    JES,       1, 11 },
+    { JESRelativeJERHFup,                      "JESRelativeJERHFup",                      "RelativeJERHF",                     JES,       1, 12 },
+    { JESRelativePtBBup,                       "JESRelativePtBBup",                       "RelativePtBB",                      JES,       1, 13 },
+    { JESRelativePtEC1up,                      "JESRelativePtEC1up",                      "RelativePtEC1",                     JES,       1, 14 },
+    { JESRelativePtEC2up,                      "JESRelativePtEC2up",                      "RelativePtEC2",                     JES,       1, 15 },
+    { JESRelativePtHFup,                       "JESRelativePtHFup",                       "RelativePtHF",                      JES,       1, 16 },
+    { JESRelativeBalup,                        "JESRelativeBalup",                        "RelativeBal",                       JES,       1, 17 },
+    { JESRelativeFSRup,                        "JESRelativeFSRup",                        "RelativeFSR",                       JES,       1, 18 },
+    { JESRelativeStatFSRup,                    "JESRelativeStatFSRup",                    "RelativeStatFSR",                   JES,       1, 19 },
+    { JESRelativeStatECup,                     "JESRelativeStatECup",                     "RelativeStatEC",                    JES,       1, 20 },
+    { JESRelativeStatHFup,                     "JESRelativeStatHFup",                     "RelativeStatHF",                    JES,       1, 21 },
+    { JESPileUpDataMCup,                       "JESPileUpDataMCup",                       "PileUpDataMC",                      JES,       1, 22 },
+    { JESPileUpPtRefup,                        "JESPileUpPtRefup",                        "PileUpPtRef",                       JES,       1, 23 },
+    { JESPileUpPtBBup,                         "JESPileUpPtBBup",                         "PileUpPtBB",                        JES,       1, 24 },
+    { JESPileUpPtEC1up,                        "JESPileUpPtEC1up",                        "PileUpPtEC1",                       JES,       1, 25 },
+    { JESPileUpPtEC2up,                        "JESPileUpPtEC2up",                        "PileUpPtEC2",                       JES,       1, 26 },
+    { JESPileUpPtHFup,                         "JESPileUpPtHFup",                         "PileUpPtHF",                        JES,       1, 27 },
+    { JESPileUpMuZeroup,                       "JESPileUpMuZeroup",                       "PileUpMuZero",                      JES,       1, 28 },
+    { JESPileUpEnvelopeup,                     "JESPileUpEnvelopeup",                     "PileUpEnvelope",                    JES,       1, 29 },
+    { JESSubTotalPileUpup,                     "JESSubTotalPileUpup",                     "SubTotalPileUp",                    JES,       1, 30 },
+    { JESSubTotalRelativeup,                   "JESSubTotalRelativeup",                   "SubTotalRelative",                  JES,       1, 31 },
+    { JESSubTotalPtup,                         "JESSubTotalPtup",                         "SubTotalPt",                        JES,       1, 32 },
+    { JESSubTotalScaleup,                      "JESSubTotalScaleup",                      "SubTotalScale",                     JES,       1, 33 },
+    { JESSubTotalAbsoluteup,                   "JESSubTotalAbsoluteup",                   "SubTotalAbsolute",                  JES,       1, 34 },
+    { JESSubTotalMCup,                         "JESSubTotalMCup",                         "SubTotalMC",                        JES,       1, 35 },
+    { JESTotalup,                              "JESTotalup",                              "Total",                             JES,       1, 36 },
+    { JESTotalNoFlavorup,                      "JESTotalNoFlavorup",                      "TotalNoFlavor",                     JES,       1, 37 },
+    { JESTotalNoTimeup,                        "JESTotalNoTimeup",                        "TotalNoTime",                       JES,       1, 38 },
+    { JESTotalNoFlavorNoTimeup,                "JESTotalNoFlavorNoTimeup",                "TotalNoFlavorNoTime",               JES,       1, 39 },
+    { JESFlavorZJetup,                         "JESFlavorZJetup",                         "FlavorZJet",                        JES,       1, 40 },
+    { JESFlavorPhotonJetup,                    "JESFlavorPhotonJetup",                    "FlavorPhotonJet",                   JES,       1, 41 },
+    { JESFlavorPureGluonup,                    "JESFlavorPureGluonup",                    "FlavorPureGluon",                   JES,       1, 42 },
+    { JESFlavorPureQuarkup,                    "JESFlavorPureQuarkup",                    "FlavorPureQuark",                   JES,       1, 43 },
+    { JESFlavorPureCharmup,                    "JESFlavorPureCharmup",                    "FlavorPureCharm",                   JES,       1, 44 },
+    { JESFlavorPureBottomup,                   "JESFlavorPureBottomup",                   "FlavorPureBottom",                  JES,       1, 45 },
+    { JESTimeRunBCDup,                         "JESTimeRunBCDup",                         "TimeRunBCD",                        JES,       1, 46 },
+    { JESTimeRunEFup,                          "JESTimeRunEFup",                          "TimeRunEF",                         JES,       1, 47 },
+    { JESTimeRunGup,                           "JESTimeRunGup",                           "TimeRunG",                          JES,       1, 48 },
+    { JESTimeRunHup,                           "JESTimeRunHup",                           "TimeRunH",                          JES,       1, 49 },
+    { JESCorrelationGroupMPFInSituup,          "JESCorrelationGroupMPFInSituup",          "CorrelationGroupMPFInSitu",         JES,       1, 50 },
+    { JESCorrelationGroupIntercalibrationup,   "JESCorrelationGroupIntercalibrationup",   "CorrelationGroupIntercalibration",  JES,       1, 51 },
+    { JESCorrelationGroupbJESup,               "JESCorrelationGroupbJESup",               "CorrelationGroupbJES",              JES,       1, 52 },
+    { JESCorrelationGroupFlavorup,             "JESCorrelationGroupFlavorup",             "CorrelationGroupFlavor",            JES,       1, 53 },
+    { JESCorrelationGroupUncorrelatedup,       "JESCorrelationGroupUncorrelatedup",       "CorrelationGroupUncorrelated",      JES,       1, 54 },
+    { JESAbsoluteStatdown,                     "JESAbsoluteStatdown",                     "AbsoluteStat",                      JES,      -1,  1 },
+    { JESAbsoluteScaledown,                    "JESAbsoluteScaledown",                    "AbsoluteScale",                     JES,      -1,  2 },
+    { JESAbsoluteFlavMapdown,                  "JESAbsoluteFlavMapdown",                  "AbsoluteFlavMap",                   JES,      -1,  3 },
+    { JESAbsoluteMPFBiasdown,                  "JESAbsoluteMPFBiasdown",                  "AbsoluteMPFBias",                   JES,      -1,  4 },
+    { JESFragmentationdown,                    "JESFragmentationdown",                    "Fragmentation",                     JES,      -1,  5 },
+    { JESSinglePionECALdown,                   "JESSinglePionECALdown",                   "SinglePionECAL",                    JES,      -1,  6 },
+    { JESSinglePionHCALdown,                   "JESSinglePionHCALdown",                   "SinglePionHCAL",                    JES,      -1,  7 },
+    { JESFlavorQCDdown,                        "JESFlavorQCDdown",                        "FlavorQCD",                         JES,      -1,  8 },
+    { JESTimePtEtadown,                        "JESTimePtEtadown",                        "TimePtEta",                         JES,      -1,  9 },
+    { JESRelativeJEREC1down,                   "JESRelativeJEREC1down",                   "RelativeJEREC1",                    JES,      -1, 10 },
+    { JESRelativeJEREC2down,                   "JESRelativeJEREC2down",                   "RelativeJEREC2",                    JES,      -1, 11 },
+    { JESRelativeJERHFdown,                    "JESRelativeJERHFdown",                    "RelativeJERHF",                     JES,      -1, 12 },
+    { JESRelativePtBBdown,                     "JESRelativePtBBdown",                     "RelativePtBB",                      JES,      -1, 13 },
+    { JESRelativePtEC1down,                    "JESRelativePtEC1down",                    "RelativePtEC1",                     JES,      -1, 14 },
+    { JESRelativePtEC2down,                    "JESRelativePtEC2down",                    "RelativePtEC2",                     JES,      -1, 15 },
+    { JESRelativePtHFdown,                     "JESRelativePtHFdown",                     "RelativePtHF",                      JES,      -1, 16 },
+    { JESRelativeBaldown,                      "JESRelativeBaldown",                      "RelativeBal",                       JES,      -1, 17 },
+    { JESRelativeFSRdown,                      "JESRelativeFSRdown",                      "RelativeFSR",                       JES,      -1, 18 },
+    { JESRelativeStatFSRdown,                  "JESRelativeStatFSRdown",                  "RelativeStatFSR",                   JES,      -1, 19 },
+    { JESRelativeStatECdown,                   "JESRelativeStatECdown",                   "RelativeStatEC",                    JES,      -1, 20 },
+    { JESRelativeStatHFdown,                   "JESRelativeStatHFdown",                   "RelativeStatHF",                    JES,      -1, 21 },
+    { JESPileUpDataMCdown,                     "JESPileUpDataMCdown",                     "PileUpDataMC",                      JES,      -1, 22 },
+    { JESPileUpPtRefdown,                      "JESPileUpPtRefdown",                      "PileUpPtRef",                       JES,      -1, 23 },
+    { JESPileUpPtBBdown,                       "JESPileUpPtBBdown",                       "PileUpPtBB",                        JES,      -1, 24 },
+    { JESPileUpPtEC1down,                      "JESPileUpPtEC1down",                      "PileUpPtEC1",                       JES,      -1, 25 },
+    { JESPileUpPtEC2down,                      "JESPileUpPtEC2down",                      "PileUpPtEC2",                       JES,      -1, 26 },
+    { JESPileUpPtHFdown,                       "JESPileUpPtHFdown",                       "PileUpPtHF",                        JES,      -1, 27 },
+    { JESPileUpMuZerodown,                     "JESPileUpMuZerodown",                     "PileUpMuZero",                      JES,      -1, 28 },
+    { JESPileUpEnvelopedown,                   "JESPileUpEnvelopedown",                   "PileUpEnvelope",                    JES,      -1, 29 },
+    { JESSubTotalPileUpdown,                   "JESSubTotalPileUpdown",                   "SubTotalPileUp",                    JES,      -1, 30 },
+    { JESSubTotalRelativedown,                 "JESSubTotalRelativedown",                 "SubTotalRelative",                  JES,      -1, 31 },
+    { JESSubTotalPtdown,                       "JESSubTotalPtdown",                       "SubTotalPt",                        JES,      -1, 32 },
+    { JESSubTotalScaledown,                    "JESSubTotalScaledown",                    "SubTotalScale",                     JES,      -1, 33 },
+    { JESSubTotalAbsolutedown,                 "JESSubTotalAbsolutedown",                 "SubTotalAbsolute",                  JES,      -1, 34 },
+    { JESSubTotalMCdown,                       "JESSubTotalMCdown",                       "SubTotalMC",                        JES,      -1, 35 },
+    { JESTotaldown,                            "JESTotaldown",                            "Total",                             JES,      -1, 36 },
+    { JESTotalNoFlavordown,                    "JESTotalNoFlavordown",                    "TotalNoFlavor",                     JES,      -1, 37 },
+    { JESTotalNoTimedown,                      "JESTotalNoTimedown",                      "TotalNoTime",                       JES,      -1, 38 },
+    { JESTotalNoFlavorNoTimedown,              "JESTotalNoFlavorNoTimedown",              "TotalNoFlavorNoTime",               JES,      -1, 39 },
+    { JESFlavorZJetdown,                       "JESFlavorZJetdown",                       "FlavorZJet",                        JES,      -1, 40 },
+    { JESFlavorPhotonJetdown,                  "JESFlavorPhotonJetdown",                  "FlavorPhotonJet",                   JES,      -1, 41 },
+    { JESFlavorPureGluondown,                  "JESFlavorPureGluondown",                  "FlavorPureGluon",                   JES,      -1, 42 },
+    { JESFlavorPureQuarkdown,                  "JESFlavorPureQuarkdown",                  "FlavorPureQuark",                   JES,      -1, 43 },
+    { JESFlavorPureCharmdown,                  "JESFlavorPureCharmdown",                  "FlavorPureCharm",                   JES,      -1, 44 },
+    { JESFlavorPureBottomdown,                 "JESFlavorPureBottomdown",                 "FlavorPureBottom",                  JES,      -1, 45 },
+    { JESTimeRunBCDdown,                       "JESTimeRunBCDdown",                       "TimeRunBCD",                        JES,      -1, 46 },
+    { JESTimeRunEFdown,                        "JESTimeRunEFdown",                        "TimeRunEF",                         JES,      -1, 47 },
+    { JESTimeRunGdown,                         "JESTimeRunGdown",                         "TimeRunG",                          JES,      -1, 48 },
+    { JESTimeRunHdown,                         "JESTimeRunHdown",                         "TimeRunH",                          JES,      -1, 49 },
+    { JESCorrelationGroupMPFInSitudown,        "JESCorrelationGroupMPFInSitudown",        "CorrelationGroupMPFInSitu",         JES,      -1, 50 },
+    { JESCorrelationGroupIntercalibrationdown, "JESCorrelationGroupIntercalibrationdown", "CorrelationGroupIntercalibration",  JES,      -1, 51 },
+    { JESCorrelationGroupbJESdown,             "JESCorrelationGroupbJESdown",             "CorrelationGroupbJES",              JES,      -1, 52 },
+    { JESCorrelationGroupFlavordown,           "JESCorrelationGroupFlavordown",           "CorrelationGroupFlavor",            JES,      -1, 53 },
+    { JESCorrelationGroupUncorrelateddown,     "JESCorrelationGroupUncorrelateddown",     "CorrelationGroupUncorrelated",      JES,      -1, 54 },
+    { JERup,                                   "JERup",                                   "JER",                               JER,       1, -1 },
+    { JERdown,                                 "JERdown",                                 "JER",                               JER,      -1, -1 },
+    { hfSFup,                                  "hfSFup",                                  "",                                  CSV,       1, -1 },
+    { hfSFdown,                                "hfSFdown",                                "",                                  CSV,      -1, -1 },
+    { lfSFdown,                                "lfSFdown",                                "",                                  CSV,      -1, -1 },
+    { lfSFup,                                  "lfSFup",                                  "",                                  CSV,       1, -1 },
+    { TESup,                                   "TESup",                                   "",                                  TES,       1, -1 },
+    { TESdown,                                 "TESdown",                                 "",                                  TES,      -1, -1 },
+    { CSVLFup,                                 "CSVLFup",                                 "",                                  CSV,       1, -1 },
+    { CSVLFdown,                               "CSVLFdown",                               "",                                  CSV,      -1, -1 },
+    { CSVHFup,                                 "CSVHFup",                                 "",                                  CSV,       1, -1 },
+    { CSVHFdown,                               "CSVHFdown",                               "",                                  CSV,      -1, -1 },
+    { CSVHFStats1up,                           "CSVHFStats1up",                           "",                                  CSV,       1, -1 },
+    { CSVHFStats1down,                         "CSVHFStats1down",                         "",                                  CSV,      -1, -1 },
+    { CSVLFStats1up,                           "CSVLFStats1up",                           "",                                  CSV,       1, -1 },
+    { CSVLFStats1down,                         "CSVLFStats1down",                         "",                                  CSV,      -1, -1 },
+    { CSVHFStats2up,                           "CSVHFStats2up",                           "",                                  CSV,       1, -1 },
+    { CSVHFStats2down,                         "CSVHFStats2down",                         "",                                  CSV,      -1, -1 },
+    { CSVLFStats2up,                           "CSVLFStats2up",                           "",                                  CSV,       1, -1 },
+    { CSVLFStats2down,                         "CSVLFStats2down",                         "",                                  CSV,      -1, -1 },
+    { CSVCErr1up,                              "CSVCErr1up",                              "",                                  CSV,       1, -1 },
+    { CSVCErr1down,                            "CSVCErr1down",                            "",                                  CSV,      -1, -1 },
+    { CSVCErr2up,                              "CSVCErr2up",                              "",                                  CSV,       1, -1 },
+    { CSVCErr2down,                            "CSVCErr2down",                            "",                                  CSV,      -1, -1 }
+  };
+
+};
 
-  static void init();
-  static bool isInit();
-  static void add(Systematics::Type typeUp, Systematics::Type typeDn, const std::string& name, const std::string& label);
+
+// Set of systematics with O(1) insertion and lookup, e.g. the down variations
+// of the individual JEC sources:
+//   SystematicSet::family(Systematics::JES) & SystematicSet::down()
+class SystematicSet {
+public:
+  SystematicSet() {}
+  SystematicSet(std::initializer_list<Systematics::Type> types) { for( const auto& type: types ) insert(type); }
+  explicit SystematicSet(const std::vector<Systematics::Type>& types) { for( const auto& type: types ) insert(type); }
+
+  // all types except NA, and the subsets of a family or direction
+  static SystematicSet all();
+  static SystematicSet family(const Systematics::Family family);
+  static SystematicSet up();
+  static SystematicSet down();
+
+  SystematicSet& insert(const Systematics::Type type) { bits_.set(type); return *this; }
+  SystematicSet& erase(const Systematics::Type type) { bits_.reset(type); return *this; }
+  bool contains(const Systematics::Type type) const { return unsigned(type) < Systematics::nTypes && bits_.test(type); }
+  bool empty() const { return bits_.none(); }
+  unsigned int size() const { return bits_.count(); }
+  // the types in the order of Systematics::Type
+  std::vector<Systematics::Type> types() const;
+
+  SystematicSet& operator|=(const SystematicSet& other) { bits_ |= other.bits_; return *this; }
+  SystematicSet& operator&=(const SystematicSet& other) { bits_ &= other.bits_; return *this; }
+  SystematicSet operator|(const SystematicSet& other) const { return SystematicSet(*this) |= other; }
+  SystematicSet operator&(const SystematicSet& other) const { return SystematicSet(*this) &= other; }
+  bool operator==(const SystematicSet& other) const { return bits_ == other.bits_; }
+  bool operator!=(const SystematicSet& other) const { return bits_ != other.bits_; }
+
+private:
+  std::bitset<Systematics::nTypes> bits_;
 };
 
 
@@ -0,0 +1,115 @@
+#ifndef MINIAODHELPER_SYSTEMATICSSCHEDULER_H
+#define MINIAODHELPER_SYSTEMATICSSCHEDULER_H
+
+// Event selection of MiniAODHelper for the nominal case and a list of
+// systematic variations in one go. Each stage declares the systematics it
+// depends on (setDependencies, by default the JES and JER families for the
+// jet corrections and the CSV family for the CSV weight); a stage also
+// depends on everything the stages it reads depend on. Per event, every
+// stage runs once for the nominal case and again only for the variations it
+// depends on: the lepton selection, the jet-lepton cleaning and the jet ID
+// are shared by all variations, the jet corrections of all variations come
+// from one GetJetCorrectionTable call, and only the jet pt threshold and the
+// CSV weight are evaluated per variation.
+//
+// The results are index views into the input collections. The helper has to
+// be set up for the event (SetVertex, SetRho, SetPackedCandidates) before run.
+
+// system include files
+#include <vector>
+
+#include "MiniAOD/MiniAODHelper/interface/CSVHelper.h"
+#include "MiniAOD/MiniAODHelper/interface/MiniAODHelper.h"
+#include "MiniAOD/MiniAODHelper/interface/Systematics.h"
+
+
+class SystematicsScheduler {
+public:
+  // in the order of evaluation
+  enum Stage { LeptonSelection, JetCleaning, JetID, JetCorrection, JetSelection, CSVWeight, nStages };
+
+  // The nominal case (Systematics::NA) is always evaluated
+  SystematicsScheduler(MiniAODHelper& helper, const std::vector<Systematics::Type>& variations);
+
+  // Selection, as in GetSelectedMuons, GetSelectedElectrons, GetDeltaRCleanedJets
+  // and GetSelectedJets. Without a muon or electron selection, no leptons of
+  // that flavour are selected; without cleaning, no jets are removed.
+  void setMuonSelection(const float minPt, const muonID::muonID id, const coneSize::coneSize cone = coneSize::R04, const corrType::corrType corr = corrType::deltaBeta, const float maxEta = 2.4);
+  void setElectronSelection(const float minPt, const electronID::electronID id, const float maxEta = 2.4);
+  void setJetCleaning(const double deltaR);
+  void setJetCorrection(const bool doJES, const bool doJER);
+  void setJetSelection(const float minPt, const float maxAbsEta, const jetID::jetID id, const char csvWP);
+  // CSV weights of the selected jets, not evaluated without a helper
+  void setCSVHelper(const CSVHelper* csvHelper) { csvHelper_ = csvHelper; }
+
+  // Systematics a stage depends on directly, replaces the default
+  void setDependencies(const Stage stage, const SystematicSet& types);
+  // True if the result of stage differs between type and the nominal case,
+  // e.g. to decide whether a discriminant of the selected jets has to be
+  // evaluated again
+  bool dependsOn(const Stage stage, const Systematics::Type type) const;
+
+  const std::vector<Systematics::Type>& variations() const { return types_; }
+
+  void run(const edm::Event& event, const edm::EventSetup& setup,
+	   const std::vector<pat::Muon>& muons, const std::vector<pat::Electron>& electrons,
+	   const std::vector<pat::Jet>& jets, const edm::Handle<reco::GenJetCollection>& genjets);
+
+  // Results of the last event: indices into the collections passed to run.
+  // The jets are the uncorrected input jets; jetFactors()[k] scales the p4
+  // of jets()[k] to its corrected p4 under type.
+  const std::vector<unsigned int>& muons() const { return muons_; }
+  const std::vector<unsigned int>& electrons() const { return electrons_; }
+  const std::vector<unsigned int>& jets(const Systematics::Type type = Systematics::NA) const;
+  const std::vector<float>& jetFactors(const Systematics::Type type = Systematics::NA) const;
+  double csvWeight(const Systematics::Type type = Systematics::NA) const;
+  void csvWeights(const Systematics::Type type, double& hf, double& lf, double& cf) const;
+
+private:
+  struct Variation {
+    Systematics::Type type;
+    unsigned int stages;  // bitmask of the stages that depend on type
+    int tableColumn;      // in the JetCorrectionTable, -1: nominal factors
+    unsigned int jets;    // index into jetSelections_, 0: nominal
+    double csvWeight, csvWeightHF, csvWeightLF, csvWeightCF;
+  };
+  struct JetSelection {
+    std::vector<unsigned int> jets;
+    std::vector<float> factors;
+  };
+
+  void schedule();
+  const Variation& variation(const Systematics::Type type) const;
+  static int csvSystematic(const Systematics::Type type);
+
+  MiniAODHelper& helper_;
+  const CSVHelper* csvHelper_ = 0;
+
+  bool selectMuons_ = false;
+  float muonMinPt_ = 0., muonMaxEta_ = 2.4;
+  muonID::muonID muonID_ = muonID::muonTight;
+  coneSize::coneSize muonCone_ = coneSize::R04;
+  corrType::corrType muonCorr_ = corrType::deltaBeta;
+  bool selectElectrons_ = false;
+  float electronMinPt_ = 0., electronMaxEta_ = 2.4;
+  electronID::electronID electronID_ = electronID::electronTight;
+  double cleaningDeltaR_ = 0.;
+  bool doJES_ = true, doJER_ = true;
+  float jetMinPt_ = 0., jetMaxAbsEta_ = 2.4;
+  jetID::jetID jetID_ = jetID::none;
+  char csvWP_ = '-';
+
+  SystematicSet dependencies_[nStages];
+  std::vector<Systematics::Type> types_;      // types of variations_, nominal first
+  std::vector<Variation> variations_;
+  std::vector<int> variationOf_;               // per Systematics::Type, -1: not requested
+  std::vector<Systematics::Type> tableTypes_;  // columns of the JetCorrectionTable
+
+  // per event
+  std::vector<unsigned int> muons_, electrons_;
+  std::vector<CorrectedJetView> jetViews_;
+  std::vector<unsigned int> goodJets_;         // passing cleaning, eta, ID and CSV
+  std::vector<JetSelection> jetSelections_;
+};
+
+#endif
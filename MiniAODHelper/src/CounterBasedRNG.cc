@@ -0,0 +1,61 @@
+// Counter-based random numbers (Philox4x32-10)
+
+// system include files
+#include <cmath>
+
+#include "MiniAOD/MiniAODHelper/interface/CounterBasedRNG.h"
+
+
+namespace {
+  const uint32_t philoxM0 = 0xD2511F53;
+  const uint32_t philoxM1 = 0xCD9E8D57;
+  const uint32_t philoxW0 = 0x9E3779B9; // golden ratio
+  const uint32_t philoxW1 = 0xBB67AE85; // sqrt(3)-1
+  const unsigned int philoxRounds = 10;
+
+  inline void mulhilo(const uint32_t a, const uint32_t b, uint32_t& hi, uint32_t& lo) {
+    const uint64_t product = uint64_t(a)*uint64_t(b);
+    hi = product >> 32;
+    lo = uint32_t(product);
+  }
+
+  // uniform deviate in (0,1) from 64 random bits, using the upper 53
+  inline double uniform(const uint32_t hi, const uint32_t lo) {
+    const uint64_t bits = ((uint64_t(hi) << 32) | lo) >> 11;
+    return (bits + 0.5) * (1./9007199254740992.); // 2^-53
+  }
+
+  inline double boxMuller(const CounterBasedRNG::Counter& r) {
+    const double u1 = uniform(r[0], r[1]);
+    const double u2 = uniform(r[2], r[3]);
+    return std::sqrt(-2.*std::log(u1)) * std::cos(2.*M_PI*u2);
+  }
+}
+
+
+CounterBasedRNG::Counter CounterBasedRNG::philox(Counter counter, Key key) {
+  for( unsigned int round=0; round<philoxRounds; ++round ){
+    if( round > 0 ){
+      key[0] += philoxW0;
+      key[1] += philoxW1;
+    }
+    uint32_t hi0, lo0, hi1, lo1;
+    mulhilo(philoxM0, counter[0], hi0, lo0);
+    mulhilo(philoxM1, counter[2], hi1, lo1);
+    counter = {{ hi1^counter[1]^key[0], lo1, hi0^counter[3]^key[1], lo0 }};
+  }
+  return counter;
+}
+
+
+double CounterBasedRNG::gaussian(const Counter& counter, const Key& key) {
+  return boxMuller(philox(counter, key));
+}
+
+
+void CounterBasedRNG::gaussians(const Counter& counter, const uint32_t* key0, const uint32_t key1, const unsigned int n, double* out) {
+  for( unsigned int i=0; i<n; ++i ){
+    const Key key = {{ key0[i], key1 }};
+    out[i] = boxMuller(philox(counter, key));
+  }
+}
@@ -0,0 +1,77 @@
+// Eta-sorted index over the objects of veto collections for the deltaR cleaning
+
+// system include files
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "MiniAOD/MiniAODHelper/interface/DeltaRVetoIndex.h"
+
+
+namespace {
+  // deltaR^2 for phi in [-pi, pi]: the phi difference is wrapped by a
+  // comparison rather than by reco::deltaPhi
+  inline double deltaR2(const double eta1, const double phi1, const double eta2, const double phi2) {
+    const double deta = eta1-eta2;
+    double dphi = std::fabs(phi1-phi2);
+    if( dphi > M_PI ) dphi = 2*M_PI-dphi;
+    return deta*deta + dphi*dphi;
+  }
+}
+
+
+void DeltaRVetoIndex::clear() {
+  eta_.clear();
+  phi_.clear();
+}
+
+
+void DeltaRVetoIndex::sort() {
+  const unsigned int n = eta_.size();
+  std::vector<unsigned int> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [this](unsigned int i, unsigned int j) { return eta_[i] < eta_[j]; });
+
+  std::vector<double> eta(n), phi(n);
+  for( unsigned int i=0; i<n; ++i ){
+    eta[i] = eta_[order[i]];
+    phi[i] = phi_[order[i]];
+  }
+  eta_.swap(eta);
+  phi_.swap(phi);
+}
+
+
+bool DeltaRVetoIndex::overlaps(const double eta, const double phi, const double dR) const {
+  const double dR2 = dR*dR;
+  // |deta| <= deltaR, so the window contains every overlap
+  const std::vector<double>::const_iterator first = std::lower_bound(eta_.begin(), eta_.end(), eta-dR);
+  for( unsigned int k = first-eta_.begin(); k<eta_.size() && eta_[k] <= eta+dR; ++k ){
+    if( deltaR2(eta, phi, eta_[k], phi_[k]) < dR2 ) return true;
+  }
+  return false;
+}
+
+
+// The objects are visited in order of eta, so the start of the window in the
+// veto objects only moves forward
+void DeltaRVetoIndex::sweep(const std::vector<double>& eta, const std::vector<double>& phi, const double dR, unsigned char* keep) const {
+  if( eta_.empty() ) return;
+
+  const unsigned int n = eta.size();
+  std::vector<unsigned int> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&eta](unsigned int i, unsigned int j) { return eta[i] < eta[j]; });
+
+  const double dR2 = dR*dR;
+  unsigned int first = 0;
+  for( const auto& i: order ){
+    while( first < eta_.size() && eta_[first] < eta[i]-dR ) ++first;
+    for( unsigned int k=first; k<eta_.size() && eta_[k] <= eta[i]+dR; ++k ){
+      if( deltaR2(eta[i], phi[i], eta_[k], phi_[k]) < dR2 ){
+	keep[i] = 0;
+	break;
+      }
+    }
+  }
+}
@@ -0,0 +1,202 @@
+// Cut-based electron IDs and electron effective areas read from text files
+
+// system include files
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#include "FWCore/Utilities/interface/Exception.h"
+
+#include "MiniAOD/MiniAODHelper/interface/ElectronIDTable.h"
+
+const unsigned int ElectronIDTable::maxWorkingPoints;
+
+
+namespace {
+  // Non-empty lines of a file without the comments, as tokens
+  std::vector<std::vector<std::string> > readTokens(const std::string& fileName) {
+    std::ifstream file(fileName.c_str());
+    if( !file ){
+      throw cms::Exception("InvalidElectronIDFile") << "Cannot read '" << fileName << "'";
+    }
+    std::vector<std::vector<std::string> > lines;
+    std::string line;
+    while( std::getline(file, line) ){
+      const size_t comment = line.find('#');
+      if( comment != std::string::npos ) line.erase(comment);
+      std::istringstream stream(line);
+      std::vector<std::string> tokens;
+      std::string token;
+      while( stream >> token ) tokens.push_back(token);
+      if( !tokens.empty() ) lines.push_back(tokens);
+    }
+    return lines;
+  }
+
+  double toDouble(const std::string& token, const std::string& fileName) {
+    std::istringstream stream(token);
+    double value;
+    if( !(stream >> value) || !stream.eof() ){
+      throw cms::Exception("InvalidElectronIDFile") << "'" << token << "' in '" << fileName << "' is not a number";
+    }
+    return value;
+  }
+
+  // One const table per file, released with the last user
+  template <typename Table>
+  std::shared_ptr<const Table> sharedTable(const std::string& fileName) {
+    static std::mutex mutex;
+    static std::map<std::string, std::weak_ptr<const Table> > tables;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<const Table> table = tables[fileName].lock();
+    if( !table ){
+      std::shared_ptr<Table> newTable = std::make_shared<Table>();
+      newTable->read(fileName);
+      table = newTable;
+      tables[fileName] = table;
+    }
+    return table;
+  }
+}
+
+
+void EffectiveAreaTable::read(const std::string& fileName) {
+  etaMin_.clear();
+  etaMax_.clear();
+  area_.clear();
+
+  const std::vector<std::vector<std::string> > lines = readTokens(fileName);
+  for( const auto& tokens: lines ){
+    if( tokens.size() != 3 ){
+      throw cms::Exception("InvalidElectronIDFile") << "Expected 'etaMin etaMax area' in '" << fileName << "'";
+    }
+    etaMin_.push_back(toDouble(tokens[0], fileName));
+    etaMax_.push_back(toDouble(tokens[1], fileName));
+    area_.push_back(toDouble(tokens[2], fileName));
+  }
+}
+
+
+std::shared_ptr<const EffectiveAreaTable> EffectiveAreaTable::shared(const std::string& fileName) {
+  return sharedTable<EffectiveAreaTable>(fileName);
+}
+
+
+double EffectiveAreaTable::area(const double absEta) const {
+  for( unsigned int i=0; i<area_.size(); ++i ){
+    if( absEta >= etaMin_[i] && absEta < etaMax_[i] ) return area_[i];
+  }
+  return 9999.;
+}
+
+
+void ElectronIDTable::Block::resize(const unsigned int n) {
+  for( unsigned int v=0; v<nVariables; ++v ) values[v].resize(n);
+  endcap.resize(n);
+}
+
+
+ElectronIDTable::Variable ElectronIDTable::variable(const std::string& name) {
+  static const char* names[nVariables] = { "full5x5_sigmaIetaIeta", "dEtaIn", "dEtaInSeed", "dPhiIn", "hOverE", "ooEmooP",
+					   "d0", "dZ", "missingInnerHits", "conversion", "relIso" };
+  for( unsigned int v=0; v<nVariables; ++v ){
+    if( name == names[v] ) return Variable(v);
+  }
+  return nVariables;
+}
+
+
+void ElectronIDTable::read(const std::string& fileName) {
+  effectiveAreas_.clear();
+  workingPoints_.clear();
+  cuts_.clear();
+  variables_.clear();
+
+  const std::vector<std::vector<std::string> > lines = readTokens(fileName);
+  for( const auto& tokens: lines ){
+    if( tokens[0] == "effectiveAreas" && tokens.size() == 2 ){
+      effectiveAreas_ = tokens[1];
+    }
+    else if( tokens[0] == "workingPoints" && cuts_.empty() ){
+      workingPoints_.assign(tokens.begin()+1, tokens.end());
+      if( workingPoints_.empty() || workingPoints_.size() > maxWorkingPoints ){
+	throw cms::Exception("InvalidElectronIDFile") << "Need 1 to " << maxWorkingPoints << " working points in '" << fileName << "'";
+      }
+      cuts_.assign(workingPoints_.size()*nVariables*2, std::numeric_limits<double>::infinity());
+      variables_.resize(workingPoints_.size());
+    }
+    else{
+      const Variable v = variable(tokens[0]);
+      if( v == nVariables || cuts_.empty() || tokens.size() != 3+workingPoints_.size()
+	  || (tokens[1] != "EB" && tokens[1] != "EE") || (tokens[2] != "<" && tokens[2] != "<=") ){
+	throw cms::Exception("InvalidElectronIDFile") << "Cannot interpret line '" << tokens[0] << " " << tokens[1]
+						      << " ...' in '" << fileName << "'";
+      }
+      const unsigned int region = tokens[1] == "EE";
+      for( unsigned int w=0; w<workingPoints_.size(); ++w ){
+	// a cut can override the comparison of the line, e.g. <=0.0103
+	std::string token = tokens[3+w];
+	bool inclusive = tokens[2] == "<=";
+	if( token.compare(0, 2, "<=") == 0 ){
+	  inclusive = true;
+	  token.erase(0, 2);
+	}
+	else if( token[0] == '<' ){
+	  inclusive = false;
+	  token.erase(0, 1);
+	}
+	double cut = toDouble(token, fileName);
+	// x <= cut as x < next value above cut
+	if( inclusive ) cut = std::nextafter(cut, std::numeric_limits<double>::infinity());
+	cuts_[(w*nVariables+v)*2+region] = cut;
+	if( std::find(variables_[w].begin(), variables_[w].end(), v) == variables_[w].end() ) variables_[w].push_back(v);
+      }
+    }
+  }
+
+  if( workingPoints_.empty() || effectiveAreas_.empty() ){
+    throw cms::Exception("InvalidElectronIDFile") << "No working points or effective areas in '" << fileName << "'";
+  }
+}
+
+
+std::shared_ptr<const ElectronIDTable> ElectronIDTable::shared(const std::string& fileName) {
+  return sharedTable<ElectronIDTable>(fileName);
+}
+
+
+int ElectronIDTable::workingPoint(const std::string& name) const {
+  for( unsigned int w=0; w<workingPoints_.size(); ++w ){
+    if( workingPoints_[w] == name ) return w;
+  }
+  return -1;
+}
+
+
+// Starts from all working points passed and clears bit w of every electron
+// that fails a cut of w. A failed comparison, e.g. with a NaN, fails the cut.
+void ElectronIDTable::evaluate(const Block& block, unsigned int* masks) const {
+  const unsigned int n = block.size();
+  const unsigned int all = workingPoints_.size() == 32 ? ~0u : (1u<<workingPoints_.size())-1;
+  for( unsigned int i=0; i<n; ++i ) masks[i] = all;
+
+  const unsigned char* endcap = block.endcap.data();
+  for( unsigned int w=0; w<workingPoints_.size(); ++w ){
+    const unsigned int fail = ~(1u<<w);
+    for( const auto& v: variables_[w] ){
+      const double* x = block.values[v].data();
+      const double cutEB = cuts_[(w*nVariables+v)*2];
+      const double cutEE = cuts_[(w*nVariables+v)*2+1];
+      // selects rather than branches, so that the loop vectorises
+      for( unsigned int i=0; i<n; ++i ){
+	const double cut = endcap[i] ? cutEE : cutEB;
+	masks[i] &= x[i] < cut ? ~0u : fail;
+      }
+    }
+  }
+}
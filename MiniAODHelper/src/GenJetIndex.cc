@@ -0,0 +1,63 @@
+// Per-event eta-sorted index over the gen jets
+
+// system include files
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "DataFormats/Math/interface/deltaR.h"
+
+#include "MiniAOD/MiniAODHelper/interface/GenJetIndex.h"
+
+
+void GenJetIndex::build(const reco::GenJetCollection& genjets) {
+  const unsigned int n = genjets.size();
+
+  std::vector<unsigned int> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&genjets](unsigned int i, unsigned int j) {
+      return genjets[i].eta() < genjets[j].eta();
+    });
+
+  eta_.resize(n);
+  phi_.resize(n);
+  pt_.resize(n);
+  index_.resize(n);
+  for( unsigned int i=0; i<n; ++i ){
+    const reco::GenJet& genjet = genjets[order[i]];
+    eta_[i] = genjet.eta();
+    phi_[i] = genjet.phi();
+    pt_[i] = genjet.pt();
+    index_[i] = order[i];
+  }
+}
+
+
+void GenJetIndex::clear() {
+  eta_.clear();
+  phi_.clear();
+  pt_.clear();
+  index_.clear();
+}
+
+
+int GenJetIndex::match(const double pt, const double eta, const double phi, const double Rcone, const double maxDPt) const {
+  const double dRMax = Rcone/2;
+
+  double dpt_min = 99999;
+  int best = -1;
+
+  // |deta| <= deltaR, so the window contains every candidate
+  const std::vector<double>::const_iterator first = std::lower_bound(eta_.begin(), eta_.end(), eta-dRMax);
+  for( unsigned int i = first-eta_.begin(); i<eta_.size() && eta_[i] <= eta+dRMax; ++i ){
+    const double dpt = fabs(pt-pt_[i]);
+    if( !(dpt < maxDPt) ) continue;
+    if( !(reco::deltaR(eta_[i], phi_[i], eta, phi) < dRMax) ) continue;
+    if( dpt < dpt_min || (dpt == dpt_min && int(index_[i]) > best) ){
+      best = index_[i];
+      dpt_min = dpt;
+    }
+  }
+
+  return best;
+}
@@ -0,0 +1,248 @@
+// JEC uncertainty sources compiled into flat eta x pt grids
+
+// system include files
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <numeric>
+
+#include "FWCore/Utilities/interface/Exception.h"
+
+#include "MiniAOD/MiniAODHelper/interface/JECUncertaintyTable.h"
+
+
+namespace {
+  // value returned by JetCorrectionUncertainty for jets outside of all eta bins
+  const float outOfRangeUncertainty = -999.;
+}
+
+
+void JECUncertaintyTable::addSource(const Systematics::Type type, const std::string& label, const JetCorrectorParameters& parameters) {
+  int iSource = -1;
+  for( unsigned int i=0; i<sources_.size(); ++i ){
+    if( sources_[i].label == label ) iSource = i;
+  }
+  if( iSource < 0 ){
+    Source source;
+    source.label = label;
+    compile(source, parameters);
+    iSource = sources_.size();
+    sources_.push_back(source);
+  }
+
+  if( types_.size() <= unsigned(type) ){
+    const TypeEntry none = { -1, false };
+    types_.resize(type+1, none);
+  }
+  types_[type].source = iSource;
+  types_[type].up = Systematics::isJECUncertaintyUp(type);
+}
+
+
+bool JECUncertaintyTable::hasSource(const Systematics::Type type) const {
+  return entry(type).source >= 0;
+}
+
+
+std::vector<std::string> JECUncertaintyTable::labels() const {
+  std::vector<std::string> result;
+  for( std::vector<Source>::const_iterator it = sources_.begin(); it != sources_.end(); ++it ){
+    result.push_back(it->label);
+  }
+  return result;
+}
+
+
+void JECUncertaintyTable::clear() {
+  layouts_.clear();
+  sources_.clear();
+  types_.clear();
+}
+
+
+std::shared_ptr<const JECUncertaintyTable> JECUncertaintyTable::shared(const std::string& key, const std::function<void(JECUncertaintyTable&)>& build) {
+  static std::mutex mutex;
+  static std::map<std::string, std::weak_ptr<const JECUncertaintyTable> > tables;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  std::shared_ptr<const JECUncertaintyTable> table = tables[key].lock();
+  if( !table ){
+    std::shared_ptr<JECUncertaintyTable> newTable = std::make_shared<JECUncertaintyTable>();
+    build(*newTable);
+    table = newTable;
+    tables[key] = table;
+
+    // forget the tables nobody uses any more, e.g. of previous IOVs
+    for( std::map<std::string, std::weak_ptr<const JECUncertaintyTable> >::iterator it = tables.begin(); it != tables.end(); ){
+      if( it->second.expired() ) tables.erase(it++);
+      else ++it;
+    }
+  }
+  return table;
+}
+
+
+// Mirrors SimpleJetCorrectionUncertainty: within an eta bin the uncertainty is
+// interpolated linearly in pt between the nodes, and constant beyond the first
+// and last node. The coefficients are computed with the same float expressions,
+// so a*pt+b reproduces its results.
+void JECUncertaintyTable::compile(Source& source, const JetCorrectorParameters& parameters) {
+  const JetCorrectorParameters::Definitions& definitions = parameters.definitions();
+  if( definitions.nBinVar() != 1 || definitions.binVar(0) != "JetEta" ||
+      definitions.nParVar() != 1 || definitions.parVar(0) != "JetPt" ){
+    throw cms::Exception("InvalidJECUncertaintySource") << "JEC uncertainty source '" << source.label << "' is not binned in JetEta and parametrized in JetPt";
+  }
+
+  // eta bins in ascending order
+  std::vector<unsigned int> order(parameters.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&parameters](unsigned int i, unsigned int j) {
+      return parameters.record(i).xMin(0) < parameters.record(j).xMin(0);
+    });
+
+  Layout layout;
+  layout.ptOffset.push_back(0);
+  source.aUp.clear();
+  source.bUp.clear();
+  source.aDown.clear();
+  source.bDown.clear();
+
+  for( unsigned int i=0; i<order.size(); ++i ){
+    const JetCorrectorParameters::Record& record = parameters.record(order[i]);
+    if( i > 0 && record.xMin(0) < layout.etaMax.back() ){
+      throw cms::Exception("InvalidJECUncertaintySource") << "JEC uncertainty source '" << source.label << "' has overlapping eta bins";
+    }
+    layout.etaMin.push_back(record.xMin(0));
+    layout.etaMax.push_back(record.xMax(0));
+
+    const std::vector<float>& p = record.parameters();
+    if( p.size() % 3 != 0 || p.empty() ){
+      throw cms::Exception("InvalidJECUncertaintySource") << "JEC uncertainty source '" << source.label << "' has a malformed eta bin";
+    }
+    const unsigned int n = p.size()/3;
+    for( unsigned int k=0; k<n; ++k ) layout.ptNodes.push_back(p[3*k]);
+    layout.ptOffset.push_back(layout.ptNodes.size());
+
+    // below the first node
+    source.aUp.push_back(0.);
+    source.bUp.push_back(p[1]);
+    source.aDown.push_back(0.);
+    source.bDown.push_back(p[2]);
+    for( unsigned int k=1; k<n; ++k ){
+      const float x0 = p[3*(k-1)];
+      const float x1 = p[3*k];
+      for( unsigned int dir=1; dir<=2; ++dir ){
+	const float y0 = p[3*(k-1)+dir];
+	const float y1 = p[3*k+dir];
+	float a = 0.;
+	float b = y0;
+	if( x0 != x1 ){
+	  a = (y1-y0)/(x1-x0);
+	  b = (y0*x1-y1*x0)/(x1-x0);
+	}
+	(dir == 1 ? source.aUp : source.aDown).push_back(a);
+	(dir == 1 ? source.bUp : source.bDown).push_back(b);
+      }
+    }
+    // above the last node
+    source.aUp.push_back(0.);
+    source.bUp.push_back(p[3*(n-1)+1]);
+    source.aDown.push_back(0.);
+    source.bDown.push_back(p[3*(n-1)+2]);
+  }
+
+  source.layout = findLayout(layout);
+}
+
+
+unsigned int JECUncertaintyTable::findLayout(const Layout& layout) {
+  for( unsigned int i=0; i<layouts_.size(); ++i ){
+    if( layouts_[i].etaMin == layout.etaMin && layouts_[i].etaMax == layout.etaMax &&
+	layouts_[i].ptOffset == layout.ptOffset && layouts_[i].ptNodes == layout.ptNodes ) return i;
+  }
+  layouts_.push_back(layout);
+  return layouts_.size()-1;
+}
+
+
+int JECUncertaintyTable::segment(const Layout& layout, const float pt, const float eta) const {
+  // same bin definition as JetCorrectorParameters::binIndex: xMin <= eta < xMax
+  const std::vector<float>::const_iterator itEta = std::upper_bound(layout.etaMin.begin(), layout.etaMin.end(), eta);
+  if( itEta == layout.etaMin.begin() ) return -1;
+  const unsigned int iEta = (itEta - layout.etaMin.begin()) - 1;
+  if( !(eta < layout.etaMax[iEta]) ) return -1;
+
+  const std::vector<float>::const_iterator first = layout.ptNodes.begin() + layout.ptOffset[iEta];
+  const std::vector<float>::const_iterator last = layout.ptNodes.begin() + layout.ptOffset[iEta+1];
+  const unsigned int n = last - first;
+  unsigned int k;
+  if( pt <= *first ) k = 0;
+  else if( pt >= *(last-1) ) k = n;
+  else k = std::upper_bound(first, last, pt) - first;
+
+  return layout.ptOffset[iEta] + iEta + k;
+}
+
+
+const JECUncertaintyTable::TypeEntry& JECUncertaintyTable::entry(const Systematics::Type type) const {
+  static const TypeEntry none = { -1, false };
+  return unsigned(type) < types_.size() ? types_[type] : none;
+}
+
+
+float JECUncertaintyTable::uncertainty(const Systematics::Type type, const float pt, const float eta) const {
+  const TypeEntry& e = entry(type);
+  if( e.source < 0 ){
+    throw cms::Exception("InvalidJECUncertaintyType") << "No JEC uncertainty source for type '" << Systematics::toString(type) << "'";
+  }
+  const Source& source = sources_[e.source];
+
+  const int k = segment(layouts_[source.layout], pt, eta);
+  float value = outOfRangeUncertainty;
+  if( k >= 0 ) value = e.up ? source.aUp[k]*pt + source.bUp[k] : source.aDown[k]*pt + source.bDown[k];
+
+  return e.up ? value : -value;
+}
+
+
+// The segment indices are computed once per layout, after which each type is
+// a gather and a multiply-add over the jets
+void JECUncertaintyTable::uncertainties(const float* pt, const float* eta, const unsigned int nJets,
+					const std::vector<Systematics::Type>& types, float* out) const {
+  const unsigned int nTypes = types.size();
+  std::vector<int> segments(nJets);
+  std::vector<float> values(nJets);
+  int currentLayout = -1;
+
+  // group the types by layout
+  std::vector<unsigned int> order(nTypes);
+  std::iota(order.begin(), order.end(), 0);
+  for( unsigned int j=0; j<nTypes; ++j ){
+    if( entry(types[j]).source < 0 ){
+      throw cms::Exception("InvalidJECUncertaintyType") << "No JEC uncertainty source for type '" << Systematics::toString(types[j]) << "'";
+    }
+  }
+  std::stable_sort(order.begin(), order.end(), [this,&types](unsigned int i, unsigned int j) {
+      return sources_[entry(types[i]).source].layout < sources_[entry(types[j]).source].layout;
+    });
+
+  for( unsigned int jj=0; jj<nTypes; ++jj ){
+    const unsigned int j = order[jj];
+    const TypeEntry& e = entry(types[j]);
+    const Source& source = sources_[e.source];
+
+    if( int(source.layout) != currentLayout ){
+      currentLayout = source.layout;
+      for( unsigned int i=0; i<nJets; ++i ) segments[i] = segment(layouts_[currentLayout], pt[i], eta[i]);
+    }
+
+    const float* a = e.up ? &source.aUp[0] : &source.aDown[0];
+    const float* b = e.up ? &source.bUp[0] : &source.bDown[0];
+    for( unsigned int i=0; i<nJets; ++i ){
+      const int k = segments[i];
+      values[i] = k >= 0 ? a[k]*pt[i] + b[k] : outOfRangeUncertainty;
+    }
+    const float sign = e.up ? 1. : -1.;
+    for( unsigned int i=0; i<nJets; ++i ) out[i*nTypes+j] = sign*values[i];
+  }
+}
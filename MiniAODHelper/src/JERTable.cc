@@ -0,0 +1,139 @@
+// JER pt resolution and scale factor payloads compiled into flat grids
+
+// system include files
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include "MiniAOD/MiniAODHelper/interface/JERTable.h"
+
+
+namespace {
+  // The pt resolution formula of the AK4 payloads, N*|N|/pt^2 + S^2*pt^d + C^2
+  const std::string resolutionFormula = "sqrt([0]*abs([0])/(x*x)+[1]*[1]*pow(x,[3])+[2]*[2])";
+
+  std::string stripSpaces(std::string s) {
+    s.erase(std::remove(s.begin(), s.end(), ' '), s.end());
+    return s;
+  }
+}
+
+
+void JERTable::clear() {
+  etaMin_.clear();
+  etaMax_.clear();
+  rhoOffset_.clear();
+  rhoMin_.clear();
+  rhoMax_.clear();
+  ptMin_.clear();
+  ptMax_.clear();
+  par_.clear();
+  sfEtaMin_.clear();
+  sfEtaMax_.clear();
+  sf_.clear();
+}
+
+
+// Requires records binned in (JetEta, Rho) with JetPt as variable, ordered in
+// eta and then rho, so that a search for the first containing bin in each
+// dimension finds the record that JetResolutionObject::getRecord would
+bool JERTable::compileResolution(const JME::JetResolutionObject& object) {
+  etaMin_.clear();
+  etaMax_.clear();
+  rhoOffset_.clear();
+  rhoMin_.clear();
+  rhoMax_.clear();
+  ptMin_.clear();
+  ptMax_.clear();
+  par_.clear();
+
+  const JME::JetResolutionObject::Definition& definition = object.getDefinition();
+  if( definition.nBins() != 2 || definition.getBinName(0) != "JetEta" || definition.getBinName(1) != "Rho" ||
+      definition.nVariables() != 1 || definition.getVariableName(0) != "JetPt" ||
+      stripSpaces(definition.getFormulaString()) != resolutionFormula ) return false;
+
+  rhoOffset_.push_back(0);
+  const std::vector<JME::JetResolutionObject::Record>& records = object.getRecords();
+  for( std::vector<JME::JetResolutionObject::Record>::const_iterator it = records.begin(); it != records.end(); ++it ){
+    const JME::JetResolutionObject::Range& eta = it->getBinsRange()[0];
+    const JME::JetResolutionObject::Range& rho = it->getBinsRange()[1];
+    const std::vector<float>& p = it->getParametersValues();
+    if( p.size() != 4 ) break;
+
+    const bool newEta = etaMin_.empty() || eta.min != etaMin_.back() || eta.max != etaMax_.back();
+    if( newEta ){
+      if( !etaMin_.empty() && !(eta.min >= etaMax_.back()) ) break;
+      if( !etaMin_.empty() ) rhoOffset_.push_back(rhoMin_.size());
+      etaMin_.push_back(eta.min);
+      etaMax_.push_back(eta.max);
+    }
+    else if( !(rho.min >= rhoMax_.back()) ) break;
+
+    rhoMin_.push_back(rho.min);
+    rhoMax_.push_back(rho.max);
+    ptMin_.push_back(it->getVariablesRange()[0].min);
+    ptMax_.push_back(it->getVariablesRange()[0].max);
+    par_.insert(par_.end(), p.begin(), p.end());
+  }
+  rhoOffset_.push_back(rhoMin_.size());
+
+  if( rhoMin_.size() != records.size() ){ // unsupported layout
+    etaMin_.clear();
+    return false;
+  }
+  return true;
+}
+
+
+bool JERTable::compileScaleFactor(const JME::JetResolutionObject& object) {
+  sfEtaMin_.clear();
+  sfEtaMax_.clear();
+  sf_.clear();
+
+  const JME::JetResolutionObject::Definition& definition = object.getDefinition();
+  if( definition.nBins() != 1 || definition.getBinName(0) != "JetEta" ) return false;
+
+  const std::vector<JME::JetResolutionObject::Record>& records = object.getRecords();
+  for( std::vector<JME::JetResolutionObject::Record>::const_iterator it = records.begin(); it != records.end(); ++it ){
+    const JME::JetResolutionObject::Range& eta = it->getBinsRange()[0];
+    const std::vector<float>& p = it->getParametersValues();
+    if( p.size() != 3 || (!sfEtaMin_.empty() && !(eta.min >= sfEtaMax_.back())) ){
+      sfEtaMin_.clear();
+      return false;
+    }
+    sfEtaMin_.push_back(eta.min);
+    sfEtaMax_.push_back(eta.max);
+    sf_.insert(sf_.end(), p.begin(), p.end());
+  }
+  return true;
+}
+
+
+int JERTable::findBin(const std::vector<float>& min, const std::vector<float>& max,
+		      const unsigned int begin, const unsigned int end, const float value) {
+  // first bin with value <= max; bins are ascending, so it is the first
+  // containing one if it also has min <= value
+  const unsigned int i = std::lower_bound(max.begin()+begin, max.begin()+end, value) - max.begin();
+  if( i == end || !(value >= min[i]) ) return -1;
+  return i;
+}
+
+
+float JERTable::resolution(const float pt, const float eta, const float rho) const {
+  const int iEta = findBin(etaMin_, etaMax_, 0, etaMin_.size(), eta);
+  if( iEta < 0 ) return 1.;
+  const int iRho = findBin(rhoMin_, rhoMax_, rhoOffset_[iEta], rhoOffset_[iEta+1], rho);
+  if( iRho < 0 ) return 1.;
+
+  const float x = std::min(std::max(pt, ptMin_[iRho]), ptMax_[iRho]);
+  const float* p = &par_[4*iRho];
+  const double dx = x;
+  const double p0 = p[0], p1 = p[1], p2 = p[2], p3 = p[3];
+  return std::sqrt(p0*std::abs(p0)/(dx*dx) + p1*p1*std::pow(dx,p3) + p2*p2);
+}
+
+
+void JERTable::scaleFactors(const float eta, float sf[3]) const {
+  const int iEta = findBin(sfEtaMin_, sfEtaMax_, 0, sfEtaMin_.size(), eta);
+  for( unsigned int i=0; i<3; ++i ) sf[i] = iEta < 0 ? 1.f : sf_[3*iEta+i];
+}
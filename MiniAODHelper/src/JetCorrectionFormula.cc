@@ -0,0 +1,251 @@
+// Compiled formulas of the JetCorrectorParameters payloads
+
+// system include files
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+
+#include "MiniAOD/MiniAODHelper/interface/JetCorrectionFormula.h"
+
+
+namespace {
+  const unsigned int maxStackSize = 64;
+
+  // as TMath::Max and TMath::Min
+  inline double tmax(const double a, const double b) { return a > b ? a : b; }
+  inline double tmin(const double a, const double b) { return a < b ? a : b; }
+
+  // L1FastJet, variables (Rho, JetPt, JetA)
+  double l1FastJet(const double* x, const double* p) {
+    return tmax(0.0001,1-x[2]*(p[0]+(p[1]*x[0])*(1+p[2]*std::log(x[1])))/x[1]);
+  }
+
+  // L1RC, variables (JetPt, JetA, Rho)
+  double l1RC(const double* x, const double* p) {
+    return tmax(0.0001,1-x[1]*(p[0]+p[1]*(x[2]-1.519)+p[2]*std::pow(x[2]-1.519,2))/x[0]);
+  }
+
+  // L2Relative, variable JetPt
+  double l2Relative(const double* x, const double* p) {
+    return tmax(0.0001,p[0]+((x[0]-p[1])*(p[2]+((x[0]-p[1])*(p[3]+((x[0]-p[1])*p[4]))))));
+  }
+
+  double one(const double*, const double*) {
+    return 1.;
+  }
+
+  struct NativeFormula {
+    const char* expression; // without spaces
+    double (*function)(const double*, const double*);
+    unsigned int nVariables, nParameters;
+  };
+
+  const NativeFormula nativeFormulas[] = {
+    { "max(0.0001,1-z*([0]+([1]*x)*(1+[2]*log(y)))/y)", l1FastJet, 3, 3 },
+    { "max(0.0001,1-y*([0]+[1]*(z-1.519)+[2]*pow(z-1.519,2))/x)", l1RC, 3, 3 },
+    { "max(0.0001,[0]+((x-[1])*([2]+((x-[1])*([3]+((x-[1])*[4]))))))", l2Relative, 1, 5 },
+    { "1", one, 0, 0 }
+  };
+
+  struct Function {
+    const char* name;
+    int op; // JetCorrectionFormula::Op
+    unsigned int nArgs;
+  };
+}
+
+
+bool JetCorrectionFormula::compile(const std::string& expression) {
+  native_ = 0;
+  program_.clear();
+  depth_ = 0;
+  stackSize_ = 0;
+  nVariables_ = 0;
+  nParameters_ = 0;
+
+  std::string s;
+  for( std::string::const_iterator c = expression.begin(); c != expression.end(); ++c ){
+    if( !std::isspace(static_cast<unsigned char>(*c)) ) s += *c;
+  }
+
+  for( const auto& formula: nativeFormulas ){
+    if( s == formula.expression ){
+      native_ = formula.function;
+      nVariables_ = formula.nVariables;
+      nParameters_ = formula.nParameters;
+      return true;
+    }
+  }
+
+  size_t pos = 0;
+  if( !parseSum(s, pos) || pos != s.size() || stackSize_ > maxStackSize ){
+    program_.clear();
+    return false;
+  }
+  return true;
+}
+
+
+void JetCorrectionFormula::emit(const Op op, const unsigned int index, const double value) {
+  Instruction instruction;
+  instruction.op = op;
+  instruction.index = index;
+  instruction.value = value;
+  program_.push_back(instruction);
+
+  // track the stack depth and the inputs the program needs
+  switch( op ){
+  case Const: ++depth_; break;
+  case Var: ++depth_; nVariables_ = std::max(nVariables_, index+1); break;
+  case Par: ++depth_; nParameters_ = std::max(nParameters_, index+1); break;
+  case Neg: case Log: case Log10: case Exp: case Sqrt: case Abs: break;
+  default: --depth_;
+  }
+  stackSize_ = std::max(stackSize_, depth_);
+}
+
+
+bool JetCorrectionFormula::parseSum(const std::string& s, size_t& pos) {
+  if( !parseProduct(s, pos) ) return false;
+  while( pos < s.size() && (s[pos] == '+' || s[pos] == '-') ){
+    const Op op = s[pos] == '+' ? Add : Sub;
+    ++pos;
+    if( !parseProduct(s, pos) ) return false;
+    emit(op);
+  }
+  return true;
+}
+
+
+bool JetCorrectionFormula::parseProduct(const std::string& s, size_t& pos) {
+  if( !parseUnary(s, pos) ) return false;
+  while( pos < s.size() && (s[pos] == '*' || s[pos] == '/') ){
+    const Op op = s[pos] == '*' ? Mul : Div;
+    ++pos;
+    if( !parseUnary(s, pos) ) return false;
+    emit(op);
+  }
+  return true;
+}
+
+
+bool JetCorrectionFormula::parseUnary(const std::string& s, size_t& pos) {
+  if( pos < s.size() && (s[pos] == '-' || s[pos] == '+') ){
+    const bool negate = s[pos] == '-';
+    ++pos;
+    if( !parseUnary(s, pos) ) return false;
+    if( negate ) emit(Neg);
+    return true;
+  }
+  return parsePower(s, pos);
+}
+
+
+bool JetCorrectionFormula::parsePower(const std::string& s, size_t& pos) {
+  if( !parsePrimary(s, pos) ) return false;
+  if( pos < s.size() && s[pos] == '^' ){
+    ++pos;
+    if( !parseUnary(s, pos) ) return false;
+    emit(Pow);
+  }
+  return true;
+}
+
+
+bool JetCorrectionFormula::parsePrimary(const std::string& s, size_t& pos) {
+  if( pos >= s.size() ) return false;
+  const char c = s[pos];
+
+  if( std::isdigit(static_cast<unsigned char>(c)) || c == '.' ){
+    const char* begin = s.c_str()+pos;
+    char* end = 0;
+    const double value = std::strtod(begin, &end);
+    if( end == begin ) return false;
+    pos += end-begin;
+    emit(Const, 0, value);
+    return true;
+  }
+
+  if( c == '[' ){
+    const size_t close = s.find(']', pos);
+    if( close == std::string::npos || close == pos+1 ) return false;
+    const std::string digits = s.substr(pos+1, close-pos-1);
+    if( digits.find_first_not_of("0123456789") != std::string::npos ) return false;
+    emit(Par, std::atoi(digits.c_str()));
+    pos = close+1;
+    return true;
+  }
+
+  if( c == '(' ){
+    ++pos;
+    if( !parseSum(s, pos) || pos >= s.size() || s[pos] != ')' ) return false;
+    ++pos;
+    return true;
+  }
+
+  if( !std::isalpha(static_cast<unsigned char>(c)) ) return false;
+  size_t end = pos;
+  while( end < s.size() && (std::isalnum(static_cast<unsigned char>(s[end])) || s[end] == ':' || s[end] == '_') ) ++end;
+  std::string name = s.substr(pos, end-pos);
+  pos = end;
+
+  static const std::string variables = "xyzt";
+  if( name.size() == 1 && variables.find(name[0]) != std::string::npos ){
+    emit(Var, variables.find(name[0]));
+    return true;
+  }
+
+  if( name.compare(0, 7, "TMath::") == 0 ) name = name.substr(7);
+  static const Function functions[] = {
+    { "max", Max, 2 }, { "Max", Max, 2 }, { "min", Min, 2 }, { "Min", Min, 2 },
+    { "pow", Pow, 2 }, { "Power", Pow, 2 },
+    { "log", Log, 1 }, { "Log", Log, 1 }, { "log10", Log10, 1 }, { "Log10", Log10, 1 },
+    { "exp", Exp, 1 }, { "Exp", Exp, 1 }, { "sqrt", Sqrt, 1 }, { "Sqrt", Sqrt, 1 },
+    { "abs", Abs, 1 }, { "fabs", Abs, 1 }, { "Abs", Abs, 1 }
+  };
+  for( const auto& function: functions ){
+    if( name != function.name ) continue;
+    if( pos >= s.size() || s[pos] != '(' ) return false;
+    ++pos;
+    for( unsigned int i=0; i<function.nArgs; ++i ){
+      if( i > 0 ){
+	if( pos >= s.size() || s[pos] != ',' ) return false;
+	++pos;
+      }
+      if( !parseSum(s, pos) ) return false;
+    }
+    if( pos >= s.size() || s[pos] != ')' ) return false;
+    ++pos;
+    emit(static_cast<Op>(function.op));
+    return true;
+  }
+  return false;
+}
+
+
+double JetCorrectionFormula::run(const double* x, const double* p) const {
+  double stack[maxStackSize];
+  unsigned int n = 0;
+  for( std::vector<Instruction>::const_iterator it = program_.begin(); it != program_.end(); ++it ){
+    switch( it->op ){
+    case Const: stack[n++] = it->value; break;
+    case Var:   stack[n++] = x[it->index]; break;
+    case Par:   stack[n++] = p[it->index]; break;
+    case Neg:   stack[n-1] = -stack[n-1]; break;
+    case Add:   --n; stack[n-1] = stack[n-1] + stack[n]; break;
+    case Sub:   --n; stack[n-1] = stack[n-1] - stack[n]; break;
+    case Mul:   --n; stack[n-1] = stack[n-1] * stack[n]; break;
+    case Div:   --n; stack[n-1] = stack[n-1] / stack[n]; break;
+    case Pow:   --n; stack[n-1] = std::pow(stack[n-1], stack[n]); break;
+    case Max:   --n; stack[n-1] = tmax(stack[n-1], stack[n]); break;
+    case Min:   --n; stack[n-1] = tmin(stack[n-1], stack[n]); break;
+    case Log:   stack[n-1] = std::log(stack[n-1]); break;
+    case Log10: stack[n-1] = std::log10(stack[n-1]); break;
+    case Exp:   stack[n-1] = std::exp(stack[n-1]); break;
+    case Sqrt:  stack[n-1] = std::sqrt(stack[n-1]); break;
+    case Abs:   stack[n-1] = std::fabs(stack[n-1]); break;
+    }
+  }
+  return n == 1 ? stack[0] : 0.;
+}
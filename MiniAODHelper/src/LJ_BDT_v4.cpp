@@ -151,8 +151,10 @@ LJ_BDT_v4::~LJ_BDT_v4(){
 std::string LJ_BDT_v4::GetCategory(const std::vector<pat::Jet>& selectedJets) const{
   int njets=selectedJets.size();
   int ntagged=0;
+  BTagIndex csv("pfCombinedInclusiveSecondaryVertexV2BJetTags");
+  csv.resolve(selectedJets);
   for(auto jet=selectedJets.begin(); jet!=selectedJets.end(); jet++){
-    if(MiniAODHelper::GetJetCSV(*jet)>btagMcut) ntagged++;
+    if(MiniAODHelper::GetJetCSV(*jet,csv)>btagMcut) ntagged++;
   }
   if(ntagged>=4&&njets>=6){
     return "6j4t"; 
@@ -202,11 +204,13 @@ float LJ_BDT_v4::Evaluate(std::string categoryLabel, const std::vector<pat::Muon
   if(selectedMuons.size()>0) lepton_vec.SetPtEtaPhiE(selectedMuons[0].pt(),selectedMuons[0].eta(),selectedMuons[0].phi(),selectedMuons[0].energy());
   if(selectedElectrons.size()>0) lepton_vec.SetPtEtaPhiE(selectedElectrons[0].pt(),selectedElectrons[0].eta(),selectedElectrons[0].phi(),selectedElectrons[0].energy());
   met_vec.SetPtEtaPhiE(pfMET.pt(),0,pfMET.phi(),pfMET.pt());
+  BTagIndex csv("pfCombinedInclusiveSecondaryVertexV2BJetTags");
+  csv.resolve(selectedJets);
   for(auto jet=selectedJets.begin();jet!=selectedJets.end(); jet++){
     TLorentzVector jetvec;
     jetvec.SetPtEtaPhiE(jet->pt(),jet->eta(),jet->phi(),jet->energy());
     jet_vecs.push_back(jetvec);
-    if(MiniAODHelper::GetJetCSV(*jet)>btagMcut){
+    if(MiniAODHelper::GetJetCSV(*jet,csv)>btagMcut){
       tagged_jet_vecs.push_back(jetvec);
     }
     vector<double> pxpypzE;
@@ -215,15 +219,16 @@ float LJ_BDT_v4::Evaluate(std::string categoryLabel, const std::vector<pat::Muon
     pxpypzE.push_back(jet->pz());
     pxpypzE.push_back(jet->energy());
     jets_vvdouble.push_back(pxpypzE);
-    jetCSV.push_back(MiniAODHelper::GetJetCSV(*jet));
+    jetCSV.push_back(MiniAODHelper::GetJetCSV(*jet,csv));
   }
   sortedCSV=jetCSV;
   std::sort(sortedCSV.begin(),sortedCSV.end(),std::greater<float>());
+  csv.resolve(selectedJetsLoose);
   for(auto jet=selectedJetsLoose.begin();jet!=selectedJetsLoose.end(); jet++){
     TLorentzVector jetvec;
     jetvec.SetPtEtaPhiE(jet->pt(),jet->eta(),jet->phi(),jet->energy());
     jet_loose_vecs.push_back(jetvec);
-    jetCSV_loose.push_back(MiniAODHelper::GetJetCSV(*jet));
+    jetCSV_loose.push_back(MiniAODHelper::GetJetCSV(*jet,csv));
   }
 
   // TODO loose jet and csv defintion
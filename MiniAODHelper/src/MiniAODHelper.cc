@@ -2,6 +2,8 @@
 #include "../interface/utils.h"
 
 #include "FWCore/Utilities/interface/Exception.h"
+#include <cstring>
+#include <functional>
 
 
 using namespace std;
@@ -25,59 +27,36 @@ MiniAODHelper::MiniAODHelper()
 
   samplename = "blank";
 
+  allcands_ = 0;
+
+  // tau IDs of isGoodTau, in the order of TauIDLabel
+  const char* tauIDLabels[nTauIDLabels] = { "decayModeFindingNewDMs", "againstMuonLoose3", "againstMuonTight3",
+					    "againstElectronVLooseMVA6", "againstElectronLooseMVA6", "againstElectronMediumMVA6",
+					    "byLooseCombinedIsolationDeltaBetaCorr3Hits", "byMediumCombinedIsolationDeltaBetaCorr3Hits",
+					    "byTightCombinedIsolationDeltaBetaCorr3Hits" };
+  for( unsigned int i=0; i<nTauIDLabels; ++i ) tauIDIndices_.push_back(TauIDIndex(tauIDLabels[i]));
+
   // JEC uncertainties
   jecUncertaintyTxtFileName_ = std::string(getenv("CMSSW_BASE")) + "/src/MiniAOD/MiniAODHelper/data/jec/Summer16_23Sep2016V4_MC_UncertaintySources_AK4PFchs.txt";
   if( jecUncertaintyTxtFileName_ != "" ) {
     if( !utils::fileExists(jecUncertaintyTxtFileName_) ) { // check if JEC uncertainty file exists
       throw cms::Exception("InvalidJECUncertaintyFile") << "No JEC uncertainty file '" << jecUncertaintyTxtFileName_ << "' found";
     }
+    if( !jecUncertaintyCache_.open(jecUncertaintyTxtFileName_) && utils::fileExists(PayloadCache::blobName(jecUncertaintyTxtFileName_)) ) {
+      edm::LogWarning("MiniAODHelper") << "Ignoring outdated or corrupt '" << PayloadCache::blobName(jecUncertaintyTxtFileName_) << "', reading the txt file. Rerun compileJECPayloads";
+    }
   }
 
-  { //  JER preparation
-
-    const std::string JER_file =  string(getenv("CMSSW_BASE")) + "/src/MiniAOD/MiniAODHelper/data/jec/Spring16_25nsV6_MC_PtResolution_AK4PFchs.txt" ;
-    if( !utils::fileExists(JER_file) ) {
-      throw cms::Exception("InvalidJERCorrectionFile") << "No JER correction file '" << JER_file << "' found";
-    }
-
-    double eta_min;
-    double eta_max;
-    double rho_min;
-    double rho_max;
-    double dummy;
-    double pt_min;
-    double pt_max;
-    double par0;
-    double par1;
-    double par2;
-    double par3;
-
-    JER_etaMin.clear();
-    JER_etaMax.clear();
-    JER_rhoMin.clear();
-    JER_rhoMax.clear();
-    JER_PtMin.clear();
-    JER_PtMax.clear();
-    JER_Par0.clear();
-    JER_Par1.clear();
-    JER_Par2.clear();
-    JER_Par3.clear();
-
-    std::ifstream infile( JER_file);
-    while (infile>>eta_min>>eta_max>>rho_min>>rho_max>>dummy>>pt_min>>pt_max>>par0>>par1>>par2>>par3) {
-      JER_etaMin.push_back(eta_min);
-      JER_etaMax.push_back(eta_max);
-      JER_rhoMin.push_back(rho_min);
-      JER_rhoMax.push_back(rho_max);
-      JER_PtMin .push_back(pt_min);
-      JER_PtMax .push_back(pt_max);
-      JER_Par0  .push_back(par0);
-      JER_Par1  .push_back(par1);
-      JER_Par2  .push_back(par2);
-      JER_Par3  .push_back(par3);
-    }
-
-  } // end of JER preparation
+  { // cut-based electron IDs and electron effective areas
+    const std::string electronIDPath = std::string(getenv("CMSSW_BASE")) + "/src/MiniAOD/MiniAODHelper/data/electronID/";
+
+    const char* electronIDFiles[nElectronIDCampaigns] = { "cutBasedElectronID_Phys14.txt", "cutBasedElectronID_Spring15.txt", "cutBasedElectronID_Summer16_80X.txt" };
+    for( unsigned int i=0; i<nElectronIDCampaigns; ++i ) electronIDTables_[i] = ElectronIDTable::shared(electronIDPath + electronIDFiles[i]);
+
+    // in the order of effAreaType
+    const char* effAreaFiles[4] = { "effAreaElectrons_fall17.txt", "effAreaElectrons_spring16.txt", "effAreaElectrons_spring15.txt", "effAreaElectrons_phys14.txt" };
+    for( unsigned int i=0; i<4; ++i ) electronEffectiveAreas_[i] = EffectiveAreaTable::shared(electronIDPath + effAreaFiles[i]);
+  }
   
 }
 
@@ -95,6 +74,15 @@ void MiniAODHelper::SetJER_SF_Tool(const edm::EventSetup& iSetup){
   JER_ak4_resolution = JME::JetResolution::get(iSetup, "AK4PFchs_pt");
   JER_ak4_resolutionSF = JME::JetResolutionScaleFactor::get(iSetup, "AK4PFchs");
 
+  // flat lookup tables; the JME objects stay in use for payloads that cannot be compiled
+  jerTable_.clear();
+  if( !jerTable_.compileResolution(*JER_ak4_resolution.getResolutionObject()) ) {
+    edm::LogWarning("MiniAODHelper") << "JER resolution payload not supported by JERTable, using JME::JetResolution";
+  }
+  if( !jerTable_.compileScaleFactor(*JER_ak4_resolutionSF.getResolutionObject()) ) {
+    edm::LogWarning("MiniAODHelper") << "JER scale factor payload not supported by JERTable, using JME::JetResolutionScaleFactor";
+  }
+
 }
 
 
@@ -190,12 +178,15 @@ void MiniAODHelper::SetPackedCandidates(const std::vector<pat::PackedCandidate>
       }
     }
   }
-  //  if (weightCone_ > 0) weights_.resize(neutral_.size());
-  //  std::fill(weights_.begin(), weights_.end(), -1.f);
   std::sort(charged_.begin(), charged_.end(), ByEta());
   std::sort(neutral_.begin(), neutral_.end(), ByEta());
   std::sort(pileup_.begin(),  pileup_.end(),  ByEta());
+  chargedIndex_.build(charged_, all.data());
+  neutralIndex_.build(neutral_, all.data());
+  pileupIndex_.build(pileup_,  all.data());
   clearVetos();
+  isoScratch_.self.assign(all.size(), false);
+  isoScratch_.selfKeys.clear();
 }
 
 // Return packed cands collection
@@ -222,24 +213,24 @@ void MiniAODHelper::SetBoostedJetCorrector(const JetCorrector* iCorrector){
 // Set up parameters one by one
 
 
-// Create a new instance of JetCorrectionUncertainty
+// Get the parameters of a JEC uncertainty source
 //
 // jetTypeLabel: the jet type, e.g. "AK4PFchs". Must be one of the valid names used
 // in the JEC records or txt files
 //
 // uncertaintyLabel: the uncertainty source. See also: https://cmssdt.cern.ch/SDT/doxygen/CMSSW_8_0_23/doc/html/dc/d33/classJetCorrectorParametersCollection.html#afb3d4c6fd711ca23d89e0625a22dc483 for a list of in principle valid labels.
 // Whether the uncertainty exists in the specific case depends on the particular payload
-JetCorrectionUncertainty*
-MiniAODHelper::CreateJetCorrectorUncertainty(const edm::EventSetup& iSetup, 
-					     const std::string& jetTypeLabel,
-					     const std::string& uncertaintyLabel) const {
+JetCorrectorParameters
+MiniAODHelper::CreateJetCorrectorParameters(const edm::EventSetup& iSetup, 
+					    const std::string& jetTypeLabel,
+					    const std::string& uncertaintyLabel) const {
   try {
     JetCorrectorParameters jetCorPar;
     if( jecUncertaintyTxtFileName_ != "" ) {
-      if( uncertaintyLabel == "Uncertainty" ) {// this is the key in the database but not in txt...
-	jetCorPar = JetCorrectorParameters(jecUncertaintyTxtFileName_,"Total");
-      } else {
-	jetCorPar = JetCorrectorParameters(jecUncertaintyTxtFileName_,uncertaintyLabel);
+      // "Uncertainty" is the key in the database but not in txt...
+      const std::string section = uncertaintyLabel == "Uncertainty" ? "Total" : uncertaintyLabel;
+      if( !jecUncertaintyCache_.jetCorrectorParameters(section,jetCorPar) ) {
+	jetCorPar = JetCorrectorParameters(jecUncertaintyTxtFileName_,section);
       }
     } else {
       edm::ESHandle<JetCorrectorParametersCollection> JetCorParColl;
@@ -247,32 +238,82 @@ MiniAODHelper::CreateJetCorrectorUncertainty(const edm::EventSetup& iSetup,
       //JetCorrectorParameters const & JetCorPar = (*JetCorParColl)[uncertaintyLabel];
       jetCorPar = (*JetCorParColl)[uncertaintyLabel];
     }
-    return new JetCorrectionUncertainty(jetCorPar);
+    return jetCorPar;
   } catch (cms::Exception& e) {
     throw cms::Exception("InvalidJECUncertaintyLabel") << "No JEC uncertainty with label '" << uncertaintyLabel << "' found in event setup";
   }
-  return 0;
+  return JetCorrectorParameters();
+}
+
+// Identity of the JEC uncertainty payload: the txt file, or the jet type and
+// the IOV of the JetCorrectionsRecord
+std::string
+MiniAODHelper::JECUncertaintyPayloadId(const edm::EventSetup& iSetup) const {
+  if( jecUncertaintyTxtFileName_ != "" ) return "txt:" + jecUncertaintyTxtFileName_;
+  return "db:" + jetTypeLabelForJECUncertainty_ + ":" + std::to_string(iSetup.get<JetCorrectionsRecord>().cacheIdentifier());
 }
 
-// Add a new JetCorrectionUncertainty of type uncertaintyLabel to the list of
-// considered uncertainties.
+// (Re)load the table of the JEC uncertainties with all sources of the payload,
+// so that any JEC uncertainty type can be served from it without a rebuild.
+// Helpers with the same payload, e.g. the stream copies of a module, share the
+// table.
+void
+MiniAODHelper::LoadJECUncertainties(const edm::EventSetup& iSetup) {
+  const std::string payload = JECUncertaintyPayloadId(iSetup);
+
+  jecUncertainties_ = JECUncertaintyTable::shared(payload, [this,&iSetup](JECUncertaintyTable& table) {
+      std::vector<std::string> missing; // labels that are not in the payload
+      for( unsigned int i=1; i<Systematics::nTypes; ++i ){
+	const Systematics::Type type = Systematics::Type(i);
+	if( !Systematics::isJECUncertainty(type) ) continue;
+	const std::string uncertaintyLabel = Systematics::GetJECUncertaintyLabel(type);
+	if( std::find(missing.begin(), missing.end(), uncertaintyLabel) != missing.end() ) continue;
+	const std::vector<std::string> labels = table.labels();
+	if( std::find(labels.begin(), labels.end(), uncertaintyLabel) != labels.end() ){
+	  // the other direction of a compiled source, the parameters are not read
+	  table.addSource(type,uncertaintyLabel,JetCorrectorParameters());
+	  continue;
+	}
+	try {
+	  table.addSource(type,uncertaintyLabel,CreateJetCorrectorParameters(iSetup,jetTypeLabelForJECUncertainty_,uncertaintyLabel));
+	} catch (cms::Exception&) {
+	  missing.push_back(uncertaintyLabel);
+	}
+      }
+    });
+  jecUncertaintyPayload_ = payload;
+}
+
+// Load the JEC uncertainty table, e.g. in beginRun, so that no source has to be
+// read during the event loop. Throws if the payload lacks the source of one of
+// types (non-JEC types are ignored).
+void
+MiniAODHelper::SetJECUncertaintyTypes(const edm::EventSetup& iSetup, const std::vector<Systematics::Type>& types) {
+  if( !jecUncertainties_ ) LoadJECUncertainties(iSetup);
+  for( const auto& type: types ){
+    if( Systematics::isJECUncertainty(type) && !jecUncertainties_->hasSource(type) ){
+      throw cms::Exception("InvalidJECUncertaintyLabel") << "No JEC uncertainty with label '" << Systematics::GetJECUncertaintyLabel(type) << "' found in the payload";
+    }
+  }
+}
+
+// Check that the JEC uncertainty source of iSysType is available
 //
-// Note: will be called automatically if a new uncertainty type previously not
-// in the list is requested by GetCorrectedJet --> avoid having to initialize
-// unused types
+// Note: the table holds all sources of the payload, which is loaded with the
+// first request of GetCorrectedJet. Prefer SetJECUncertaintyTypes, which
+// loads it before the first event.
 void
-MiniAODHelper::AddJetCorrectorUncertainty(const edm::EventSetup& iSetup, const std::string& uncertaintyLabel) {
-  jecUncertainties_[uncertaintyLabel] = std::unique_ptr<JetCorrectionUncertainty>( CreateJetCorrectorUncertainty(iSetup,jetTypeLabelForJECUncertainty_,uncertaintyLabel) );
+MiniAODHelper::AddJetCorrectorUncertainty(const edm::EventSetup& iSetup, const Systematics::Type iSysType) {
+  SetJECUncertaintyTypes(iSetup, std::vector<Systematics::Type>(1, iSysType));
 }
 
-// Upate the JetCorrectionUncertainty instances for all considered types of
-// JEC uncertainties. Call when a new payload is required, e.g. at the begin
-// of a new run (=possibly new IOV).
+// Update the JEC uncertainty table. Call when a new payload may be required,
+// e.g. at the begin of a new run (=possibly new IOV); the table is only
+// rebuilt if the payload changed.
 void
 MiniAODHelper::UpdateJetCorrectorUncertainties(const edm::EventSetup& iSetup) {
-  for(auto& jecUncIt: jecUncertainties_) {
-    jecUncIt.second.reset( CreateJetCorrectorUncertainty(iSetup,jetTypeLabelForJECUncertainty_,jecUncIt.first) );
-  }
+  if( !jecUncertainties_ || JECUncertaintyPayloadId(iSetup) == jecUncertaintyPayload_ ) return;
+  LoadJECUncertainties(iSetup);
 }
 
 // Return the JEC uncertainty value
@@ -283,18 +324,21 @@ MiniAODHelper::UpdateJetCorrectorUncertainties(const edm::EventSetup& iSetup) {
 // --> *always* scale JES by (1+value).
 double
 MiniAODHelper::GetJECUncertainty(const pat::Jet& jet, const edm::EventSetup& iSetup, const Systematics::Type iSysType) {
-  const std::string uncertaintyLabel = Systematics::GetJECUncertaintyLabel(iSysType);
-  std::map< std::string, std::unique_ptr<JetCorrectionUncertainty> >::iterator jecUncIt = jecUncertainties_.find(uncertaintyLabel);
-  if( jecUncIt == jecUncertainties_.end() ) { // Lazy initialization
-    AddJetCorrectorUncertainty(iSetup,uncertaintyLabel);
-    jecUncIt = jecUncertainties_.find(uncertaintyLabel);
-  }
-  JetCorrectionUncertainty* unc = jecUncIt->second.get();
+  return GetJECUncertainty(jet.pt(),jet.eta(),iSetup,iSysType);
+}
+
+// Same as above, for a jet with corrected pt and eta
+double
+MiniAODHelper::GetJECUncertainty(const double pt, const double eta, const edm::EventSetup& iSetup, const Systematics::Type iSysType) {
+  if( !jecUncertainties_ ) LoadJECUncertainties(iSetup); // Lazy initialization
+  return jecUncertainties_->uncertainty(iSysType,pt,eta); // here you must use the CORRECTED jet pt
+}
 
-  unc->setJetEta(jet.eta());
-  unc->setJetPt(jet.pt()); // here you must use the CORRECTED jet pt
-  if( Systematics::isJECUncertaintyUp(iSysType) ) return +1. * unc->getUncertainty(true);
-  else                                        return -1. * unc->getUncertainty(false);
+void
+MiniAODHelper::GetJECUncertainties(const std::vector<float>& pt, const std::vector<float>& eta, const edm::EventSetup& iSetup, const std::vector<Systematics::Type>& sysTypes, std::vector<float>& out) {
+  if( !jecUncertainties_ ) LoadJECUncertainties(iSetup); // Lazy initialization
+  out.resize(pt.size()*sysTypes.size());
+  if( !out.empty() ) jecUncertainties_->uncertainties(&pt[0],&eta[0],pt.size(),sysTypes,&out[0]);
 }
 
 
@@ -311,10 +355,19 @@ MiniAODHelper::GetSelectedMuons(const std::vector<pat::Muon>& inputMuons, const
 
   CheckSetUp();
 
+  return GetSelectedMuons(inputMuons, EvaluateMuonIDs(inputMuons, leptonIDMask::bit(iMuonID), iconeSize, icorrType), iMinPt, iMuonID, iMaxEta);
+}
+
+
+std::vector<pat::Muon>
+MiniAODHelper::GetSelectedMuons(const std::vector<pat::Muon>& inputMuons, const std::vector<uint64_t>& masks, const float iMinPt, const muonID::muonID iMuonID, const float iMaxEta){
+
   std::vector<pat::Muon> selectedMuons;
 
-  for( std::vector<pat::Muon>::const_iterator it = inputMuons.begin(), ed = inputMuons.end(); it != ed; ++it ){
-    if( isGoodMuon(*it,iMinPt,iMaxEta,iMuonID,iconeSize,icorrType) ) selectedMuons.push_back(*it);
+  for( unsigned int i=0; i<inputMuons.size(); ++i ){
+    const pat::Muon& muon = inputMuons[i];
+    if( !(masks[i] & leptonIDMask::bit(iMuonID)) ) continue;
+    if( (muon.pt() >= iMinPt) && (fabs(muon.eta()) <= iMaxEta) ) selectedMuons.push_back(muon);
   }
 
   return selectedMuons;
@@ -326,10 +379,19 @@ MiniAODHelper::GetSelectedElectrons(const std::vector<pat::Electron>& inputElect
 
   CheckSetUp();
 
+  return GetSelectedElectrons(inputElectrons, EvaluateElectronIDs(inputElectrons, leptonIDMask::bit(iElectronID)), iMinPt, iElectronID, iMaxEta);
+}
+
+
+std::vector<pat::Electron>
+MiniAODHelper::GetSelectedElectrons(const std::vector<pat::Electron>& inputElectrons, const std::vector<uint64_t>& masks, const float iMinPt, const electronID::electronID iElectronID, const float iMaxEta){
+
   std::vector<pat::Electron> selectedElectrons;
 
-  for( std::vector<pat::Electron>::const_iterator it = inputElectrons.begin(), ed = inputElectrons.end(); it != ed; ++it ){
-    if( isGoodElectron(*it,iMinPt,iMaxEta,iElectronID) ) selectedElectrons.push_back(*it);
+  for( unsigned int i=0; i<inputElectrons.size(); ++i ){
+    const pat::Electron& electron = inputElectrons[i];
+    if( !(masks[i] & leptonIDMask::bit(iElectronID)) ) continue;
+    if( (electron.pt() >= iMinPt) && (fabs(electron.eta()) <= iMaxEta) ) selectedElectrons.push_back(electron);
   }
 
   return selectedElectrons;
@@ -339,11 +401,13 @@ std::vector<pat::Tau>
 MiniAODHelper::GetSelectedTaus(const std::vector<pat::Tau>& inputTaus, const float iMinPt, const tau::ID id){
 
   CheckSetUp();
+  CheckVertexSetUp();
 
   std::vector<pat::Tau> selectedTaus;
+  for( auto& index: tauIDIndices_ ) index.resolve(inputTaus);
 
   for( std::vector<pat::Tau>::const_iterator it = inputTaus.begin(), ed = inputTaus.end(); it != ed; ++it ){
-    if( isGoodTau(*it,iMinPt,id) ) selectedTaus.push_back(*it);
+    if( PassesTauSelection(*it,iMinPt,id) ) selectedTaus.push_back(*it);
   }
 
   return selectedTaus;
@@ -407,6 +471,137 @@ std::vector<pat::Jet> MiniAODHelper::GetUncorrectedJets(
 }
 
 
+// Views of the jets as they are
+std::vector<CorrectedJetView>
+MiniAODHelper::GetJetViews(const std::vector<pat::Jet>& inputJets){
+
+  std::vector<CorrectedJetView> views;
+  views.reserve(inputJets.size());
+  const BTagIndex& csv = csvIndex(inputJets);
+
+  for( unsigned int i=0; i<inputJets.size(); ++i ){
+    const pat::Jet& jet = inputJets[i];
+    CorrectedJetView view = { i, float(jet.pt()), float(jet.eta()), float(jet.phi()), float(jet.mass()), 1.f, 1.f,
+			      GetJetCSV(jet,csv) };
+    views.push_back(view);
+  }
+
+  return views;
+}
+
+
+// Views of the uncorrected jets: jes is the factor back to the uncorrected p4,
+// as set by GetUncorrectedJets
+std::vector<CorrectedJetView>
+MiniAODHelper::GetUncorrectedJetViews(const std::vector<pat::Jet>& inputJets){
+
+  CheckSetUp();
+
+  std::vector<CorrectedJetView> views = GetJetViews(inputJets);
+
+  for( unsigned int i=0; i<views.size(); ++i ){
+    const double jes = inputJets[i].jecFactor(0);
+    views[i].pt *= jes;
+    views[i].mass *= jes;
+    views[i].jes = jes;
+  }
+
+  return views;
+}
+
+
+std::vector<CorrectedJetView>
+MiniAODHelper::GetSelectedJetViews(const std::vector<CorrectedJetView>& inputViews, const std::vector<pat::Jet>& sourceJets, const float iMinPt, const float iMaxAbsEta, const jetID::jetID iJetID, const char iCSVwp){
+
+  CheckSetUp();
+
+  std::vector<CorrectedJetView> selectedViews;
+
+  for( std::vector<CorrectedJetView>::const_iterator it = inputViews.begin(), ed = inputViews.end(); it != ed; ++it ){
+    if( isGoodJet(*it, sourceJets[it->index], iMinPt, iMaxAbsEta, iJetID, iCSVwp) ) selectedViews.push_back(*it);
+  }
+
+  return selectedViews;
+}
+
+
+// Same corrections as GetCorrectedJet(inputJets[index],...), without copying the jet
+CorrectedJetView
+MiniAODHelper::GetCorrectedJetView(const std::vector<pat::Jet>& inputJets, const unsigned int index, const edm::Event& event, const edm::EventSetup& setup, const edm::Handle<reco::GenJetCollection>& genjets, const Systematics::Type iSysType, const bool doJES, const bool doJER, const float corrFactor, const float uncFactor){
+
+  const pat::Jet& jet = inputJets[index];
+  double jes = 1.;
+  double jer = 1.;
+  GetJetCorrectionFactors(jet, event, setup, genjets, iSysType, doJES, doJER, corrFactor, uncFactor, jes, jer);
+
+  csvIndex_.resolve(jet);
+  const double factor = jes*jer;
+  CorrectedJetView view = { index, float(jet.pt()*factor), float(jet.eta()), float(jet.phi()), float(jet.mass()*factor),
+			    float(jes), float(jer), GetJetCSV(jet,csvIndex_) };
+  return view;
+}
+
+
+std::vector<CorrectedJetView>
+MiniAODHelper::GetCorrectedJetViews(const std::vector<pat::Jet>& inputJets, const edm::Event& event, const edm::EventSetup& setup, const edm::Handle<reco::GenJetCollection>& genjets, const Systematics::Type iSysType, const bool doJES, const bool doJER, const float corrFactor, const float uncFactor){
+
+  if( !doJES && !doJER ) return GetJetViews(inputJets);
+
+  CheckSetUp();
+
+  std::vector<CorrectedJetView> views;
+  views.reserve(inputJets.size());
+
+  for( unsigned int i=0; i<inputJets.size(); ++i ){
+    views.push_back(GetCorrectedJetView(inputJets,i,event,setup,genjets,iSysType,doJES,doJER,corrFactor,uncFactor));
+  }
+
+  return views;
+}
+
+
+std::vector<JetCorrectionInfo>
+MiniAODHelper::GetJetCorrectionInfos(const std::vector<pat::Jet>& inputJets, const edm::Event& event, const edm::EventSetup& setup, const edm::Handle<reco::GenJetCollection>& genjets, const Systematics::Type iSysType, const bool doJES, const bool doJER, const float corrFactor, const float uncFactor, const bool withUncertainties){
+
+  const unsigned int nJets = inputJets.size();
+  std::vector<JetCorrectionInfo> infos(nJets);
+
+  for( unsigned int i=0; i<nJets; ++i ){
+    double jes = 1.;
+    double jer = 1.;
+    GetJetCorrectionFactors(inputJets[i], event, setup, genjets, iSysType, doJES, doJER, corrFactor, uncFactor, jes, jer, &infos[i]);
+  }
+
+  if( withUncertainties && doJES && nJets > 0 ){
+    // at the corrected pt, for all jets in one call
+    std::vector<float> pt(nJets), eta(nJets), unc;
+    for( unsigned int i=0; i<nJets; ++i ){
+      pt[i] = inputJets[i].pt()*infos[i].jes*corrFactor;
+      eta[i] = inputJets[i].eta();
+    }
+    const std::vector<Systematics::Type> types = { Systematics::JESup, Systematics::JESdown };
+    GetJECUncertainties(pt, eta, setup, types, unc);
+    for( unsigned int i=0; i<nJets; ++i ){
+      infos[i].jesUp = 1. + unc[2*i];
+      infos[i].jesDown = 1. + unc[2*i+1];
+    }
+  }
+
+  return infos;
+}
+
+
+pat::Jet
+MiniAODHelper::GetJet(const CorrectedJetView& view, const std::vector<pat::Jet>& sourceJets) const {
+
+  pat::Jet jet = sourceJets[view.index];
+  jet.scaleEnergy(view.factor());
+  return jet;
+}
+
+
+// Reads the factor from the cached correction table when the jet is in it,
+// see GetJetCorrection
 pat::Jet MiniAODHelper::GetCorrectedJet(const pat::Jet& inputJet,
 					const edm::Event& event,
 					const edm::EventSetup& setup,
@@ -417,19 +612,15 @@ pat::Jet MiniAODHelper::GetCorrectedJet(const pat::Jet& inputJet,
 					const float corrFactor,
 					const float uncFactor) {
 
-  double factor = 1.;
   pat::Jet outputJet = inputJet;
-  ApplyJetEnergyCorrection(outputJet,
-			   factor,
-			   event,
-			   setup,
-			   genjets,
-			   iSysType,
-			   doJES,
-			   doJER,
-			   true, // addUserFloats
-			   corrFactor,
-			   uncFactor);
+  if( !doJES && !doJER ) return outputJet;
+
+  float factor = 1.;
+  float jes = 1.;
+  GetJetCorrection(inputJet, event, setup, genjets, iSysType, doJES, doJER, corrFactor, uncFactor, factor, jes);
+
+  if( doJES && jetCorrectionUserFloats_ ) AddJetCorrectionUserFloats(outputJet, jes, setup); // see SetJetCorrectionUserFloats
+  outputJet.scaleEnergy( factor );
 
   return outputJet;
 }
@@ -445,24 +636,148 @@ float MiniAODHelper::GetJetCorrectionFactor(const pat::Jet& inputJet,
 					    const float corrFactor,
 					    const float uncFactor) {
 
-  double factor = 1.;
-  pat::Jet outputJet = inputJet;
-  ApplyJetEnergyCorrection(outputJet,
-			   factor,
-			   event,
-			   setup,
-			   genjets,
-			   iSysType,
-			   doJES,
-			   doJER,
-			   false, // addUserFloats: does not make sense to add them to intermediate outputJet
-			   corrFactor,
-			   uncFactor);
+  if( !doJES && !doJER ) return 1.;
+
+  float factor = 1.;
+  float jes = 1.;
+  GetJetCorrection(inputJet, event, setup, genjets, iSysType, doJES, doJER, corrFactor, uncFactor, factor, jes);
 
   return factor;
 }
 
 
+void MiniAODHelper::GetJetCorrection(const pat::Jet& jet,
+				     const edm::Event& event,
+				     const edm::EventSetup& setup,
+				     const edm::Handle<reco::GenJetCollection>& genjets,
+				     const Systematics::Type iSysType,
+				     const bool doJES,
+				     const bool doJER,
+				     const float corrFactor,
+				     const float uncFactor,
+				     float& factor,
+				     float& jes,
+				     const JetChain chain) {
+
+  // a jet of the cached collection reads its factors from the table, which
+  // gets the column of iSysType for all its jets if it lacks it
+  if( chain == JetChain::AK4 && jetCorrectionCache_.matches(event, genjets, corrector, doJES, doJER, corrFactor, uncFactor) ){
+    const int i = jetCorrectionCache_.index(jet);
+    if( i >= 0 ){
+      if( !jetCorrectionCache_.table.has(iSysType) ) AddCachedJetCorrectionColumns(event, setup, genjets, std::vector<Systematics::Type>(1, iSysType));
+      factor = jetCorrectionCache_.table.factor(i, iSysType);
+      jes = jetCorrectionCache_.table.jes[i];
+      return;
+    }
+  }
+
+  JetCorrectionTable table;
+  const std::vector<const pat::Jet*> jets(1, &jet);
+  const std::vector<Systematics::Type> sysTypes(JetCorrectionTable::varies(iSysType) ? 1 : 0, iSysType);
+  FillJetCorrectionTable(jets, event, setup, genjets, sysTypes, doJES, doJER, corrFactor, uncFactor, table, chain);
+  factor = table.factor(0, iSysType);
+  jes = table.jes[0];
+}
+
+
+// Nominal JES of the jet corrector, shared by all correction paths
+double MiniAODHelper::GetNominalJES(const pat::Jet& jet, const edm::Event& event, const edm::EventSetup& setup, const JetChain chain) {
+  const JetCorrector* jetCorrector = chain == JetChain::AK8 ? ak8corrector : corrector;
+  if( jetCorrector ) return jetCorrector->correction(jet, event, setup);
+  if( chain == JetChain::AK8 || !use_corrected_jets ) edm::LogError("MiniAODHelper") << "Trying to use Full Framework GetCorrectedJets without setting jet corrector!";
+  return 1.;
+}
+
+
+// JER factor of a jet on top of its JES factor jes, shared by all correction
+// paths. The stochastic smearing is seeded with the direction of the input jet.
+double MiniAODHelper::GetJERFactor(const pat::Jet& jet,
+				   const double jes,
+				   const edm::Event& event,
+				   const edm::Handle<reco::GenJetCollection>& genjets,
+				   const GenJetIndex& genJetIndex,
+				   const Systematics::Type iSysType,
+				   const reco::GenJet** matched_genjet) {
+
+  // - - - 
+  // instruction from https://twiki.cern.ch/twiki/bin/view/CMSPublic/WorkBookJetEnergyResolution?rev=15#CMSSW_7_6_X_and_CMSSW_8_0X
+  // - - -
+  const double pt = jet.pt()*jes;
+  const float resolution = GetJERResolution(pt, jet.eta());
+  const reco::GenJet* match = MatchGenJet(pt, jet.eta(), jet.phi(), resolution, genjets, genJetIndex, 0.4);
+  if( matched_genjet ) *matched_genjet = match;
+  // in case of no matching, perform stochastic smearing: Gaus( 0, resolution ) = resolution * Gaus( 0, 1 )
+  const double gaus = match ? 0. : GetJERGaussian(event, jet.eta(), jet.phi());
+  const double rescaleFactor = GetJERRescaleFactor(pt, jet.eta(), resolution, match, iSysType, gaus);
+
+  // - - - - - - - - - - 
+  // Rescale factor is so large that the direction of the jet is flipped. 
+  //  This is not the JER is supposed to do.
+  //  JET people recommend to put a limit.
+  // 
+  const double MIN_JET_ENERGY = 1e-2; //  https://github.com/cms-sw/cmssw/blob/CMSSW_8_0_25/PhysicsTools/PatUtils/interface/SmearedJetProducerT.h#L283
+  return max( rescaleFactor, MIN_JET_ENERGY / (jet.energy()*jes) );
+}
+
+
+// Compatibility user floats of a jet with the nominal JES jes, before it is corrected
+void MiniAODHelper::AddJetCorrectionUserFloats(pat::Jet& jet, const double jes, const edm::EventSetup& setup) {
+  jet.addUserFloat("HelperJES",jes);
+  jet.addUserFloat("HelperJESUp",1. + GetJECUncertainty(jet,setup,Systematics::JESup));
+  jet.addUserFloat("HelperJESDown",1. + GetJECUncertainty(jet,setup,Systematics::JESdown));
+}
+
+
+// JES and JER factors of a jet, as applied by ApplyJetEnergyCorrection, without
+// modifying or copying the jet. Fills info, except for the JES uncertainties.
+void MiniAODHelper::GetJetCorrectionFactors(const pat::Jet& jet,
+					    const edm::Event& event,
+					    const edm::EventSetup& setup,
+					    const edm::Handle<reco::GenJetCollection>& genjets,
+					    const Systematics::Type iSysType,
+					    const bool doJES,
+					    const bool doJER,
+					    const float corrFactor,
+					    const float uncFactor,
+					    double& jesFactor,
+					    double& jerFactor,
+					    JetCorrectionInfo* info) {
+  jesFactor = 1.;
+  jerFactor = 1.;
+  if( info ) {
+    const JetCorrectionInfo none = { 1., 1., 1., 1., -1 };
+    *info = none;
+  }
+
+  if( !doJES && !doJER ) return;
+
+  CheckSetUp();
+
+  /// JES
+  if( doJES ){
+    const double scale = GetNominalJES(jet, event, setup);
+    jesFactor = scale*corrFactor;
+    if( info ) info->jes = scale;
+
+    if( Systematics::isJECUncertainty(iSysType) ) {
+      const double unc = GetJECUncertainty(jet.pt()*jesFactor,jet.eta(),setup,iSysType);
+      jesFactor *= 1. + (unc*uncFactor);
+    }
+  }
+
+  /// JER
+  if( doJER && !isData ){
+    const reco::GenJet* matched_genjet = 0;
+    jerFactor = GetJERFactor(jet, jesFactor, event, genjets, GetGenJetIndex(event,genjets), iSysType, &matched_genjet);
+
+    if( info ) {
+      info->jer = jerFactor;
+      if( matched_genjet ) info->genJetIndex = matched_genjet - &(*genjets)[0];
+    }
+  }
+}
+
+
 void MiniAODHelper::ApplyJetEnergyCorrection(pat::Jet& jet,
 					     double& totalCorrFactor,
 					     const edm::Event& event,
@@ -476,309 +791,339 @@ void MiniAODHelper::ApplyJetEnergyCorrection(pat::Jet& jet,
 					     const float uncFactor) {
   totalCorrFactor = 1.;
 
-  if( doJES || doJER ) {
-    CheckSetUp();
+  if( !doJES && !doJER ) return;
 
-    /// JES
-    if( doJES ){
-      double scale = 1.;
-      if (corrector) {
-	scale = corrector->correction(jet, event, setup);
-      } else if (!use_corrected_jets) {
-	edm::LogError("MiniAODHelper") << "Trying to use Full Framework GetCorrectedJets without setting jet corrector!";
-      }
-      if( addUserFloats ) {
-	  jet.addUserFloat("HelperJES",scale);
-	  const double uncUp = GetJECUncertainty(jet,setup,Systematics::JESup);
-	  const double uncDown = GetJECUncertainty(jet,setup,Systematics::JESdown);
-	  const double jecvarUp = 1. + (uncUp);
-	  const double jecvarDown = 1. + (uncDown);
-	  jet.addUserFloat("HelperJESUp",jecvarUp);
-	  jet.addUserFloat("HelperJESDown",jecvarDown);
-      }
+  double jes = 1.;
+  double jer = 1.;
+  JetCorrectionInfo info;
+  GetJetCorrectionFactors(jet, event, setup, genjets, iSysType, doJES, doJER, corrFactor, uncFactor, jes, jer, &info);
 
-      const double jec = scale*corrFactor;
-      jet.scaleEnergy( jec );
-      totalCorrFactor *= jec;
+  if( doJES && addUserFloats ) AddJetCorrectionUserFloats(jet, info.jes, setup);
 
-      if( Systematics::isJECUncertainty(iSysType) ) {
-	const double unc = GetJECUncertainty(jet,setup,iSysType);
-	const double jecvar = 1. + (unc*uncFactor);
-	jet.scaleEnergy( jecvar );
-	totalCorrFactor *= jecvar;
-      }
-    }
-
-    /// JER
-    if( doJER && !isData ){
-
-      // - - - 
-      // instruction from https://twiki.cern.ch/twiki/bin/view/CMSPublic/WorkBookJetEnergyResolution?rev=15#CMSSW_7_6_X_and_CMSSW_8_0X
-      // - - -
-      double rescaleFactor = 0.0 ; 
+  totalCorrFactor = jes*jer;
+  jet.scaleEnergy( totalCorrFactor );
+}
 
-      JME::JetParameters jer_param = { {JME::Binning::JetEta, jet.eta()} } ;
 
-      const double JET_core_resolution_scale_factor 
-	= (iSysType == Systematics::JERup   ) ?     JER_ak4_resolutionSF .getScaleFactor(jer_param, Variation::UP)  
-	: (    iSysType == Systematics::JERdown ) ? JER_ak4_resolutionSF .getScaleFactor(jer_param, Variation::DOWN)  
-	:                                       JER_ak4_resolutionSF .getScaleFactor(jer_param); ;
+// AK8 chain of the correction engine, see FillJetCorrectionTable
+pat::Jet
+MiniAODHelper::GetCorrectedAK8Jet(const pat::Jet& inputJet, const edm::Event& event, const edm::EventSetup& setup, const edm::Handle<reco::GenJetCollection>& genjets, const Systematics::Type iSysType, const bool& doJES, const bool& doJER, const float& corrFactor, const float& uncFactor){
 
+  if( !doJES && !doJER ) return inputJet;
 
-      reco::GenJet matched_genjet;
-      if ( GenJet_Match(jet, genjets, matched_genjet, 0.4) ) { // = Failuer in either dR(jet-gen) or delta_Pt within 3 sigma.
-	rescaleFactor = max( 0.0,
-			     1.0 + ( JET_core_resolution_scale_factor - 1.0  ) * ( jet.pt() - matched_genjet.pt() ) / jet.pt() ) ;
-	// Reference of this equation : https://github.com/cms-sw/cmssw/blob/CMSSW_8_0_25/PhysicsTools/PatUtils/interface/SmearedJetProducerT.h#L237
+  float factor = 1.;
+  float jes = 1.;
+  GetJetCorrection(inputJet, event, setup, genjets, iSysType, doJES, doJER, corrFactor, uncFactor, factor, jes, JetChain::AK8);
 
-      }else{
-	// in case of no matching, perform stochastic smearing.
+  pat::Jet outputJet = inputJet;
+  outputJet.scaleEnergy( factor );
 
-	JME::JetParameters parameter; 
-	parameter.setJetPt(jet.pt());
-	parameter.setJetEta(jet.eta()); 
-	parameter.setRho( useRho ) ; 
+  return outputJet;
+}
 
-	const double resolution = JER_ak4_resolution.getResolution( parameter );
 
-	rescaleFactor = max( 0.0,
-			     1.0
-			     + JERRandumGenerator.Gaus( 0.0, resolution ) // mean = zero, sigma = resolution
-			     * sqrt( max ( 0.0 , - 1.0 + JET_core_resolution_scale_factor * JET_core_resolution_scale_factor) )
-			     );
-			     //
-			     // equation from https://twiki.cern.ch/twiki/bin/view/CMSPublic/WorkBookJetEnergyResolution?rev=15#CMSSW_7_6_X_and_CMSSW_8_0X
-			     // 
-			     // note : distribution of Gaus( 0, sigma ) * A and Gaus( 0, sigma * A ) result in the same.
-			     //  
-      }
-      
-      // - - - - - - - - - - 
-      // Rescale factor is so large that the direction of the jet is flipped. 
-      //  This is not the JER is supposed to do.
-      //  JET people recommend to put a limit.
-      // 
-      const double MIN_JET_ENERGY = 1e-2; //  https://github.com/cms-sw/cmssw/blob/CMSSW_8_0_25/PhysicsTools/PatUtils/interface/SmearedJetProducerT.h#L283
-      if( jet.energy() * rescaleFactor < MIN_JET_ENERGY ){
-	rescaleFactor =  MIN_JET_ENERGY / jet.energy() ;
-	jet.scaleEnergy(  rescaleFactor );
-      }
-
-      // - - - - - - - - - -      
-      // - apply thre prepared rescale factor to the jet.
-      // - - - - - - - - - -      
+float
+MiniAODHelper::GetAK8JetCorrectionFactor(const pat::Jet& inputJet, const edm::Event& event, const edm::EventSetup& setup, const edm::Handle<reco::GenJetCollection>& genjets, const Systematics::Type iSysType, const bool& doJES, const bool& doJER, const float& corrFactor, const float& uncFactor){
 
-      jet.scaleEnergy(  rescaleFactor );
-      totalCorrFactor *= rescaleFactor ;
+  if( !doJES && !doJER ) return 1.;
 
-    }
+  float factor = 1.;
+  float jes = 1.;
+  GetJetCorrection(inputJet, event, setup, genjets, iSysType, doJES, doJER, corrFactor, uncFactor, factor, jes, JetChain::AK8);
 
-  }
+  return factor;
 }
 
 
-pat::Jet
-MiniAODHelper::GetCorrectedAK8Jet(const pat::Jet& inputJet, const edm::Event& event, const edm::EventSetup& setup, const edm::Handle<reco::GenJetCollection>& genjets, const Systematics::Type iSysType, const bool& doJES, const bool& doJER, const float& corrFactor, const float& uncFactor){
-
-  if( !doJES && !doJER ) return inputJet;
+// JER factor of an AK8 jet on top of its JES factor jes: scaling of the
+// matched jets only, corrFactor included
+double MiniAODHelper::GetAK8JERFactor(const pat::Jet& jet,
+				      const double jes,
+				      const edm::Handle<reco::GenJetCollection>& genjets,
+				      const GenJetIndex& genJetIndex,
+				      const Systematics::Type iSysType,
+				      const float corrFactor,
+				      const float uncFactor) {
 
-  CheckSetUp();
+  const double pt = jet.pt()*jes;
+  double jerSF = 1.;
+  const reco::GenJet* matched_genjet = MatchGenJet(pt, jet.eta(), jet.phi(), GetJERResolution(pt, jet.eta()), genjets, genJetIndex, 0.8);
+  if ( matched_genjet ) {
+    if( iSysType == Systematics::JERup ){
+      jerSF = getJERfactor(uncFactor, fabs(jet.eta()), matched_genjet->pt(), pt);
+    }
+    else if( iSysType == Systematics::JERdown ){
+      jerSF = getJERfactor(-uncFactor, fabs(jet.eta()), matched_genjet->pt(), pt);
+    }
+    else {
+      jerSF = getJERfactor(0, fabs(jet.eta()), matched_genjet->pt(), pt);
+    }
+  }
 
-  pat::Jet outputJet = inputJet;
+  return jerSF*corrFactor;
+}
 
-  /// JES
-  if( doJES ){
-    double scale = 1.;
 
-    if (corrector) {
-       scale = ak8corrector->correction(outputJet, event, setup);
-    } else {
-       edm::LogError("MiniAODHelper") << "Trying to use Full Framework GetCorrectedJets without setting jet corrector!";
+void MiniAODHelper::GetAK8JECUncertainties(const std::vector<float>& pt, const std::vector<float>& eta, const std::vector<Systematics::Type>& sysTypes, std::vector<float>& out) {
+  out.assign(pt.size()*sysTypes.size(), 0.);
+  for( unsigned int j=0; j<sysTypes.size(); ++j ){
+    if( sysTypes[j] != Systematics::JESup && sysTypes[j] != Systematics::JESdown ) continue;
+    for( unsigned int i=0; i<pt.size(); ++i ){
+      ak8jecUnc_->setJetEta(eta[i]);
+      ak8jecUnc_->setJetPt(pt[i]); // here you must use the CORRECTED jet pt
+      out[i*sysTypes.size()+j] = sysTypes[j] == Systematics::JESup ? ak8jecUnc_->getUncertainty(true) : -ak8jecUnc_->getUncertainty(false);
     }
+  }
+}
 
-    outputJet.scaleEnergy( scale*corrFactor );
 
-    if( iSysType == Systematics::JESup || iSysType == Systematics::JESdown ){
+// Reads the factors from the cached correction table, see GetJetCorrectionTable.
+// A table of these jets without iSysType gets its column; without a table of
+// these jets, one is filled for iSysType alone.
+std::vector<pat::Jet>
+MiniAODHelper::GetCorrectedJets(const std::vector<pat::Jet>& inputJets, const edm::Event& event, const edm::EventSetup& setup, const edm::Handle<reco::GenJetCollection>& genjets, const Systematics::Type iSysType, const bool& doJES, const bool& doJER, const float& corrFactor, const float& uncFactor){
 
-      ak8jecUnc_->setJetEta(outputJet.eta());
-      ak8jecUnc_->setJetPt(outputJet.pt()); // here you must use the CORRECTED jet pt
-      double unc = 1;
-      double jes = 1;
-      if( iSysType==Systematics::JESup ){
-	      unc = ak8jecUnc_->getUncertainty(true);
-	      jes = 1 + (unc*uncFactor);
-      }
-      else if( iSysType==Systematics::JESdown ){
-	      unc = ak8jecUnc_->getUncertainty(false);
-	      jes = 1 - (unc*uncFactor);
-      }
+  if( !doJES && !doJER ) return inputJets;
 
-      outputJet.scaleEnergy( jes );
-    }
-  }
+  CheckSetUp();
 
-  /// JER
-  if( doJER){
-    double jerSF = 1.;
-    reco::GenJet matched_genjet;
-    if ( GenJet_Match(outputJet, genjets, matched_genjet, 0.8) ) {
-    //if( outputJet.genJet() && deltaR(outputJet,*outputJet.genJet())<0.4/2 && jetdPtMatched(outputJet)){
-      if( iSysType == Systematics::JERup ){
-	      jerSF = getJERfactor(uncFactor, fabs(outputJet.eta()), matched_genjet.pt(), outputJet.pt());
-      }
-      else if( iSysType == Systematics::JERdown ){
-	      jerSF = getJERfactor(-uncFactor, fabs(outputJet.eta()), matched_genjet.pt(), outputJet.pt());
-      }
-      else {
-	      jerSF = getJERfactor(0, fabs(outputJet.eta()), matched_genjet.pt(), outputJet.pt());
-      }
-      // std::cout << "----->checking gen Jet pt " << jet.genJet()->pt() << ",  jerSF is" << jerSF << std::endl;
-    }
-    // else     std::cout << "    ==> can't find genJet" << std::endl;
+  const std::vector<Systematics::Type> sysTypes(JetCorrectionTable::varies(iSysType) ? 1 : 0, iSysType);
+  const JetCorrectionTable& table = FillCachedJetCorrectionTable(inputJets, event, setup, genjets, sysTypes, doJES, doJER, corrFactor, uncFactor);
 
-    outputJet.scaleEnergy( jerSF*corrFactor );
+  std::vector<pat::Jet> outputJets(inputJets);
+  for( unsigned int i=0; i<outputJets.size(); ++i ){
+    if( doJES && jetCorrectionUserFloats_ ) AddJetCorrectionUserFloats(outputJets[i], table.jes[i], setup); // see SetJetCorrectionUserFloats
+    outputJets[i].scaleEnergy( table.factor(i, iSysType) );
   }
 
-  return outputJet;
+  return outputJets;
 }
 
 
-float
-MiniAODHelper::GetAK8JetCorrectionFactor(const pat::Jet& inputJet, const edm::Event& event, const edm::EventSetup& setup, const edm::Handle<reco::GenJetCollection>& genjets, const Systematics::Type iSysType, const bool& doJES, const bool& doJER, const float& corrFactor, const float& uncFactor){
+// Corrections for all requested systematics in one pass over the jets. The
+// nominal JES is evaluated once per jet; each systematic then only costs its
+// uncertainty lookup and the JER factor at the varied pt. A factor multiplies
+// the input jet p4, and equals the one returned by GetJetCorrectionFactor.
+MiniAODHelper::JetCorrectionTable
+MiniAODHelper::GetJetCorrectionTable(const std::vector<pat::Jet>& inputJets, const edm::Event& event, const edm::EventSetup& setup, const edm::Handle<reco::GenJetCollection>& genjets, const std::vector<Systematics::Type>& sysTypes, const bool doJES, const bool doJER, const float corrFactor, const float uncFactor){
 
-  double factor = 1.;
+  const JetCorrectionTable& cached = FillCachedJetCorrectionTable(inputJets, event, setup, genjets, sysTypes, doJES, doJER, corrFactor, uncFactor);
 
-  if( !doJES && !doJER ) return factor;
+  // the columns of sysTypes, in their order
+  JetCorrectionTable table;
+  table.systematics = sysTypes;
+  table.jes = cached.jes;
+  table.nominalFactors = cached.nominalFactors;
+  table.nominalP4 = cached.nominalP4;
+  table.factors.resize(inputJets.size()*sysTypes.size());
+  for( unsigned int i=0; i<inputJets.size(); ++i ){
+    for( unsigned int j=0; j<sysTypes.size(); ++j ) table.factors[i*sysTypes.size()+j] = cached.factor(i, sysTypes[j]);
+  }
+
+  return table;
+}
+
+
+void MiniAODHelper::FillJetCorrectionTable(const std::vector<const pat::Jet*>& jets,
+					   const edm::Event& event,
+					   const edm::EventSetup& setup,
+					   const edm::Handle<reco::GenJetCollection>& genjets,
+					   const std::vector<Systematics::Type>& sysTypes,
+					   const bool doJES,
+					   const bool doJER,
+					   const float corrFactor,
+					   const float uncFactor,
+					   JetCorrectionTable& table,
+					   const JetChain chain) {
+
+  table.systematics = sysTypes;
+  const unsigned int nJets = jets.size();
+  const unsigned int nSys = sysTypes.size();
+  table.jes.assign(nJets, 1.);
+  table.nominalFactors.assign(nJets, 1.);
+  table.factors.assign(nJets*nSys, 1.);
+  table.nominalP4.clear();
+  table.nominalP4.reserve(nJets);
+
+  if( !doJES && !doJER ){
+    for( unsigned int i=0; i<nJets; ++i ) table.nominalP4.push_back(jets[i]->p4());
+    return;
+  }
 
   CheckSetUp();
 
-  pat::Jet outputJet = inputJet;
+  const bool ak8 = chain == JetChain::AK8;
+  const bool smear = doJER && (ak8 || !isData);
 
-  /// JES
+  // nominal JES, then the JEC uncertainties of all jets and sources in one call
+  std::vector<double> jecs(nJets, 1.);
+  std::vector<float> correctedPt(nJets), etas(nJets);
+  for( unsigned int i=0; i<nJets; ++i ){
+    const pat::Jet& jet = *jets[i];
+    if( doJES ){
+      table.jes[i] = GetNominalJES(jet, event, setup, chain);
+      jecs[i] = table.jes[i]*corrFactor;
+    }
+    correctedPt[i] = jet.pt()*jecs[i];
+    etas[i] = jet.eta();
+  }
+  std::vector<Systematics::Type> jecTypes;
+  std::vector<int> jecColumn(nSys, -1);
   if( doJES ){
-    double scale = 1.;
-
-    if (ak8corrector) {
-       scale = ak8corrector->correction(outputJet, event, setup);
-    } else {
-       edm::LogError("MiniAODHelper") << "Trying to use Full Framework GetCorrectedJets without setting jet corrector!";
+    for( unsigned int j=0; j<nSys; ++j ){
+      if( !Systematics::isJECUncertainty(sysTypes[j]) ) continue;
+      jecColumn[j] = jecTypes.size();
+      jecTypes.push_back(sysTypes[j]);
     }
+  }
+  std::vector<float> jecUnc;
+  if( ak8 ) GetAK8JECUncertainties(correctedPt, etas, jecTypes, jecUnc);
+  else      GetJECUncertainties(correctedPt, etas, setup, jecTypes, jecUnc);
+  const GenJetIndex& genJetIndex = GetGenJetIndex(event, genjets);
+
+  // JER factor on top of the JES factor f
+  auto jerFactor = [&](const pat::Jet& jet, const double f, const Systematics::Type iSysType) {
+    return ak8 ? GetAK8JERFactor(jet, f, genjets, genJetIndex, iSysType, corrFactor, uncFactor) : GetJERFactor(jet, f, event, genjets, genJetIndex, iSysType);
+  };
 
-    outputJet.scaleEnergy( scale*corrFactor );
-    factor *= scale*corrFactor;
+  for( unsigned int i=0; i<nJets; ++i ){
+    const pat::Jet& jet = *jets[i];
+    const double jec = jecs[i];
 
-    if( iSysType == Systematics::JESup || iSysType == Systematics::JESdown ){
+    const double nominal = smear ? jec*jerFactor(jet, jec, Systematics::NA) : jec;
+    table.nominalFactors[i] = nominal;
+    table.nominalP4.push_back(jet.p4()*nominal);
 
-      ak8jecUnc_->setJetEta(outputJet.eta());
-      ak8jecUnc_->setJetPt(outputJet.pt()); // here you must use the CORRECTED jet pt
-      double unc = 1;
-      double jes = 1;
-      if( iSysType==Systematics::JESup ){
-	      unc = ak8jecUnc_->getUncertainty(true);
-	      jes = 1 + (unc*uncFactor);
+    float* row = &table.factors[i*nSys];
+    for( unsigned int j=0; j<nSys; ++j ){
+      const Systematics::Type iSysType = sysTypes[j];
+      double f = jec;
+      if( jecColumn[j] >= 0 ) {
+	f *= 1. + jecUnc[i*jecTypes.size()+jecColumn[j]]*uncFactor;
       }
-      else if( iSysType==Systematics::JESdown ){
-	      unc = ak8jecUnc_->getUncertainty(false);
-	      jes = 1 - (unc*uncFactor);
+      else if( iSysType != Systematics::JERup && iSysType != Systematics::JERdown ) {
+	// neither JES nor JER variation: same as nominal
+	row[j] = nominal;
+	continue;
       }
-
-      outputJet.scaleEnergy( jes );
-      factor *= jes;
+      row[j] = smear ? f*jerFactor(jet, f, iSysType) : f;
     }
   }
+}
 
-  /// JER
-  if( doJER){
-    double jerSF = 1.;
-    reco::GenJet matched_genjet;
-    if ( GenJet_Match(outputJet, genjets, matched_genjet, 0.8) ) {
-    //if( outputJet.genJet() && deltaR(outputJet,*outputJet.genJet())<0.4/2 && jetdPtMatched(outputJet)){
-      if( iSysType == Systematics::JERup ){
-	      jerSF = getJERfactor(uncFactor, fabs(outputJet.eta()), matched_genjet.pt(), outputJet.pt());
-      }
-      else if( iSysType == Systematics::JERdown ){
-	      jerSF = getJERfactor(-uncFactor, fabs(outputJet.eta()), matched_genjet.pt(), outputJet.pt());
-      }
-      else {
-	      jerSF = getJERfactor(0, fabs(outputJet.eta()), matched_genjet.pt(), outputJet.pt());
-      }
-      // std::cout << "----->checking gen Jet pt " << jet.genJet()->pt() << ",  jerSF is" << jerSF << std::endl;
-    }
-    // else     std::cout << "    ==> can't find genJet" << std::endl;
 
-    outputJet.scaleEnergy( jerSF*corrFactor );
-    factor *= jerSF*corrFactor;
+const MiniAODHelper::JetCorrectionTable&
+MiniAODHelper::FillCachedJetCorrectionTable(const std::vector<pat::Jet>& inputJets, const edm::Event& event, const edm::EventSetup& setup, const edm::Handle<reco::GenJetCollection>& genjets, const std::vector<Systematics::Type>& sysTypes, const bool doJES, const bool doJER, const float corrFactor, const float uncFactor){
+
+  JetCorrectionCache& cache = jetCorrectionCache_;
+  if( cache.matches(event, genjets, corrector, doJES, doJER, corrFactor, uncFactor) && cache.holds(inputJets) ){
+    AddCachedJetCorrectionColumns(event, setup, genjets, sysTypes);
+    return cache.table;
   }
 
-  return factor;
-}
+  std::vector<const pat::Jet*> jets;
+  jets.reserve(inputJets.size());
+  for( const auto& jet: inputJets ) jets.push_back(&jet);
+  FillJetCorrectionTable(jets, event, setup, genjets, sysTypes, doJES, doJER, corrFactor, uncFactor, cache.table);
 
+  cache.event = event.id();
+  cache.jets = inputJets.empty() ? 0 : &inputJets[0];
+  cache.inputP4.clear();
+  for( const auto& jet: inputJets ) cache.inputP4.push_back(jet.p4());
+  cache.genjets = genjets.isValid() ? genjets.product() : 0;
+  cache.corrector = corrector;
+  cache.doJES = doJES;
+  cache.doJER = doJER;
+  cache.corrFactor = corrFactor;
+  cache.uncFactor = uncFactor;
 
-std::vector<pat::Jet>
-MiniAODHelper::GetCorrectedJets(const std::vector<pat::Jet>& inputJets, const edm::Event& event, const edm::EventSetup& setup, const edm::Handle<reco::GenJetCollection>& genjets, const Systematics::Type iSysType, const bool& doJES, const bool& doJER, const float& corrFactor, const float& uncFactor){
-
-  if( !doJES && !doJER ) return inputJets;
+  return cache.table;
+}
 
-  CheckSetUp();
 
-  std::vector<pat::Jet> outputJets;
+// Adds the systematics of sysTypes that the cached table lacks, for all its jets
+void MiniAODHelper::AddCachedJetCorrectionColumns(const edm::Event& event, const edm::EventSetup& setup, const edm::Handle<reco::GenJetCollection>& genjets, const std::vector<Systematics::Type>& sysTypes){
 
-  for( std::vector<pat::Jet>::const_iterator it = inputJets.begin(), ed = inputJets.end(); it != ed; ++it ){
-    outputJets.push_back(GetCorrectedJet(*it,event,setup, genjets, iSysType,doJES,doJER,corrFactor,uncFactor));
+  JetCorrectionCache& cache = jetCorrectionCache_;
+  std::vector<Systematics::Type> missing;
+  for( const auto iSysType: sysTypes ){
+    if( !cache.table.has(iSysType) && std::find(missing.begin(), missing.end(), iSysType) == missing.end() ) missing.push_back(iSysType);
   }
+  if( missing.empty() ) return;
 
-  return outputJets;
+  std::vector<const pat::Jet*> jets;
+  jets.reserve(cache.inputP4.size());
+  for( unsigned int i=0; i<cache.inputP4.size(); ++i ) jets.push_back(cache.jets+i);
+  JetCorrectionTable columns;
+  FillJetCorrectionTable(jets, event, setup, genjets, missing, cache.doJES, cache.doJER, cache.corrFactor, cache.uncFactor, columns);
+  cache.table.merge(columns);
 }
 
 
-// std::vector<pat::Jet>
-// MiniAODHelper::GetCorrectedJets(const std::vector<pat::Jet>& inputJets, const Systematics::Type iSysType ){
-
-//   CheckSetUp();
+void MiniAODHelper::JetCorrectionTable::merge(const JetCorrectionTable& other) {
+  std::vector<unsigned int> added;
+  for( unsigned int j=0; j<other.systematics.size(); ++j ){
+    if( !has(other.systematics[j]) ) added.push_back(j);
+  }
+  if( added.empty() ) return;
+
+  const unsigned int nJets = nominalFactors.size();
+  const unsigned int nSys = systematics.size();
+  const unsigned int nMerged = nSys+added.size();
+  std::vector<float> merged(nJets*nMerged);
+  for( unsigned int i=0; i<nJets; ++i ){
+    std::copy(factors.begin()+i*nSys, factors.begin()+(i+1)*nSys, merged.begin()+i*nMerged);
+    for( unsigned int k=0; k<added.size(); ++k ) merged[i*nMerged+nSys+k] = other.factor(i, added[k]);
+  }
+  factors.swap(merged);
+  for( const auto j: added ) systematics.push_back(other.systematics[j]);
+}
 
-//   std::vector<pat::Jet> outputJets;
 
-//   if( !(factorizedjetcorrectorIsSet && rhoIsSet) ){
-//    std::cout << " !! ERROR !! Trying to use FWLite Framework GetCorrectedJets without setting factorized jet corrector !" << std::endl;
+bool MiniAODHelper::JetCorrectionCache::holds(const std::vector<pat::Jet>& iJets) const {
+  if( iJets.size() != inputP4.size() || (iJets.empty() ? 0 : &iJets[0]) != jets ) return false;
+  for( unsigned int i=0; i<iJets.size(); ++i ){
+    if( iJets[i].p4() != inputP4[i] ) return false;
+  }
+  return true;
+}
 
-//      return inputJets;
-//   }
 
-//   for( std::vector<pat::Jet>::const_iterator it = inputJets.begin(), ed = inputJets.end(); it != ed; ++it ){
-//     pat::Jet jet = (*it);
-//     double scale = 1.;
+int MiniAODHelper::JetCorrectionCache::index(const pat::Jet& jet) const {
+  const std::less<const pat::Jet*> before;
+  if( before(&jet, jets) || !before(&jet, jets+inputP4.size()) ) return -1;
+  const unsigned int i = &jet-jets;
+  return jet.p4() == inputP4[i] ? int(i) : -1;
+}
 
-//     useJetCorrector->setJetEta(it->eta());
-//     useJetCorrector->setJetPt(it->pt());
-//     useJetCorrector->setJetA(it->jetArea());
-//     useJetCorrector->setRho(useRho);
 
-//     scale = useJetCorrector->getCorrection();
+// FWLite: JES of uncorrected jets (see GetUncorrectedJets) with a standalone
+// corrector and the rho given by SetRho, without the EventSetup. All jets are
+// corrected in one call.
+std::vector<pat::Jet>
+MiniAODHelper::GetCorrectedJets(const std::vector<pat::Jet>& inputJets, const StandaloneJetCorrector& jetCorrector){
 
-//     jet.scaleEnergy( scale );
+  CheckSetUp();
 
-//     if( iSysType == Systematics::JESup || iSysType == Systematics::JESdown ){
-//       jecUnc_->setJetEta(jet.eta());
-//       jecUnc_->setJetPt(jet.pt()); // here you must use the CORRECTED jet pt
-//       double unc = 1;
-//       double jes = 1;
-//       if( iSysType==Systematics::JESup ){
-// 	unc = jecUnc_->getUncertainty(true);
-// 	jes = 1 + unc;
-//       }
-//       else if( iSysType==Systematics::JESdown ){
-// 	unc = jecUnc_->getUncertainty(false);
-// 	jes = 1 - unc;
-//       }
+  if( !rhoIsSet ){
+    edm::LogError("MiniAODHelper") << "Trying to use FWLite GetCorrectedJets without setting rho!";
+    return inputJets;
+  }
 
-//       jet.scaleEnergy( jes );
-//     }
+  const unsigned int nJets = inputJets.size();
+  std::vector<float> pt(nJets), eta(nJets), area(nJets), scales;
+  for( unsigned int i=0; i<nJets; ++i ){
+    pt[i] = inputJets[i].pt();
+    eta[i] = inputJets[i].eta();
+    area[i] = inputJets[i].jetArea();
+  }
+  jetCorrector.corrections(pt, eta, area, useRho, scales);
 
-//     outputJets.push_back(jet);
-//   }
+  std::vector<pat::Jet> outputJets(inputJets);
+  for( unsigned int i=0; i<nJets; ++i ) outputJets[i].scaleEnergy( scales[i] );
 
-//   return outputJets;
-// }
+  return outputJets;
+}
 
 
 std::vector<boosted::BoostedJet>
@@ -788,44 +1133,82 @@ MiniAODHelper::GetCorrectedBoostedJets(const std::vector<boosted::BoostedJet>& i
 
   CheckSetUp();
 
-  std::vector<boosted::BoostedJet> outputBoostedJets;
+  std::vector<boosted::BoostedJet> outputBoostedJets(inputBoostedJets);
 
-  for( std::vector<boosted::BoostedJet>::const_iterator it = inputBoostedJets.begin(), ed = inputBoostedJets.end(); it != ed; ++it ){
-    boosted::BoostedJet outputBoostedJet = *it;
+  std::vector<boosted::BoostedJet*> boostedJets;
+  for( auto& boostedJet: outputBoostedJets ) boostedJets.push_back(&boostedJet);
+  CorrectBoostedJets(boostedJets,event,setup,genjets,iSysType,doJES,doJER,corrFactor,uncFactor);
 
-    outputBoostedJet.fatjet = GetCorrectedAK8Jet(outputBoostedJet.fatjet,event,setup,genjets,iSysType,doJES,false,corrFactor,uncFactor);
+  return outputBoostedJets;
+}
 
-    outputBoostedJet.nonW = GetCorrectedJet(outputBoostedJet.nonW,event,setup,genjets,iSysType,doJES,doJER,corrFactor,uncFactor);
-    outputBoostedJet.W1   = GetCorrectedJet(outputBoostedJet.W1  ,event,setup,genjets,iSysType,doJES,doJER,corrFactor,uncFactor);
-    outputBoostedJet.W2   = GetCorrectedJet(outputBoostedJet.W2  ,event,setup,genjets,iSysType,doJES,doJER,corrFactor,uncFactor);
 
-    outputBoostedJet.subjets    =  GetCorrectedJets(outputBoostedJet.subjets   ,event,setup,genjets,iSysType,doJES,doJER,corrFactor,uncFactor);
-    outputBoostedJet.filterjets =  GetCorrectedJets(outputBoostedJet.filterjets,event,setup,genjets,iSysType,doJES,doJER,corrFactor,uncFactor);
+void
+MiniAODHelper::CorrectBoostedJet(boosted::BoostedJet& boostedJet, const edm::Event& event, const edm::EventSetup& setup, const edm::Handle<reco::GenJetCollection>& genjets, const Systematics::Type iSysType, const bool doJES, const bool doJER, const float corrFactor, const float uncFactor){
 
-    outputBoostedJet.topjet.setP4(outputBoostedJet.nonW.p4()+outputBoostedJet.W1.p4()+outputBoostedJet.W2.p4());
+  const std::vector<boosted::BoostedJet*> boostedJets(1, &boostedJet);
+  CorrectBoostedJets(boostedJets,event,setup,genjets,iSysType,doJES,doJER,corrFactor,uncFactor);
+}
+
+
+// Corrects the fat jets (AK8 chain, JES only) and all their AK4 constituents
+// in place, with one correction table for the fat jets and one for the
+// constituents. The pruned mass is scaled with the factor of the fat jet, and
+// the top jet and fRec are rebuilt from the corrected constituents.
+void
+MiniAODHelper::CorrectBoostedJets(const std::vector<boosted::BoostedJet*>& boostedJets, const edm::Event& event, const edm::EventSetup& setup, const edm::Handle<reco::GenJetCollection>& genjets, const Systematics::Type iSysType, const bool doJES, const bool doJER, const float corrFactor, const float uncFactor){
+
+  if( !doJES && !doJER ) return;
+
+  CheckSetUp();
+
+  const std::vector<Systematics::Type> sysTypes(JetCorrectionTable::varies(iSysType) ? 1 : 0, iSysType);
+  JetCorrectionTable table;
+
+  std::vector<const pat::Jet*> fatjets;
+  for( auto boostedJet: boostedJets ) fatjets.push_back(&boostedJet->fatjet);
+  FillJetCorrectionTable(fatjets,event,setup,genjets,sysTypes,doJES,false,corrFactor,uncFactor,table,JetChain::AK8);
+  for( unsigned int i=0; i<boostedJets.size(); ++i ){
+    const double fatFactor = table.factor(i, iSysType);
+    boostedJets[i]->fatjet.scaleEnergy( fatFactor );
 
     // Correction of pruned mass
-    outputBoostedJet.prunedMass = outputBoostedJet.prunedMass * GetAK8JetCorrectionFactor(outputBoostedJet.fatjet,event,setup,genjets,iSysType,doJES,false,corrFactor,uncFactor);
+    boostedJets[i]->prunedMass = boostedJets[i]->prunedMass * fatFactor;
+  }
+
+  std::vector<pat::Jet*> constituents;
+  for( auto boostedJet: boostedJets ){
+    constituents.push_back(&boostedJet->nonW);
+    constituents.push_back(&boostedJet->W1);
+    constituents.push_back(&boostedJet->W2);
+    for( auto& subjet: boostedJet->subjets ) constituents.push_back(&subjet);
+    for( auto& filterjet: boostedJet->filterjets ) constituents.push_back(&filterjet);
+  }
+  const std::vector<const pat::Jet*> jets(constituents.begin(), constituents.end());
+  FillJetCorrectionTable(jets,event,setup,genjets,sysTypes,doJES,doJER,corrFactor,uncFactor,table);
+  for( unsigned int i=0; i<constituents.size(); ++i ){
+    if( doJES && jetCorrectionUserFloats_ ) AddJetCorrectionUserFloats(*constituents[i], table.jes[i], setup); // see SetJetCorrectionUserFloats
+    constituents[i]->scaleEnergy( table.factor(i, iSysType) );
+  }
+
+  for( auto boostedJet: boostedJets ){
+    boostedJet->topjet.setP4(boostedJet->nonW.p4()+boostedJet->W1.p4()+boostedJet->W2.p4());
 
     // Recalculation of fRec
     double _mtmass = 172.3;
     double _mwmass = 80.4;
 
-    double mbw1 = (outputBoostedJet.nonW.p4() + outputBoostedJet.W1.p4()).M();
-    double mbw2 = (outputBoostedJet.nonW.p4() + outputBoostedJet.W2.p4()).M();
-    double mw   = (outputBoostedJet.W1.p4()   + outputBoostedJet.W2.p4()).M();
-    double mtop = (outputBoostedJet.nonW.p4() + outputBoostedJet.W1.p4() + outputBoostedJet.W2.p4()).M();
+    double mbw1 = (boostedJet->nonW.p4() + boostedJet->W1.p4()).M();
+    double mbw2 = (boostedJet->nonW.p4() + boostedJet->W2.p4()).M();
+    double mw   = (boostedJet->W1.p4()   + boostedJet->W2.p4()).M();
+    double mtop = (boostedJet->nonW.p4() + boostedJet->W1.p4() + boostedJet->W2.p4()).M();
 
     double fwbw1 = fabs( (mbw1/mtop) / (_mwmass/_mtmass) - 1);
     double fwbw2 = fabs( (mbw2/mtop) / (_mwmass/_mtmass) - 1);
     double fww   = fabs( (mw/mtop) / (_mwmass/_mtmass) - 1);
 
-    outputBoostedJet.fRec = std::min(fww, std::min(fwbw1, fwbw2));
-
-    outputBoostedJets.push_back(outputBoostedJet);
+    boostedJet->fRec = std::min(fww, std::min(fwbw1, fwbw2));
   }
-
-  return outputBoostedJets;
 }
 
 
@@ -985,67 +1368,48 @@ MiniAODHelper::isGoodMuon(const pat::Muon& iMuon, const float iMinPt, const floa
 
   CheckVertexSetUp();
 
-  double minMuonPt = iMinPt;
-
-  double maxMuonEta = iMaxEta;
-
-
-  // Be skeptical about this muon making it through
-  bool passesKinematics	= false;
-  bool passesIso        = false;
-  bool passesID         = false;
-  bool isPFMuon         = false;
-  bool passesTrackerID  = false;
-
-  bool passesGlobalTrackID   = false;
-  bool passesMuonBestTrackID = false;
-  bool passesInnerTrackID    = false;
-  bool passesTrackID         = false;
-
-
-  switch(iMuonID){
-  case muonID::muonPreselection:
-    // see https://github.com/cms-ttH/ttH-LeptonID for adding multilepton
-    // selection userFloats
-    passesKinematics = ((iMuon.pt() >= minMuonPt) && (fabs(iMuon.eta()) <= maxMuonEta));
-    passesIso = true;
-    passesID = iMuon.userFloat("idPreselection") > .5;
-    break;
-  case muonID::muonLooseMvaBased:
-    passesKinematics = ((iMuon.pt() >= minMuonPt) && (fabs(iMuon.eta()) <= maxMuonEta));
-    passesIso = true;
-    passesID = iMuon.userFloat("idLooseMVA") > .5;
-    break;
-  case muonID::muonTightMvaBased:
-    passesKinematics = ((iMuon.pt() >= minMuonPt) && (fabs(iMuon.eta()) <= maxMuonEta));
-    passesIso = true;
-    passesID = iMuon.userFloat("idTightMVA") > .5;
-    break;
-  case muonID::muonLooseCutBased:
-    passesKinematics = ((iMuon.pt() >= minMuonPt) && (fabs(iMuon.eta()) <= maxMuonEta));
-    passesIso = true;
-    passesID = iMuon.userFloat("idLooseCut") > .5;
-    break;
-  case muonID::muonTightCutBased:
-    passesKinematics = ((iMuon.pt() >= minMuonPt) && (fabs(iMuon.eta()) <= maxMuonEta));
-    passesIso = true;
-    passesID = iMuon.userFloat("idTightCut") > .5;
-    break;
-  case muonID::muonSide:
-  case muonID::muonSideLooseMVA:
-  case muonID::muonSideTightMVA:
-  case muonID::muonFakeable:
-  case muonID::muonPtOnly:
-  case muonID::muonPtEtaOnly:
-  case muonID::muonPtEtaIsoOnly:
-  case muonID::muonPtEtaIsoTrackerOnly:
-  case muonID::muonRaw:
-  case muonID::muonCutBased:
-  case muonID::muon2lss:
-  case muonID::muonLoose:
-    passesKinematics = ((iMuon.pt() >= minMuonPt) && (fabs(iMuon.eta()) <= maxMuonEta));
-    passesIso        = (GetMuonRelIso(iMuon,iconeSize,icorrType) < 0.200);
-    isPFMuon         = iMuon.isPFMuon();
+  const bool passesKinematics = ((iMuon.pt() >= iMinPt) && (fabs(iMuon.eta()) <= iMaxEta));
+  if( !passesKinematics ) return false;
+
+  return EvaluateMuonIDs(iMuon, leptonIDMask::bit(iMuonID), iconeSize, icorrType) != 0;
+}
+
+
+uint64_t
+MiniAODHelper::EvaluateMuonIDs(const pat::Muon& iMuon, const uint64_t ids, const coneSize::coneSize iconeSize, const corrType::corrType icorrType){
+
+  CheckVertexSetUp();
+
+  using leptonIDMask::bit;
+  uint64_t mask = 0;
+
+  // see https://github.com/cms-ttH/ttH-LeptonID for adding multilepton
+  // selection userFloats
+  static const std::pair<muonID::muonID,const char*> userFloatIDs[] = {
+    { muonID::muonPreselection,   "idPreselection" },
+    { muonID::muonLooseMvaBased,  "idLooseMVA" },
+    { muonID::muonTightMvaBased,  "idTightMVA" },
+    { muonID::muonLooseCutBased,  "idLooseCut" },
+    { muonID::muonTightCutBased,  "idTightCut" }
+  };
+  for( const auto& userFloatID: userFloatIDs ){
+    if( (ids & bit(userFloatID.first)) && iMuon.userFloat(userFloatID.second) > .5 ) mask |= bit(userFloatID.first);
+  }
+
+  const uint64_t looseIDs = bit(muonID::muonSide) | bit(muonID::muonSideLooseMVA) | bit(muonID::muonSideTightMVA) | bit(muonID::muonFakeable)
+    | bit(muonID::muonPtOnly) | bit(muonID::muonPtEtaOnly) | bit(muonID::muonPtEtaIsoOnly) | bit(muonID::muonPtEtaIsoTrackerOnly)
+    | bit(muonID::muonRaw) | bit(muonID::muonCutBased) | bit(muonID::muon2lss) | bit(muonID::muonLoose);
+  const uint64_t tightIDs = bit(muonID::muonTight) | bit(muonID::muonTightDL);
+  if( !(ids & (looseIDs | tightIDs | bit(muonID::muonMediumICHEP))) ) return mask;
+
+  // same isolation for all remaining IDs
+  const float relIso = GetMuonRelIso(iMuon,iconeSize,icorrType);
+
+  if( (ids & looseIDs) && relIso < 0.200 ){
+    bool passesGlobalTrackID   = false;
+    bool passesMuonBestTrackID = false;
+    bool passesInnerTrackID    = false;
+    bool passesTrackID         = false;
 
     if( iMuon.globalTrack().isAvailable() ){
       passesGlobalTrackID = ( (iMuon.globalTrack()->normalizedChi2() < 10.)
@@ -1062,31 +1426,33 @@ MiniAODHelper::isGoodMuon(const pat::Muon& iMuon, const float iMinPt, const floa
     if( iMuon.track().isAvailable() )
       passesTrackID = (iMuon.track()->hitPattern().trackerLayersWithMeasurement() > 5);
 
-    passesTrackerID = ( passesGlobalTrackID && passesMuonBestTrackID && passesInnerTrackID && passesTrackID && (iMuon.numberOfMatchedStations() > 1) );
+    const bool passesTrackerID = ( passesGlobalTrackID && passesMuonBestTrackID && passesInnerTrackID && passesTrackID && (iMuon.numberOfMatchedStations() > 1) );
 
-    passesID        = (iMuon.isGlobalMuon() && isPFMuon && passesTrackerID);
+    if( iMuon.isGlobalMuon() && iMuon.isPFMuon() && passesTrackerID ) mask |= ids & looseIDs;
+  }
 
-    break;
-  case muonID::muonTight:
-      passesKinematics = ((iMuon.pt() >= minMuonPt) && (fabs(iMuon.eta()) <= maxMuonEta));
-      passesIso        = (GetMuonRelIso(iMuon,iconeSize,icorrType) < 0.15);
-      passesID         = passesMuonPOGIdTight(iMuon);
-      break;
-  case muonID::muonTightDL:
-      passesKinematics = ((iMuon.pt() >= minMuonPt) && (fabs(iMuon.eta()) <= maxMuonEta));
-      passesIso        = (GetMuonRelIso(iMuon,iconeSize,icorrType) < 0.25);
-      passesID         = passesMuonPOGIdTight(iMuon);
-      break;
+  if( (ids & tightIDs) && relIso < 0.25 && passesMuonPOGIdTight(iMuon) ){
+    if( relIso < 0.15 ) mask |= ids & bit(muonID::muonTight);
+    mask |= ids & bit(muonID::muonTightDL);
+  }
 
-  case muonID::muonMediumICHEP:
-      passesKinematics = ((iMuon.pt() >= minMuonPt) && (fabs(iMuon.eta()) <= maxMuonEta));
-      passesIso        = (GetMuonRelIso(iMuon,iconeSize,icorrType) < 0.15);
-      passesID         = passesMuonPOGIdICHEPMedium(iMuon);
-      break;
+  if( (ids & bit(muonID::muonMediumICHEP)) && relIso < 0.15 && passesMuonPOGIdICHEPMedium(iMuon) ) mask |= bit(muonID::muonMediumICHEP);
+
+  return mask;
+}
+
+
+std::vector<uint64_t>
+MiniAODHelper::EvaluateMuonIDs(const std::vector<pat::Muon>& inputMuons, const uint64_t ids, const coneSize::coneSize iconeSize, const corrType::corrType icorrType){
 
+  std::vector<uint64_t> masks;
+  masks.reserve(inputMuons.size());
+
+  for( std::vector<pat::Muon>::const_iterator it = inputMuons.begin(), ed = inputMuons.end(); it != ed; ++it ){
+    masks.push_back(EvaluateMuonIDs(*it, ids, iconeSize, icorrType));
   }
 
-  return (passesKinematics && passesIso && passesID);
+  return masks;
 }
 
 
@@ -1096,170 +1462,111 @@ MiniAODHelper::isGoodElectron(const pat::Electron& iElectron, const float iMinPt
 
   CheckVertexSetUp();
 
-  double minElectronPt = iMinPt;
-
-  float maxElectronEta = iMaxEta;
-
-
-  // Be skeptical about this electron making it through
-  bool passesKinematics	= false;
-  bool passesIso        = false;
-  bool passesID         = false;
-
-  double SCeta = (iElectron.superCluster().isAvailable()) ? iElectron.superCluster()->position().eta() : -99;
-  double absSCeta = fabs(SCeta);
-
-  bool inCrack = false;
-  if( iElectron.superCluster().isAvailable() ) inCrack = ( absSCeta>1.4442 && absSCeta<1.5660 );
-
-
-  bool myTrigPresel = true;
-
-  //double eleID      = iElectron.electronID("eidTight");
-  bool passMVAId53x = true;//( eleID>0.5 );  // For 2012_53x, tighter selection
-
-  bool d02 = false;
-  bool d04 = false;
-  bool dZ  = false;
-  bool no_exp_inner_trkr_hits = true; //false; // see below
-  if( iElectron.gsfTrack().isAvailable() ){
-    d02 = ( fabs(iElectron.gsfTrack()->dxy(vertex.position())) < 0.02 );
-    d04 = ( fabs(iElectron.gsfTrack()->dxy(vertex.position())) < 0.04 );
-    //no_exp_inner_trkr_hits = ( iElectron.gsfTrack()->trackerExpectedHitsInner().numberOfHits() <= 0 ); // deprecated in 7_2_0 .. replace with ..?
-    dZ = ( fabs(iElectron.gsfTrack()->dz(vertex.position())) < 1. );
-  }
-
-
-  bool notConv = ( iElectron.passConversionVeto() );
-  bool id      = ( passMVAId53x && d02 && dZ && notConv );
-
-
-  switch(iElectronID){
-  case electronID::electronPreselection:
-    // see https://github.com/cms-ttH/ttH-LeptonID for adding multilepton
-    // selection userFloats
-    passesKinematics = ((iElectron.pt() >= minElectronPt) && (fabs(iElectron.eta()) <= maxElectronEta) && !inCrack);
-    passesIso = true;
-    passesID = iElectron.userFloat("idPreselection") > .5;
-    break;
-  case electronID::electronLooseCutBased:
-    passesKinematics = ((iElectron.pt() >= minElectronPt) && (fabs(iElectron.eta()) <= maxElectronEta) && !inCrack);
-    passesIso = true;
-    passesID = iElectron.userFloat("idLooseCut") > .5;
-    break;
-  case electronID::electronTightCutBased:
-    passesKinematics = ((iElectron.pt() >= minElectronPt) && (fabs(iElectron.eta()) <= maxElectronEta) && !inCrack);
-    passesIso = true;
-    passesID = iElectron.userFloat("idTightCut") > .5;
-    break;
-  case electronID::electronLooseMvaBased:
-    passesKinematics = ((iElectron.pt() >= minElectronPt) && (fabs(iElectron.eta()) <= maxElectronEta) && !inCrack);
-    passesIso = true;
-    passesID = iElectron.userFloat("idLooseMVA") > .5;
-    break;
-  case electronID::electronTightMvaBased:
-    passesKinematics = ((iElectron.pt() >= minElectronPt) && (fabs(iElectron.eta()) <= maxElectronEta) && !inCrack);
-    passesIso = true;
-    passesID = iElectron.userFloat("idTightMVA") > .5;
-    break;
-  case electronID::electronSide:
-  case electronID::electronSideLooseMVA:
-  case electronID::electronSideTightMVA:
-  case electronID::electronFakeable:
-  case electronID::electronLooseMinusTrigPresel:
-  case electronID::electronRaw:
-  case electronID::electronCutBased:
-  case electronID::electron2lss:
-  case electronID::electronLoose:
-    passesKinematics = ((iElectron.pt() >= minElectronPt) && (fabs(iElectron.eta()) <= maxElectronEta) && !inCrack);
-    passesIso        = (GetElectronRelIso(iElectron) < 0.200);
-    passesID         = ( passMVAId53x && no_exp_inner_trkr_hits && d04 && notConv && myTrigPresel );
-    break;
-  case electronID::electronTightMinusTrigPresel:
-  case electronID::electronTight:
-    passesKinematics = ((iElectron.pt() >= minElectronPt) && (fabs(iElectron.eta()) <= maxElectronEta) && !inCrack);
-    passesIso        = (GetElectronRelIso(iElectron) < 0.100);
-    passesID         = ( id && no_exp_inner_trkr_hits && myTrigPresel );
-    break;
-  case electronID::electronPhys14L:
-  case electronID::electronPhys14M:
-  case electronID::electronPhys14T:
-    id = PassElectronPhys14Id( iElectron, iElectronID );
-    passesIso = id;
-    passesID = id;
-    passesKinematics = ((iElectron.pt() >= minElectronPt) && (fabs(iElectron.eta()) <= maxElectronEta) && !inCrack);
-    break;
-  case electronID::electronSpring15Veto:
-  case electronID::electronSpring15L:
-  case electronID::electronSpring15M:
-  case electronID::electronSpring15T:
-    id = PassElectronSpring15Id( iElectron, iElectronID );
-    passesIso = id;
-    passesID = id;
-    passesKinematics = ((iElectron.pt() >= minElectronPt) && (fabs(iElectron.eta()) <= maxElectronEta) && !inCrack);
-    break;
-  case electronID::electronEndOf15MVA80:
-    passesID = PassesMVAid80(iElectron);
-    passesKinematics = ((iElectron.pt() >= minElectronPt) && (fabs(iElectron.eta()) <= maxElectronEta) && !inCrack);
-    passesIso = true; // TODO: what is the correct isolation here?
-    break;
-  case electronID::electronEndOf15MVA90:
-    passesID = PassesMVAid90(iElectron);
-    passesKinematics = ((iElectron.pt() >= minElectronPt) && (fabs(iElectron.eta()) <= maxElectronEta) && !inCrack);
-    passesIso = true; // TODO: what is the correct isolation here?
-    break;
-  case electronID::electronEndOf15MVA80iso0p1:
-    passesID = PassesMVAid80(iElectron);
-    passesKinematics = ((iElectron.pt() >= minElectronPt) && (fabs(iElectron.eta()) <= maxElectronEta) && !inCrack);
-    passesIso=0.1>=GetElectronRelIso(iElectron, coneSize::R03, corrType::rhoEA,effAreaType::spring15);
-    break;
-  case electronID::electronEndOf15MVA90iso0p1:
-    passesID = PassesMVAid90(iElectron);
-    passesKinematics = ((iElectron.pt() >= minElectronPt) && (fabs(iElectron.eta()) <= maxElectronEta) && !inCrack);
-    passesIso=0.1>=GetElectronRelIso(iElectron, coneSize::R03, corrType::rhoEA,effAreaType::spring15);
-    break;
-  case electronID::electronEndOf15MVA80iso0p15:
-    passesID = PassesMVAid80(iElectron);
-    passesKinematics = ((iElectron.pt() >= minElectronPt) && (fabs(iElectron.eta()) <= maxElectronEta) && !inCrack);
-    passesIso=0.15>=GetElectronRelIso(iElectron, coneSize::R03, corrType::rhoEA,effAreaType::spring15);
-    break;
-  case electronID::electronEndOf15MVA90iso0p15:
-    passesID = PassesMVAid90(iElectron);
-    passesKinematics = ((iElectron.pt() >= minElectronPt) && (fabs(iElectron.eta()) <= maxElectronEta) && !inCrack);
-    passesIso=0.15>=GetElectronRelIso(iElectron, coneSize::R03, corrType::rhoEA,effAreaType::spring15);
-    break;
-
-  case electronID::electron80XCutBasedL:
-  case electronID::electron80XCutBasedM:
-  case electronID::electron80XCutBasedT:
-    passesID = PassElectron80XId(iElectron,iElectronID);
-    passesKinematics = ((iElectron.pt() >= minElectronPt) && (fabs(iElectron.eta()) <= maxElectronEta) && !inCrack);
-    passesIso=0.15>=GetElectronRelIso(iElectron, coneSize::R03, corrType::rhoEA,effAreaType::spring16);
-    break;
-  case electronID::electronNonTrigMVAid80:
-    passesID = PassesNonTrigMVAid80(iElectron);
-    passesKinematics = ((iElectron.pt() >= minElectronPt) && (fabs(iElectron.eta()) <= maxElectronEta) && !inCrack);
-    passesIso = 0.15>=GetElectronRelIso(iElectron, coneSize::R03, corrType::rhoEA,effAreaType::spring15);
-    break;
-  case electronID::electronNonTrigMVAid90:
-    passesID = PassesNonTrigMVAid90(iElectron);
-    passesKinematics = ((iElectron.pt() >= minElectronPt) && (fabs(iElectron.eta()) <= maxElectronEta) && !inCrack);
-    passesIso = 0.15>=GetElectronRelIso(iElectron, coneSize::R03, corrType::rhoEA,effAreaType::spring15);
-    break;
-  case electronID::electronGeneralPurposeMVA2016WP80:
-    passesID = PassesGeneralPurposeMVA2016WP80(iElectron);
-    passesKinematics = ((iElectron.pt() >= minElectronPt) && (fabs(iElectron.eta()) <= maxElectronEta) && !inCrack);
-    passesIso = 0.15>=GetElectronRelIso(iElectron, coneSize::R03, corrType::rhoEA,effAreaType::spring16);
-    break;
-  case electronID::electronGeneralPurposeMVA2016WP90:
-    passesID = PassesGeneralPurposeMVA2016WP90(iElectron);
-    passesKinematics = ((iElectron.pt() >= minElectronPt) && (fabs(iElectron.eta()) <= maxElectronEta) && !inCrack);
-    passesIso = 0.15>=GetElectronRelIso(iElectron, coneSize::R03, corrType::rhoEA,effAreaType::spring16);
-    break;
-
-  }
-
-  return (passesKinematics && passesIso && passesID);
+  const bool passesKinematics = ((iElectron.pt() >= iMinPt) && (fabs(iElectron.eta()) <= iMaxEta));
+  if( !passesKinematics ) return false;
+
+  return EvaluateElectronIDs(iElectron, leptonIDMask::bit(iElectronID)) != 0;
+}
+
+
+uint64_t
+MiniAODHelper::EvaluateElectronIDs(const pat::Electron& iElectron, const uint64_t ids){
+
+  CheckVertexSetUp();
+
+  using leptonIDMask::bit;
+  uint64_t mask = 0;
+
+  // no electron in the barrel-endcap transition passes any ID
+  if( InElectronCrack(iElectron) ) return mask;
+
+  // see https://github.com/cms-ttH/ttH-LeptonID for adding multilepton
+  // selection userFloats
+  static const std::pair<electronID::electronID,const char*> userFloatIDs[] = {
+    { electronID::electronPreselection,   "idPreselection" },
+    { electronID::electronLooseCutBased,  "idLooseCut" },
+    { electronID::electronTightCutBased,  "idTightCut" },
+    { electronID::electronLooseMvaBased,  "idLooseMVA" },
+    { electronID::electronTightMvaBased,  "idTightMVA" }
+  };
+  for( const auto& userFloatID: userFloatIDs ){
+    if( (ids & bit(userFloatID.first)) && iElectron.userFloat(userFloatID.second) > .5 ) mask |= bit(userFloatID.first);
+  }
+
+  // The 53x MVA ID, the expected inner hits and the trigger preselection of
+  // these IDs are no longer applied (see the history of this function)
+  const uint64_t looseIDs = bit(electronID::electronSide) | bit(electronID::electronSideLooseMVA) | bit(electronID::electronSideTightMVA)
+    | bit(electronID::electronFakeable) | bit(electronID::electronLooseMinusTrigPresel) | bit(electronID::electronRaw)
+    | bit(electronID::electronCutBased) | bit(electronID::electron2lss) | bit(electronID::electronLoose);
+  const uint64_t tightIDs = bit(electronID::electronTightMinusTrigPresel) | bit(electronID::electronTight);
+  if( ids & (looseIDs | tightIDs) ){
+    bool d02 = false;
+    bool d04 = false;
+    bool dZ  = false;
+    if( iElectron.gsfTrack().isAvailable() ){
+      const double d0 = fabs(iElectron.gsfTrack()->dxy(vertex.position()));
+      d02 = ( d0 < 0.02 );
+      d04 = ( d0 < 0.04 );
+      dZ = ( fabs(iElectron.gsfTrack()->dz(vertex.position())) < 1. );
+    }
+    const bool notConv = ( iElectron.passConversionVeto() );
+    const float relIso = GetElectronRelIso(iElectron);
+
+    if( relIso < 0.200 && d04 && notConv ) mask |= ids & looseIDs;
+    if( relIso < 0.100 && d02 && dZ && notConv ) mask |= ids & tightIDs;
+  }
+
+  // cut-based IDs of the campaigns, including their isolation (the 80X
+  // isolation cuts are all tighter than 0.15)
+  if( ids & ElectronCutTableIDs() ) EvaluateElectronCutTables(std::vector<const pat::Electron*>(1, &iElectron), ids, &mask);
+
+  // MVA IDs, from the values that GetElectronsWithMVAid stores as user floats
+  if( ids & ElectronMVAidIDs() ){
+    if( !iElectron.hasUserFloat("mvaValue") || !iElectron.hasUserInt("mvaCategory") ){
+      std::cout << "mvaValue or category not set, run MiniAODHelper::AddMVAidToElectrons first" << std::endl;
+    }
+    else{
+      const ElectronMVAid mvaID = { 0, iElectron.userFloat("mvaValue"), iElectron.userInt("mvaCategory") };
+      mask |= EvaluateElectronMVAid(iElectron, mvaID, ids);
+    }
+  }
+
+  return mask;
+}
+
+
+bool
+MiniAODHelper::InElectronCrack(const pat::Electron& iElectron){
+  if( !iElectron.superCluster().isAvailable() ) return false;
+  const double absSCeta = fabs(iElectron.superCluster()->position().eta());
+  return ( absSCeta>1.4442 && absSCeta<1.5660 );
+}
+
+
+std::vector<uint64_t>
+MiniAODHelper::EvaluateElectronIDs(const std::vector<pat::Electron>& inputElectrons, const uint64_t ids){
+
+  const uint64_t cutTableIDs = ids & ElectronCutTableIDs();
+
+  std::vector<uint64_t> masks;
+  masks.reserve(inputElectrons.size());
+  std::vector<const pat::Electron*> cutTableElectrons;
+  std::vector<unsigned int> cutTableIndices;
+
+  for( unsigned int i=0; i<inputElectrons.size(); ++i ){
+    masks.push_back(EvaluateElectronIDs(inputElectrons[i], ids & ~cutTableIDs));
+    if( cutTableIDs && !InElectronCrack(inputElectrons[i]) ){
+      cutTableElectrons.push_back(&inputElectrons[i]);
+      cutTableIndices.push_back(i);
+    }
+  }
+
+  // cut-based IDs of the campaigns for all electrons at once
+  std::vector<uint64_t> cutTableMasks(cutTableElectrons.size(), 0);
+  EvaluateElectronCutTables(cutTableElectrons, cutTableIDs, cutTableMasks.data());
+  for( unsigned int k=0; k<cutTableIndices.size(); ++k ) masks[cutTableIndices[k]] |= cutTableMasks[k];
+
+  return masks;
 }
 
 bool
@@ -1267,8 +1574,18 @@ MiniAODHelper::isGoodTau(const pat::Tau& tau, const float min_pt, const tau::ID
 {
   CheckVertexSetUp();
 
+  for( auto& index: tauIDIndices_ ) index.resolve(tau);
+
+  return PassesTauSelection(tau, min_pt, id);
+}
+
+bool
+MiniAODHelper::PassesTauSelection(const pat::Tau& tau, const float min_pt, const tau::ID id) const
+{
+  const std::vector<TauIDIndex>& tauID = tauIDIndices_;
+
   bool passesIsolation = false;
-  bool passesID = tau.tauID("decayModeFindingNewDMs") >= .5;
+  bool passesID = tauID[tauDecayModeFindingNewDMs](tau) >= .5;
 
   if (!tau.leadChargedHadrCand().isAvailable())
      return false;
@@ -1288,27 +1605,27 @@ MiniAODHelper::isGoodTau(const pat::Tau& tau, const float min_pt, const tau::ID
   switch (id) {
      case tau::nonIso:
         passesID = passesID and \
-                   tau.tauID("againstMuonLoose3") >= .5 and \
-                   tau.tauID("againstElectronVLooseMVA6") >= .5;
+                   tauID[tauAgainstMuonLoose3](tau) >= .5 and \
+                   tauID[tauAgainstElectronVLooseMVA6](tau) >= .5;
         passesIsolation = true;
         break;
      case tau::loose:
         passesID = passesID and \
-                   tau.tauID("againstMuonLoose3") >= .5 and \
-                   tau.tauID("againstElectronVLooseMVA6") >= .5;
-        passesIsolation = tau.tauID("byLooseCombinedIsolationDeltaBetaCorr3Hits") >= .5;
+                   tauID[tauAgainstMuonLoose3](tau) >= .5 and \
+                   tauID[tauAgainstElectronVLooseMVA6](tau) >= .5;
+        passesIsolation = tauID[tauByLooseIsolation](tau) >= .5;
         break;
      case tau::medium:
         passesID = passesID and \
-                   tau.tauID("againstMuonLoose3") >= .5 and \
-                   tau.tauID("againstElectronLooseMVA6") >= .5;
-        passesIsolation = tau.tauID("byMediumCombinedIsolationDeltaBetaCorr3Hits") >= .5;
+                   tauID[tauAgainstMuonLoose3](tau) >= .5 and \
+                   tauID[tauAgainstElectronLooseMVA6](tau) >= .5;
+        passesIsolation = tauID[tauByMediumIsolation](tau) >= .5;
         break;
      case tau::tight:
         passesID = passesID and \
-                   tau.tauID("againstMuonTight3") >= .5 and \
-                   tau.tauID("againstElectronMediumMVA6") >= .5;
-        passesIsolation = tau.tauID("byTightCombinedIsolationDeltaBetaCorr3Hits") >= .5;
+                   tauID[tauAgainstMuonTight3](tau) >= .5 and \
+                   tauID[tauAgainstElectronMediumMVA6](tau) >= .5;
+        passesIsolation = tauID[tauByTightIsolation](tau) >= .5;
         break;
   }
 
@@ -1326,76 +1643,154 @@ MiniAODHelper::isGoodJet(const pat::Jet& iJet, const float iMinPt, const float i
   // Absolute eta requirement
   if( fabs(iJet.eta()) > iMaxAbsEta ) return false;
 
-  // Jet ID
-  bool loose = false;
+  if( !PassesJetID(iJet, iJet.eta(), iJetID) ) return false;
+
+  if( !PassesCSV(iJet, iCSVworkingPoint) ) return false;
+
+  return true;
+}
+
+// Selection of a jet view; the jet ID is evaluated on the source jet
+bool
+MiniAODHelper::isGoodJet(const CorrectedJetView& iView, const pat::Jet& iSourceJet, const float iMinPt, const float iMaxAbsEta, const jetID::jetID iJetID, const char iCSVworkingPoint){
+
+  if( iView.pt < iMinPt ) return false;
+
+  if( fabs(iView.eta) > iMaxAbsEta ) return false;
+
+  if( !PassesJetID(iSourceJet, iView.eta, iJetID) ) return false;
+
+  if( !PassesCSV(iView.csv, iCSVworkingPoint) ) return false;
+
+  return true;
+}
+
+// Jet ID requirement of isGoodJet. The energy fractions do not depend on the
+// jet energy scale; eta selects the ID region.
+bool
+MiniAODHelper::PassesJetID(const pat::Jet& iJet, const double eta, const jetID::jetID iJetID){
+
+  if( iJetID == jetID::none ) return true;
+
+  return JetIDBits(iJet, eta) & jetIDMask::bit(iJetID);
+}
+
+// All jet ID working points, as bits of jetIDMask
+unsigned int
+MiniAODHelper::JetIDBits(const pat::Jet& iJet, const double eta){
+
+  // read the jet components once
+  const double nhf = iJet.neutralHadronEnergyFraction();
+  const double chf = iJet.chargedHadronEnergyFraction();
+  const double nemf = iJet.neutralEmEnergyFraction();
+  const double cemf = iJet.chargedEmEnergyFraction();
+  const int nMult = iJet.neutralMultiplicity();
+  const int cMult = iJet.chargedMultiplicity();
+  const double absEta = fabs(eta);
+
+  bool loose = ( nhf < 0.99 && cemf < 0.99 && nemf < 0.99 && iJet.numberOfDaughters() > 1 );
   bool tight = false;
-  bool goodForMETCorrection = false;
-
-  if(iJetID!=jetID::none){
-    loose = (
-		  iJet.neutralHadronEnergyFraction() < 0.99 &&
-		  iJet.chargedEmEnergyFraction() < 0.99 &&
-		  iJet.neutralEmEnergyFraction() < 0.99 &&
-		  iJet.numberOfDaughters() > 1
-		  );
-    if ( fabs(iJet.eta())<=2.7 )
-    {
-        // https://twiki.cern.ch/twiki/bin/viewauth/CMS/JetID13TeVRun2017
-        tight = ( iJet.neutralHadronEnergyFraction() < 0.9 &&
-            iJet.neutralEmEnergyFraction() < 0.9 &&
-            (iJet.neutralMultiplicity()+iJet.chargedMultiplicity())>1 );
-        
-        if( fabs(iJet.eta())<=2.4 )
-        {
-            bool etaLT2p4reqs = iJet.chargedHadronEnergyFraction() > 0.0 && iJet.chargedMultiplicity() > 0;           
-            loose = loose && etaLT2p4reqs;
-            tight = tight && etaLT2p4reqs;
-        }
-    }
-    if ( fabs(iJet.eta())>2.7 && fabs(iJet.eta())<=3.0 )
-    {
-        tight = ( iJet.neutralEmEnergyFraction()>0.02 &&
-             iJet.neutralEmEnergyFraction()<0.99 &&
-             //(iJet.neutralMultiplicity()+iJet.chargedMultiplicity())>2 );
-             iJet.neutralMultiplicity()>2 );
-    }
-    if ( fabs(iJet.eta())>3.0 )
-    {
-        tight = ( iJet.neutralEmEnergyFraction()<0.9 &&
-            iJet.neutralHadronEnergyFraction()>0.02 &&
-            iJet.neutralMultiplicity()>10 );
-    }
-    
-    if(iJetID==jetID::jetMETcorrection){ //only check this if asked, otherwise there could be problems
-      goodForMETCorrection = (
-                  iJet.correctedJet(0).pt()>10.0 &&
+  if ( absEta<=2.7 )
+  {
+      // https://twiki.cern.ch/twiki/bin/viewauth/CMS/JetID13TeVRun2017
+      tight = ( nhf < 0.9 && nemf < 0.9 && (nMult+cMult)>1 );
+
+      if( absEta<=2.4 )
+      {
+          bool etaLT2p4reqs = chf > 0.0 && cMult > 0;
+          loose = loose && etaLT2p4reqs;
+          tight = tight && etaLT2p4reqs;
+      }
+  }
+  if ( absEta>2.7 && absEta<=3.0 )
+  {
+      tight = ( nemf>0.02 && nemf<0.99 && nMult>2 );
+  }
+  if ( absEta>3.0 )
+  {
+      tight = ( nemf<0.9 && nhf>0.02 && nMult>10 );
+  }
+
+  // uncorrected pt as jecFactor(0)*pt, without creating the correctedJet(0) copy
+  const bool goodForMETCorrection = (
+		  iJet.jecSetsAvailable() && iJet.pt()*iJet.jecFactor(0)>10.0 &&
 		  (( !iJet.isPFJet() && iJet.emEnergyFraction()<0.9 ) ||
-		  ( iJet.isPFJet() && (iJet.neutralEmEnergyFraction() + iJet.chargedEmEnergyFraction())<0.9 ))
+		  ( iJet.isPFJet() && (nemf + cemf)<0.9 ))
 		  );
-    }
+
+  unsigned int mask = jetIDMask::bit(jetID::none);
+  if( loose ) mask |= jetIDMask::bit(jetID::jetPU) | jetIDMask::bit(jetID::jetMinimal) | jetIDMask::bit(jetID::jetLooseAOD) | jetIDMask::bit(jetID::jetLoose);
+  if( tight ) mask |= jetIDMask::bit(jetID::jetTight);
+  if( goodForMETCorrection ) mask |= jetIDMask::bit(jetID::jetMETcorrection);
+  return mask;
+}
+
+unsigned int
+MiniAODHelper::GetJetIDMask(const pat::Jet& iJet, const double eta, const float csv){
+
+  CheckSetUp();
+
+  unsigned int mask = JetIDBits(iJet, eta);
+  if( csv > CSVLwp ) mask |= jetIDMask::csvL;
+  if( csv > CSVMwp ) mask |= jetIDMask::csvM;
+  if( csv > CSVTwp ) mask |= jetIDMask::csvT;
+  return mask;
+}
+
+std::vector<unsigned int>
+MiniAODHelper::GetJetIDMasks(const std::vector<pat::Jet>& inputJets){
+
+  std::vector<unsigned int> masks;
+  masks.reserve(inputJets.size());
+  const BTagIndex& csv = csvIndex(inputJets);
+
+  for( std::vector<pat::Jet>::const_iterator it = inputJets.begin(), ed = inputJets.end(); it != ed; ++it ){
+    masks.push_back(GetJetIDMask(*it, it->eta(), GetJetCSV(*it,csv)));
   }
 
-  switch(iJetID){
-  case jetID::jetMETcorrection:
-    if( !goodForMETCorrection ) return false;
-    break;
-  case jetID::jetPU:
-  case jetID::jetMinimal:
-  case jetID::jetLooseAOD:
-  case jetID::jetLoose:
-    if( !loose ) return false;
-    break;
-  case jetID::jetTight:
-    if( !tight ) return false;
-    break;
-  case jetID::none:
-  default:
-    break;
+  return masks;
+}
+
+// Same as PassesJetID and PassesCSV
+bool
+MiniAODHelper::PassesJetIDMask(const unsigned int mask, const jetID::jetID iJetID, const char iCSVworkingPoint){
+
+  unsigned int required = jetIDMask::bit(iJetID);
+  switch(iCSVworkingPoint){
+  case 'L':	required |= jetIDMask::csvL;	break;
+  case 'M':	required |= jetIDMask::csvM;	break;
+  case 'T':	required |= jetIDMask::csvT;	break;
+  case '-':	break;
+  default:	return false;
   }
+  return (mask & required) == required;
+}
 
-  if( !PassesCSV(iJet, iCSVworkingPoint) ) return false;
+std::vector<unsigned int>
+MiniAODHelper::GetSelectedJetIndices(const std::vector<pat::Jet>& inputJets, const std::vector<unsigned int>& masks, const float iMinPt, const float iMaxAbsEta, const jetID::jetID iJetID, const char iCSVwp){
 
-  return true;
+  std::vector<unsigned int> selected;
+
+  for( unsigned int i=0; i<inputJets.size(); ++i ){
+    const pat::Jet& jet = inputJets[i];
+    if( jet.pt() < iMinPt || fabs(jet.eta()) > iMaxAbsEta ) continue;
+    if( PassesJetIDMask(masks[i], iJetID, iCSVwp) ) selected.push_back(i);
+  }
+
+  return selected;
+}
+
+std::vector<CorrectedJetView>
+MiniAODHelper::GetSelectedJetViews(const std::vector<CorrectedJetView>& inputViews, const std::vector<unsigned int>& masks, const float iMinPt, const float iMaxAbsEta, const jetID::jetID iJetID, const char iCSVwp){
+
+  std::vector<CorrectedJetView> selectedViews;
+
+  for( std::vector<CorrectedJetView>::const_iterator it = inputViews.begin(), ed = inputViews.end(); it != ed; ++it ){
+    if( it->pt < iMinPt || fabs(it->eta) > iMaxAbsEta ) continue;
+    if( PassesJetIDMask(masks[it->index], iJetID, iCSVwp) ) selectedViews.push_back(*it);
+  }
+
+  return selectedViews;
 }
 
 
@@ -1417,7 +1812,6 @@ float MiniAODHelper::GetMuonRelIso(const pat::Muon& iMuon) const
 //overloaded
 float MiniAODHelper::GetMuonRelIso(const pat::Muon& iMuon,const coneSize::coneSize iconeSize, const corrType::corrType icorrType, std::map<std::string,double> *miniIso_calculation_params) const
 {
-
   // !!! NOTE !!! rho used with Phys14 should be: fixedGridRhoFastjetAll
   // !!! NOTE !!! rho used with Spring15 should be: fixedGridRhoFastjetCentralNeutral
 
@@ -1431,6 +1825,20 @@ float MiniAODHelper::GetMuonRelIso(const pat::Muon& iMuon,const coneSize::coneSi
   double pfIsoNeutral;
   double pfIsoPUSubtracted;
 
+  if (icorrType == corrType::puppiWeighted)
+  {
+    // particle-weighted isolation from the packed candidates; the muon vetoes are
+    // those of pfIsolationR03/R04 and of the mini-isolation alike. Pileup is
+    // suppressed by the PUPPI weights, so no further correction
+    double dR = 10.0/min(max(float(iMuon.pt()), float(50.)),float(200.));
+    if (iconeSize == coneSize::R03) dR = 0.3;
+    else if (iconeSize == coneSize::R04) dR = 0.4;
+    pfIsoCharged = isoSumRaw(isoScratch_, chargedIndex_, iMuon, dR, 0.0001, 0.0, SelfVetoPolicy::selfVetoAll, -1, true)
+                 + isoSumRaw(isoScratch_, pileupIndex_, iMuon, dR, 0.0001, 0.0, SelfVetoPolicy::selfVetoAll, -1, true);
+    pfIsoNeutral = isoSumRaw(isoScratch_, neutralIndex_, iMuon, dR, 0.01, 0.5, SelfVetoPolicy::selfVetoAll, -1, true);
+    return (pfIsoCharged + pfIsoNeutral)/iMuon.pt();
+  }
+
   switch(iconeSize)
   {
     case coneSize::R04:
@@ -1439,6 +1847,8 @@ float MiniAODHelper::GetMuonRelIso(const pat::Muon& iMuon,const coneSize::coneSi
 
       switch(icorrType)
       {
+	    case corrType::puppiWeighted: // handled above
+	        break;
         case corrType::rhoEA:
             //based on R04 Phys14_25ns_v1
             // if (Eta >= 0. && Eta < 0.8) EffArea = 0.1546;
@@ -1464,6 +1874,8 @@ float MiniAODHelper::GetMuonRelIso(const pat::Muon& iMuon,const coneSize::coneSi
 
       switch(icorrType)
 	  {
+	    case corrType::puppiWeighted: // handled above
+	        break;
 	    case corrType::rhoEA:
             //effective area based on R03 Phys14_25ns_v1
             // if (Eta >= 0. && Eta < 0.8) EffArea = 0.0913;
@@ -1499,11 +1911,13 @@ float MiniAODHelper::GetMuonRelIso(const pat::Muon& iMuon,const coneSize::coneSi
 
     case coneSize::miniIso:
       double miniIsoR = 10.0/min(max(float(iMuon.pt()), float(50.)),float(200.));
-      pfIsoCharged = isoSumRaw(charged_, iMuon, miniIsoR, 0.0001, 0.0, SelfVetoPolicy::selfVetoAll);
-      pfIsoNeutral = isoSumRaw(neutral_, iMuon, miniIsoR, 0.01, 0.5, SelfVetoPolicy::selfVetoAll);
+      pfIsoCharged = isoSumRaw(isoScratch_, chargedIndex_, iMuon, miniIsoR, 0.0001, 0.0, SelfVetoPolicy::selfVetoAll, -1, false);
+      pfIsoNeutral = isoSumRaw(isoScratch_, neutralIndex_, iMuon, miniIsoR, 0.01, 0.5, SelfVetoPolicy::selfVetoAll, -1, false);
       
       switch(icorrType)
 	  {
+	    case corrType::puppiWeighted: // handled above
+	        break;
         case corrType::rhoEA:
           //effective area based on R03 Phys14_25ns_v1
           // if (abs(Eta) < 0.8) EffArea = 0.0913;
@@ -1529,7 +1943,7 @@ float MiniAODHelper::GetMuonRelIso(const pat::Muon& iMuon,const coneSize::coneSi
           correction = useRho*EffArea*(miniIsoR/0.3)*(miniIsoR/0.3);
           break;
 	    case corrType::deltaBeta:
-          double miniAbsIsoPU = isoSumRaw(pileup_, iMuon, miniIsoR, 0.01, 0.5, SelfVetoPolicy::selfVetoAll);
+          double miniAbsIsoPU = isoSumRaw(isoScratch_, pileupIndex_, iMuon, miniIsoR, 0.01, 0.5, SelfVetoPolicy::selfVetoAll, -1, false);
           correction = 0.5*miniAbsIsoPU;
           break;
 	  }
@@ -1594,6 +2008,24 @@ float MiniAODHelper::GetElectronRelIso(const pat::Electron& iElectron,const cone
   double pfIsoNeutral;
   double pfIsoPUSubtracted;
 
+  if (icorrType == corrType::puppiWeighted)
+  {
+    // particle-weighted isolation from the packed candidates, with the endcap inner
+    // radii of the mini-isolation for coneSize::miniIso only. Pileup is suppressed
+    // by the PUPPI weights, so no further correction (ieffAreaType is not used)
+    double dR = 10.0/min(max(float(iElectron.pt()), float(50.)),float(200.));
+    if (iconeSize == coneSize::R03) dR = 0.3;
+    else if (iconeSize == coneSize::R04) dR = 0.4;
+    const bool endcapVeto = iconeSize == coneSize::miniIso && !iElectron.isEB();
+    double innerR_ch = endcapVeto ? 0.015 : 0.0;
+    double innerR_nu = endcapVeto ? 0.08 : 0.0;
+    pfIsoCharged = isoSumRaw(isoScratch_, chargedIndex_, iElectron, dR, innerR_ch, 0.0, SelfVetoPolicy::selfVetoNone, -1, true)
+                 + isoSumRaw(isoScratch_, pileupIndex_, iElectron, dR, innerR_ch, 0.0, SelfVetoPolicy::selfVetoNone, -1, true);
+    pfIsoNeutral = isoSumRaw(isoScratch_, neutralIndex_, iElectron, dR, innerR_nu, 0.0, SelfVetoPolicy::selfVetoNone, 22, true)
+                 + isoSumRaw(isoScratch_, neutralIndex_, iElectron, dR, 0.0, 0.0, SelfVetoPolicy::selfVetoNone, 130, true);
+    return (pfIsoCharged + pfIsoNeutral)/iElectron.pt();
+  }
+
   switch(iconeSize)
   {
     case coneSize::R04:
@@ -1607,46 +2039,10 @@ float MiniAODHelper::GetElectronRelIso(const pat::Electron& iElectron,const cone
       }
       switch(icorrType)
 	  {
+	    case corrType::puppiWeighted: // handled above
+	        break;
 	    case corrType::rhoEA:
-	        if(ieffAreaType==effAreaType::phys14)
-	        {
-	            if (Eta >= 0. && Eta < 0.8) EffArea = 0.1013;
-	            else if (Eta >= 0.8 && Eta < 1.3) EffArea = 0.0988;
-	            else if (Eta >= 1.3 && Eta < 2.0) EffArea = 0.0572;
-	            else if (Eta >= 2.0 && Eta < 2.2) EffArea = 0.0842;
-	            else if (Eta >= 2.2 && Eta <= 2.5) EffArea = 0.1530;
-	        }
-	        else if (ieffAreaType==effAreaType::spring15)
-	        {
-	            if (Eta >= 0. && Eta < 1.0) EffArea = 0.1752;
-	            else if (Eta >= 1.0 && Eta < 1.479) EffArea = 0.1862;
-	            else if (Eta >= 1.479 && Eta < 2.0) EffArea = 0.1411;
-	            else if (Eta >= 2.0 && Eta < 2.2) EffArea = 0.1534;
-	            else if (Eta >= 2.2 && Eta < 2.3) EffArea = 0.1903;
-	            else if (Eta >= 2.3 && Eta < 2.4) EffArea = 0.2243;
-	            else if (Eta >= 2.4 && Eta < 2.5) EffArea = 0.2687;
-	        }
-	        else if (ieffAreaType==effAreaType::spring16)
-	        {
-                if (Eta >= 0. && Eta < 1.0) EffArea = 0.1703;
-                else if (Eta >= 1.0 && Eta < 1.479) EffArea = 0.1715;
-                else if (Eta >= 1.479 && Eta < 2.0) EffArea = 0.1213;
-                else if (Eta >= 2.0 && Eta < 2.2) EffArea = 0.1230;
-                else if (Eta >= 2.2 && Eta < 2.3) EffArea = 0.1635;
-                else if (Eta >= 2.3 && Eta < 2.4) EffArea = 0.1937;
-                else if (Eta >= 2.4 && Eta < 5) EffArea = 0.2393;
-	        }
-	        else if (ieffAreaType==effAreaType::fall17)
-	        {
-                if (Eta >= 0. && Eta < 1.0) EffArea = 0.1566;
-                else if (Eta >= 1.0 && Eta < 1.479) EffArea = 0.1626;
-                else if (Eta >= 1.479 && Eta < 2.0) EffArea = 0.1073;
-                else if (Eta >= 2.0 && Eta < 2.2) EffArea = 0.0854;
-                else if (Eta >= 2.2 && Eta < 2.3) EffArea = 0.1051;
-                else if (Eta >= 2.3 && Eta < 2.4) EffArea = 0.1204;
-                else if (Eta >= 2.4 && Eta < 5) EffArea = 0.1524;
-	        }
-
+	        EffArea = electronEffectiveAreas_[ieffAreaType]->area(Eta);
 	        if(!rhoIsSet) std::cout << " !! ERROR !! Trying to get rhoEffArea correction without setting rho" << std::endl;
 	        correction = useRho*EffArea;
 	        break;
@@ -1673,46 +2069,20 @@ float MiniAODHelper::GetElectronRelIso(const pat::Electron& iElectron,const cone
 	    innerR_nu = 0.08;
 	  }
 
-      pfIsoCharged = isoSumRaw(charged_, iElectron, miniIsoR, innerR_ch, 0.0, SelfVetoPolicy::selfVetoNone);
-      pfIsoNeutral = isoSumRaw(neutral_, iElectron, miniIsoR, innerR_nu, 0.0, SelfVetoPolicy::selfVetoNone, 22)+isoSumRaw(neutral_, iElectron, miniIsoR, 0.0, 0.0, SelfVetoPolicy::selfVetoNone, 130);
+      pfIsoCharged = isoSumRaw(isoScratch_, chargedIndex_, iElectron, miniIsoR, innerR_ch, 0.0, SelfVetoPolicy::selfVetoNone, -1, false);
+      pfIsoNeutral = isoSumRaw(isoScratch_, neutralIndex_, iElectron, miniIsoR, innerR_nu, 0.0, SelfVetoPolicy::selfVetoNone, 22, false)+isoSumRaw(isoScratch_, neutralIndex_, iElectron, miniIsoR, 0.0, 0.0, SelfVetoPolicy::selfVetoNone, 130, false);
       switch(icorrType)
       {
+	    case corrType::puppiWeighted: // handled above
+	        break;
 	    case corrType::rhoEA:
 	        //effective area based on R03
-
-	        if(ieffAreaType==effAreaType::phys14)
-	        {
-	            if (Eta >= 0. && Eta < 0.8) EffArea = 0.1013;
-                else if (Eta >= 0.8 && Eta < 1.3) EffArea = 0.0988;
-                else if (Eta >= 1.3 && Eta < 2.0) EffArea = 0.0572;
-                else if (Eta >= 2.0 && Eta < 2.2) EffArea = 0.0842;
-                else if (Eta >= 2.2 && Eta <= 2.5) EffArea = 0.1530;
-	        }
-	        else if (ieffAreaType==effAreaType::spring15)
-	        {
-              if (Eta >= 0. && Eta < 1.0) EffArea = 0.1752;
-              else if (Eta >= 1.0 && Eta < 1.479) EffArea = 0.1862;
-              else if (Eta >= 1.479 && Eta < 2.0) EffArea = 0.1411;
-              else if (Eta >= 2.0 && Eta < 2.2) EffArea = 0.1534;
-              else if (Eta >= 2.2 && Eta < 2.3) EffArea = 0.1903;
-              else if (Eta >= 2.3 && Eta < 2.4) EffArea = 0.2243;
-              else if (Eta >= 2.4 && Eta < 2.5) EffArea = 0.2687;
-            }
-	        else if (ieffAreaType==effAreaType::fall17)
-	        {
-              if (Eta >= 0. && Eta < 1.0) EffArea = 0.1566;
-              else if (Eta >= 1.0 && Eta < 1.479) EffArea = 0.1626;
-              else if (Eta >= 1.479 && Eta < 2.0) EffArea = 0.1073;
-              else if (Eta >= 2.0 && Eta < 2.2) EffArea = 0.0854;
-              else if (Eta >= 2.2 && Eta < 2.3) EffArea = 0.1051;
-              else if (Eta >= 2.3 && Eta < 2.4) EffArea = 0.1204;
-              else if (Eta >= 2.4 && Eta < 5) EffArea = 0.1524;
-	        }
+	        EffArea = electronEffectiveAreas_[ieffAreaType]->area(Eta);
 	        if(!rhoIsSet) std::cout << " !! ERROR !! Trying to get rhoEffArea correction without setting rho" << std::endl;
 	        correction = useRho*EffArea*(miniIsoR/0.3)*(miniIsoR/0.3);
 	        break;
 	    case corrType::deltaBeta:
-	        double miniAbsIsoPU = isoSumRaw(pileup_, iElectron, miniIsoR, innerR_ch, 0.0, SelfVetoPolicy::selfVetoNone);
+	        double miniAbsIsoPU = isoSumRaw(isoScratch_, pileupIndex_, iElectron, miniIsoR, innerR_ch, 0.0, SelfVetoPolicy::selfVetoNone, -1, false);
 	        correction = 0.5*miniAbsIsoPU;
 	        break;
       }
@@ -1731,18 +2101,208 @@ float MiniAODHelper::GetElectronRelIso(const pat::Electron& iElectron,const cone
       }
       break;
   }
-  return result;
+  return result;
+}
+
+void MiniAODHelper::AddElectronRelIso(pat::Electron& iElectron,const coneSize::coneSize iconeSize, const corrType::corrType icorrType,const effAreaType::effAreaType ieffAreaType, std::string userFloatName) const{
+    float iso=GetElectronRelIso(iElectron,iconeSize,icorrType,ieffAreaType);
+    iElectron.addUserFloat(userFloatName,iso);
+}
+
+void MiniAODHelper::AddElectronRelIso(std::vector<pat::Electron>& electrons,const coneSize::coneSize iconeSize, const corrType::corrType icorrType,const effAreaType::effAreaType ieffAreaType, std::string userFloatName) const{
+    for(auto el=electrons.begin(); el!=electrons.end(); el++){
+	AddElectronRelIso(*el,iconeSize,icorrType,ieffAreaType,userFloatName);
+    }
+}
+
+
+// Mini-isolation cones as used in GetMuonRelIso and GetElectronRelIso
+IsoCone MiniAODHelper::MuonMiniIsoCone(){
+  IsoCone cone = FixedIsoCone(-1);
+  cone.innerRCharged = 0.0001;
+  cone.innerRPhoton = cone.innerRNeutralHadron = cone.innerRPileup = 0.01;
+  cone.thresholdNeutral = cone.thresholdPileup = 0.5;
+  cone.includeHF = true;
+  cone.selfVeto = SelfVetoPolicy::selfVetoAll;
+  return cone;
+}
+
+IsoCone MiniAODHelper::ElectronMiniIsoCone(){
+  IsoCone cone = FixedIsoCone(-1);
+  cone.innerRChargedEE = cone.innerRPileupEE = 0.015;
+  cone.innerRPhotonEE = 0.08;
+  cone.includeHF = false;
+  return cone;
+}
+
+IsoCone MiniAODHelper::FixedIsoCone(const float dR, const float innerR){
+  IsoCone cone;
+  cone.dR = dR;
+  cone.innerRCharged = cone.innerRPhoton = cone.innerRNeutralHadron = cone.innerRPileup = innerR;
+  cone.innerRChargedEE = cone.innerRPhotonEE = cone.innerRPileupEE = -1;
+  cone.thresholdCharged = cone.thresholdNeutral = cone.thresholdPileup = 0;
+  cone.includeHF = true;
+  cone.selfVeto = SelfVetoPolicy::selfVetoNone;
+  return cone;
+}
+
+
+std::vector<IsoSums> MiniAODHelper::GetIsolationSums(const std::vector<pat::Muon>& muons, const std::vector<pat::Electron>& electrons, const std::vector<IsoCone>& cones) const{
+  std::vector<IsoSums> sums((muons.size()+electrons.size())*cones.size());
+  if( cones.empty() ) return sums;
+
+  IsoSums* out = sums.data();
+  for( const auto& mu : muons ){
+    FillIsolationSums(mu, false, cones, isoScratch_, out);
+    out += cones.size();
+  }
+  for( const auto& el : electrons ){
+    FillIsolationSums(el, !el.isEB(), cones, isoScratch_, out);
+    out += cones.size();
+  }
+  return sums;
 }
 
-void MiniAODHelper::AddElectronRelIso(pat::Electron& iElectron,const coneSize::coneSize iconeSize, const corrType::corrType icorrType,const effAreaType::effAreaType ieffAreaType, std::string userFloatName) const{
-    float iso=GetElectronRelIso(iElectron,iconeSize,icorrType,ieffAreaType);
-    iElectron.addUserFloat(userFloatName,iso);
+
+std::vector<IsolatedTrack> MiniAODHelper::GetIsolatedTracks(const float minPt, const float maxRelIso, const float dR) const{
+  std::vector<IsolatedTrack> tracks;
+  const PackedCandidateIndex& cands = chargedIndex_;
+  const float dR2 = dR*dR;
+  std::vector<unsigned int> accepted, recheck;
+
+  for( unsigned int i=0; i<cands.size(); ++i ){
+    const float pt = cands.pt(i);
+    if( pt < minPt ) continue;
+
+    accepted.clear();
+    recheck.clear();
+    cands.visitCone(cands.eta(i)-dR, cands.eta(i)+dR, cands.phi(i), dR, [&] (unsigned int begin, unsigned int end) {
+      cands.selectInCone(begin, end, cands.eta(i), cands.phi(i), dR2, 0, 0, -1, accepted, recheck);
+    });
+    double isosum = 0;
+    for( unsigned int j : accepted ){
+      if( j != i ) isosum += cands.pt(j);
+    }
+    for( unsigned int j : recheck ){
+      if( j != i && reco::deltaR2(*cands.cand(j), *cands.cand(i)) < dR2 ) isosum += cands.pt(j);
+    }
+
+    const float relIso = isosum/pt;
+    if( relIso < maxRelIso ){
+      IsolatedTrack track = { cands.key(i), pt, relIso };
+      tracks.push_back(track);
+    }
+  }
+  return tracks;
 }
 
-void MiniAODHelper::AddElectronRelIso(std::vector<pat::Electron>& electrons,const coneSize::coneSize iconeSize, const corrType::corrType icorrType,const effAreaType::effAreaType ieffAreaType, std::string userFloatName) const{
-    for(auto el=electrons.begin(); el!=electrons.end(); el++){
-	AddElectronRelIso(*el,iconeSize,icorrType,ieffAreaType,userFloatName);
+
+// Each candidate class is queried once with the largest cone of the lepton.
+// Hits are then decided per cone with the same cuts as isoSumRaw, and
+// accumulated in eta order.
+void MiniAODHelper::FillIsolationSums(const reco::Candidate& lepton, const bool endcap, const std::vector<IsoCone>& cones, IsoScratch& scratch, IsoSums* sums) const{
+  const unsigned int nCones = cones.size();
+  const double miniIsoR = 10.0/min(max(float(lepton.pt()), float(50.)),float(200.));
+
+  std::vector<float> dR(nCones), etaLo(nCones), etaHi(nCones);
+  float maxR = 0;
+  for( unsigned int j=0; j<nCones; ++j ){
+    dR[j] = cones[j].dR > 0 ? cones[j].dR : float(miniIsoR);
+    etaLo[j] = lepton.eta() - dR[j];
+    etaHi[j] = lepton.eta() + dR[j];
+    maxR = std::max(maxR, dR[j]);
+  }
+
+  // first available source of the lepton, and whether it is a packed candidate
+  int firstSelfKey = -1;
+  bool hasFirstSelf = false;
+  for( unsigned int i = 0, n = lepton.numberOfSourceCandidatePtrs(); i < n && !hasFirstSelf; ++i ){
+    const reco::CandidatePtr &cp = lepton.sourceCandidatePtr(i);
+    if( cp.isNonnull() && cp.isAvailable() ){
+      firstSelfKey = PackedCandidateKey(&*cp);
+      hasFirstSelf = true;
+    }
+  }
+  FillSelfVetoKeys(lepton, SelfVetoPolicy::selfVetoAll, scratch);
+
+  const PackedCandidateIndex* indices[3] = { &chargedIndex_, &neutralIndex_, &pileupIndex_ };
+  std::vector<double> acc(nCones);
+  std::vector<std::pair<unsigned int,unsigned int> > hits; // (rank,position)
+
+  for( unsigned int iClass=0; iClass<3; ++iClass ){
+    const PackedCandidateIndex& cands = *indices[iClass];
+
+    scratch.accepted.clear();
+    scratch.recheck.clear();
+    cands.visitCone(lepton.eta()-maxR, lepton.eta()+maxR, lepton.phi(), maxR, [&] (unsigned int begin, unsigned int end) {
+      cands.selectInCone(begin, end, lepton.eta(), lepton.phi(), maxR*maxR, 0, 0, -1, scratch.accepted, scratch.recheck);
+    });
+    hits.clear();
+    for( unsigned int i : scratch.accepted ) hits.push_back(std::make_pair(cands.rank(i), i));
+    for( unsigned int i : scratch.recheck ) hits.push_back(std::make_pair(cands.rank(i), i));
+    std::sort(hits.begin(), hits.end());
+
+    std::fill(acc.begin(), acc.end(), 0.);
+    for( const auto& hit : hits ){
+      const unsigned int pos = hit.second;
+      const int absPdgId = cands.absPdgId(pos);
+      const float eta = cands.eta(pos);
+      const float pt = cands.pt(pos);
+
+      // deltaR^2 from the arrays; the exact one of the candidate is only
+      // needed within rounding distance of a cone boundary
+      const float d2 = cands.deltaR2(pos, lepton.eta(), lepton.phi());
+      float exactDR2 = -1;
+      const unsigned int key = cands.key(pos);
+      const bool vetoed = vetoedKeys_[key];
+      const bool isSelf = scratch.self[key];
+      const bool isFirstSelf = isSelf && int(key) == firstSelfKey;
+
+      for( unsigned int j=0; j<nCones; ++j ){
+        const IsoCone& cone = cones[j];
+        float innerR, threshold;
+        if( iClass==0 ){
+          innerR = (endcap && cone.innerRChargedEE >= 0) ? cone.innerRChargedEE : cone.innerRCharged;
+          threshold = cone.thresholdCharged;
+        }
+        else if( iClass==2 ){
+          innerR = (endcap && cone.innerRPileupEE >= 0) ? cone.innerRPileupEE : cone.innerRPileup;
+          threshold = cone.thresholdPileup;
+        }
+        else {
+          if( absPdgId==22 ) innerR = (endcap && cone.innerRPhotonEE >= 0) ? cone.innerRPhotonEE : cone.innerRPhoton;
+          else if( absPdgId==130 || cone.includeHF ) innerR = cone.innerRNeutralHadron;
+          else continue;
+          threshold = cone.thresholdNeutral;
+        }
+
+        // eta band
+        if( eta < etaLo[j] || etaHi[j] < eta ) continue;
+        // threshold
+        if( threshold > 0 && pt < threshold ) continue;
+        // cone
+        const float outerR2 = dR[j]*dR[j], innerR2 = innerR*innerR;
+        const float tolerance = PackedCandidateIndex::rounding(outerR2);
+        float mydr2 = d2;
+        if( std::fabs(d2-outerR2) < tolerance || std::fabs(d2-innerR2) < tolerance ){
+          if( exactDR2 < 0 ) exactDR2 = reco::deltaR2(*cands.cand(pos), lepton);
+          mydr2 = exactDR2;
+        }
+        if( mydr2 >= outerR2 || mydr2 < innerR2 ) continue;
+        // veto
+        if( vetoed ) continue;
+        if( isSelf && cone.selfVeto == SelfVetoPolicy::selfVetoAll ) continue;
+        if( isFirstSelf && cone.selfVeto == SelfVetoPolicy::selfVetoFirst ) continue;
+        acc[j] += pt;
+      }
+    }
+
+    for( unsigned int j=0; j<nCones; ++j ){
+      if( iClass==0 ) sums[j].charged = acc[j];
+      else if( iClass==1 ) sums[j].neutral = acc[j];
+      else sums[j].pileup = acc[j];
     }
+  }
 }
 
 
@@ -1761,11 +2321,36 @@ float MiniAODHelper::GetJetCSV(const pat::Jet& jet, const std::string taggername
 }
 
 
+float MiniAODHelper::GetJetCSV(const pat::Jet& jet, const BTagIndex& index){
+
+  float defaultFailure = -.1;
+
+  float bTagVal = index(jet);
+
+  if(isnan(bTagVal)) return defaultFailure;
+
+  if(bTagVal > 1.) return 1.;
+  if(bTagVal < 0.) return defaultFailure;
+
+  return bTagVal;
+}
+
+
+const BTagIndex& MiniAODHelper::csvIndex(const std::vector<pat::Jet>& jets){
+  csvIndex_.resolve(jets);
+  return csvIndex_;
+}
+
+
 
 bool MiniAODHelper::PassesCSV(const pat::Jet& iJet, const char iCSVworkingPoint){
-  CheckSetUp();
+  csvIndex_.resolve(iJet);
+  return PassesCSV(GetJetCSV(iJet,csvIndex_), iCSVworkingPoint);
+}
 
-  float csvValue = GetJetCSV(iJet,"pfCombinedInclusiveSecondaryVertexV2BJetTags");
+
+bool MiniAODHelper::PassesCSV(const float csvValue, const char iCSVworkingPoint){
+  CheckSetUp();
 
   // CSV b-tagging requirement
   switch(iCSVworkingPoint){
@@ -1778,432 +2363,254 @@ bool MiniAODHelper::PassesCSV(const pat::Jet& iJet, const char iCSVworkingPoint)
 }
 
 
-bool MiniAODHelper::PassElectron80XId(const pat::Electron& iElectron, const electronID::electronID iElectronID) const{
+const MiniAODHelper::ElectronCutTableID MiniAODHelper::electronCutTableIDs_[10] = {
+  { electronID::electronPhys14L,       phys14ElectronID,   "Loose" },
+  { electronID::electronPhys14M,       phys14ElectronID,   "Medium" },
+  { electronID::electronPhys14T,       phys14ElectronID,   "Tight" },
+  { electronID::electronSpring15Veto,  spring15ElectronID, "Veto" },
+  { electronID::electronSpring15L,     spring15ElectronID, "Loose" },
+  { electronID::electronSpring15M,     spring15ElectronID, "Medium" },
+  { electronID::electronSpring15T,     spring15ElectronID, "Tight" },
+  { electronID::electron80XCutBasedL,  summer16ElectronID, "Loose" },
+  { electronID::electron80XCutBasedM,  summer16ElectronID, "Medium" },
+  { electronID::electron80XCutBasedT,  summer16ElectronID, "Tight" }
+};
 
-  double SCeta = (iElectron.superCluster().isAvailable()) ? iElectron.superCluster()->position().eta() : -99;
-  double absSCeta = fabs(SCeta);
-  double relIso = GetElectronRelIso(iElectron, coneSize::R03, corrType::rhoEA, effAreaType::spring16);
-
-  bool isEB = ( absSCeta < 1.479 );
-
-  double full5x5_sigmaIetaIeta = iElectron.full5x5_sigmaIetaIeta();
-//   double dEtaIn = fabs( iElectron.deltaEtaSuperClusterTrackAtVtx() );
-  double dEtaInSeed = iElectron.superCluster().isNonnull() && iElectron.superCluster()->seed().isNonnull() ? iElectron.deltaEtaSuperClusterTrackAtVtx() - iElectron.superCluster()->eta() + iElectron.superCluster()->seed()->eta() : std::numeric_limits<float>::max();
-  double fabsdEtaInSeed=fabs(dEtaInSeed);
-  double dPhiIn = fabs( iElectron.deltaPhiSuperClusterTrackAtVtx() );
-  double hOverE = iElectron.hcalOverEcal();
-
-  double ooEmooP = -999;
-  if( iElectron.ecalEnergy() == 0 ) ooEmooP = 1e30;
-  else if( !std::isfinite(iElectron.ecalEnergy()) ) ooEmooP = 1e30;
-  else ooEmooP = fabs(1.0/iElectron.ecalEnergy() - iElectron.eSuperClusterOverP()/iElectron.ecalEnergy() );
-
-  double d0 = -999;
-  double dZ = -999;
-  double expectedMissingInnerHits = 999;
-  if( iElectron.gsfTrack().isAvailable() ){
-    d0 = fabs(iElectron.gsfTrack()->dxy(vertex.position()));
-    dZ = fabs(iElectron.gsfTrack()->dz(vertex.position()));
-    expectedMissingInnerHits = iElectron.gsfTrack()->hitPattern().numberOfAllHits(reco::HitPattern::MISSING_INNER_HITS);
-  }
-
-  bool passConversionVeto = ( iElectron.passConversionVeto() );
-
-  bool pass = false;
-  switch(iElectronID){
-  case electronID::electron80XCutBasedL:
-    if( isEB ){
-      pass = ( full5x5_sigmaIetaIeta < 0.011 &&
-	       fabsdEtaInSeed < 0.00477 &&
-	       dPhiIn < 0.222 &&
-	       hOverE < 0.298 &&
-	       ooEmooP < 0.241 &&
-	       expectedMissingInnerHits <= 1 &&
-	       passConversionVeto &&
-	       relIso < 0.0994
-	       );
-    }
-    else{
-      pass = ( full5x5_sigmaIetaIeta < 0.0314 &&
-	       fabsdEtaInSeed < 0.00868 &&
-	       dPhiIn < 0.213 &&
-	       hOverE < 0.101 &&
-	       ooEmooP < 0.14 &&
-	       expectedMissingInnerHits <= 1 &&
-	       passConversionVeto &&
-	       relIso < 0.107
-	       );
-    }
-    break;
-  case electronID::electron80XCutBasedM:
-    if( isEB ){
-      pass = ( full5x5_sigmaIetaIeta < 0.00998 &&
-	       fabsdEtaInSeed < 0.00311 &&
-	       dPhiIn < 0.103 &&
-	       hOverE < 0.253 &&
-	       ooEmooP < 0.134 &&
-	       expectedMissingInnerHits <= 1 &&
-	       passConversionVeto &&
-	       relIso < 0.0695
-	       );
-    }
-    else{
-      pass = ( full5x5_sigmaIetaIeta < 0.0298 &&
-	       fabsdEtaInSeed < 0.00609 &&
-	       dPhiIn < 0.045 &&
-	       hOverE < 0.0878 &&
-	       ooEmooP < 0.13 &&
-	       expectedMissingInnerHits <= 1 &&
-	       passConversionVeto &&
-	       relIso < 0.0821
-	       );
-    }
-    break;
-    case electronID::electron80XCutBasedT:
-    if( isEB ){
-      pass = ( full5x5_sigmaIetaIeta < 0.00998 &&
-	       fabsdEtaInSeed < 0.00308 &&
-	       dPhiIn < 0.0816 &&
-	       hOverE < 0.0414 &&
-	       ooEmooP < 0.0129 &&
-	       expectedMissingInnerHits <= 1 &&
-	       passConversionVeto &&
-	       relIso < 0.0588
-	       );
-    }
-    else{
-      pass = ( full5x5_sigmaIetaIeta < 0.0292 &&
-	       fabsdEtaInSeed < 0.00605 &&
-	       dPhiIn < 0.0394 &&
-	       hOverE < 0.0641 &&
-	       ooEmooP < 0.0129 &&
-	       expectedMissingInnerHits <= 1 &&
-	       passConversionVeto &&
-	       relIso < 0.0571
-	       );
+
+uint64_t MiniAODHelper::ElectronCutTableIDs(){
+  uint64_t ids = 0;
+  for( const auto& cutTableID: electronCutTableIDs_ ) ids |= leptonIDMask::bit(cutTableID.id);
+  return ids;
+}
+
+
+void MiniAODHelper::FillElectronIDBlock(const std::vector<const pat::Electron*>& electrons, ElectronIDTable::Block& block) const{
+
+  block.resize(electrons.size());
+  std::vector<double>* values = block.values;
+
+  for( unsigned int i=0; i<electrons.size(); ++i ){
+    const pat::Electron& iElectron = *electrons[i];
+
+    double absSCeta = (iElectron.superCluster().isAvailable()) ? fabs(iElectron.superCluster()->position().eta()) : 99;
+    block.endcap[i] = !( absSCeta < 1.479 );
+
+    values[ElectronIDTable::full5x5_sigmaIetaIeta][i] = iElectron.full5x5_sigmaIetaIeta();
+    values[ElectronIDTable::dEtaIn][i] = fabs( iElectron.deltaEtaSuperClusterTrackAtVtx() );
+    double dEtaInSeed = iElectron.superCluster().isNonnull() && iElectron.superCluster()->seed().isNonnull() ? iElectron.deltaEtaSuperClusterTrackAtVtx() - iElectron.superCluster()->eta() + iElectron.superCluster()->seed()->eta() : std::numeric_limits<float>::max();
+    values[ElectronIDTable::dEtaInSeed][i] = fabs(dEtaInSeed);
+    values[ElectronIDTable::dPhiIn][i] = fabs( iElectron.deltaPhiSuperClusterTrackAtVtx() );
+    values[ElectronIDTable::hOverE][i] = iElectron.hcalOverEcal();
+
+    double ooEmooP = -999;
+    if( iElectron.ecalEnergy() == 0 ) ooEmooP = 1e30;
+    else if( !std::isfinite(iElectron.ecalEnergy()) ) ooEmooP = 1e30;
+    else ooEmooP = fabs(1.0/iElectron.ecalEnergy() - iElectron.eSuperClusterOverP()/iElectron.ecalEnergy() );
+    values[ElectronIDTable::ooEmooP][i] = ooEmooP;
+
+    double d0 = -999;
+    double dZ = -999;
+    double expectedMissingInnerHits = 999;
+    if( iElectron.gsfTrack().isAvailable() ){
+      d0 = fabs(iElectron.gsfTrack()->dxy(vertex.position()));
+      dZ = fabs(iElectron.gsfTrack()->dz(vertex.position()));
+      expectedMissingInnerHits = iElectron.gsfTrack()->hitPattern().numberOfAllHits(reco::HitPattern::MISSING_INNER_HITS);
     }
-    break;
-  default:
-    break;
-  }
-  bool passesIPcuts = false;
-  if( isEB ){
-    passesIPcuts = d0<0.05 && dZ<0.1;
-  }
-  else{
-    passesIPcuts = d0<0.1 && dZ<0.2;
+    values[ElectronIDTable::d0][i] = d0;
+    values[ElectronIDTable::dZ][i] = dZ;
+    values[ElectronIDTable::missingInnerHits][i] = expectedMissingInnerHits;
+
+    values[ElectronIDTable::conversion][i] = iElectron.passConversionVeto() ? 0 : 1;
   }
-  return pass&&passesIPcuts;
 }
 
 
-bool MiniAODHelper::PassElectronPhys14Id(const pat::Electron& iElectron, const electronID::electronID iElectronID) const{
+void MiniAODHelper::EvaluateElectronCutTables(const std::vector<const pat::Electron*>& electrons, const uint64_t ids, uint64_t* masks) const{
 
-  double SCeta = (iElectron.superCluster().isAvailable()) ? iElectron.superCluster()->position().eta() : -99;
-  double absSCeta = fabs(SCeta);
-
-  bool isEB = ( absSCeta < 1.479 );
-
-  // double pfIsoCharged = iElectron.pfIsolationVariables().sumChargedHadronPt;
-  // double pfIsoNeutralHadron = iElectron.pfIsolationVariables().sumNeutralHadronEt;
-  // double pfIsoNeutralPhoton = iElectron.pfIsolationVariables().sumPhotonEt;
-  // double pfIsoSumPUPt = iElectron.pfIsolationVariables().sumPUPt;
-
-  // double relIso = (pfIsoCharged + std::max( pfIsoNeutralHadron + pfIsoNeutralPhoton - 0.5*pfIsoSumPUPt, 0.0 ))/iElectron.pt();
-  double relIso = GetElectronRelIso(iElectron, coneSize::R03, corrType::rhoEA);
-
-  double full5x5_sigmaIetaIeta = iElectron.full5x5_sigmaIetaIeta();
-  double dEtaIn = fabs( iElectron.deltaEtaSuperClusterTrackAtVtx() );
-  double dPhiIn = fabs( iElectron.deltaPhiSuperClusterTrackAtVtx() );
-  double hOverE = iElectron.hcalOverEcal();
-
-  double ooEmooP = -999;
-  if( iElectron.ecalEnergy() == 0 ) ooEmooP = 1e30;
-  else if( !std::isfinite(iElectron.ecalEnergy()) ) ooEmooP = 1e30;
-  else ooEmooP = fabs(1.0/iElectron.ecalEnergy() - iElectron.eSuperClusterOverP()/iElectron.ecalEnergy() );
-
-  double d0 = -999;
-  double dZ = -999;
-  double expectedMissingInnerHits = -999;
-  if( iElectron.gsfTrack().isAvailable() ){
-    d0 = fabs(iElectron.gsfTrack()->dxy(vertex.position()));
-    dZ = fabs(iElectron.gsfTrack()->dz(vertex.position()));
-    expectedMissingInnerHits = iElectron.gsfTrack()->hitPattern().numberOfAllHits(reco::HitPattern::MISSING_INNER_HITS);
-  }
-
-  bool passConversionVeto = ( iElectron.passConversionVeto() );
-
-  bool pass = false;
-  switch(iElectronID){
-  case electronID::electronPhys14L:
-    if( isEB ){
-      pass = ( full5x5_sigmaIetaIeta < 0.010331 &&
-	       dEtaIn < 0.009277 &&
-	       dPhiIn < 0.094739 &&
-	       hOverE < 0.093068 &&
-	       ooEmooP < 0.189968 &&
-	       d0 < 0.035904 &&
-	       dZ < 0.075496 &&
-	       expectedMissingInnerHits <= 1 &&
-	       passConversionVeto &&
-	       relIso < 0.130136
-	       );
-    }
-    else{
-      pass = ( full5x5_sigmaIetaIeta < 0.031838 &&
-	       dEtaIn < 0.009833 &&
-	       dPhiIn < 0.149934 &&
-	       hOverE < 0.115754 &&
-	       ooEmooP < 0.140662 &&
-	       d0 < 0.099266 &&
-	       dZ < 0.197897 &&
-	       expectedMissingInnerHits <= 1 &&
-	       passConversionVeto &&
-	       relIso < 0.163368
-	       );
-    }
-    break;
-  case electronID::electronPhys14M:
-    if( isEB ){
-      pass = ( full5x5_sigmaIetaIeta < 0.009996 &&
-	       dEtaIn < 0.008925 &&
-	       dPhiIn < 0.035973 &&
-	       hOverE < 0.050537  &&
-	       ooEmooP < 0.091942 &&
-	       d0 < 0.012235 &&
-	       dZ < 0.042020 &&
-	       expectedMissingInnerHits <= 1 &&
-	       passConversionVeto &&
-	       relIso < 0.107587
-	       );
+  if( electrons.empty() ) return;
+
+  ElectronIDTable::Block block;
+  std::vector<unsigned int> workingPoints(electrons.size());
+
+  for( unsigned int campaign=0; campaign<nElectronIDCampaigns; ++campaign ){
+    uint64_t campaignIDs = 0;
+    for( const auto& cutTableID: electronCutTableIDs_ ){
+      if( cutTableID.campaign == campaign ) campaignIDs |= leptonIDMask::bit(cutTableID.id);
     }
-    else{
-      pass = ( full5x5_sigmaIetaIeta < 0.030135 &&
-	       dEtaIn < 0.007429 &&
-	       dPhiIn < 0.067879 &&
-	       hOverE < 0.086782 &&
-	       ooEmooP < 0.100683 &&
-	       d0 < 0.036719 &&
-	       dZ < 0.138142 &&
-	       expectedMissingInnerHits <= 1 &&
-	       passConversionVeto &&
-	       relIso < 0.113254
-	       );
-    }
-    break;
-  case electronID::electronPhys14T:
-    if( isEB ){
-      pass = ( full5x5_sigmaIetaIeta < 0.009947 &&
-	       dEtaIn < 0.006046 &&
-	       dPhiIn < 0.028092 &&
-	       hOverE < 0.045772 &&
-	       ooEmooP < 0.020118 &&
-	       d0 < 0.008790 &&
-	       dZ < 0.021226 &&
-	       expectedMissingInnerHits <= 1 &&
-	       passConversionVeto &&
-	       relIso < 0.069537
-	       );
+    if( !(ids & campaignIDs) ) continue;
+
+    // the variables are shared by the campaigns, only the isolation differs
+    if( block.size() == 0 ) FillElectronIDBlock(electrons, block);
+
+    const ElectronIDTable& table = *electronIDTables_[campaign];
+    effAreaType::effAreaType effAreas;
+    if( table.effectiveAreas() == "phys14" ) effAreas = effAreaType::phys14;
+    else if( table.effectiveAreas() == "spring15" ) effAreas = effAreaType::spring15;
+    else if( table.effectiveAreas() == "spring16" ) effAreas = effAreaType::spring16;
+    else if( table.effectiveAreas() == "fall17" ) effAreas = effAreaType::fall17;
+    else throw cms::Exception("InvalidElectronIDFile") << "Unknown effective areas '" << table.effectiveAreas() << "'";
+
+    std::vector<double>& relIso = block.values[ElectronIDTable::relIso];
+    for( unsigned int i=0; i<electrons.size(); ++i ){
+      relIso[i] = GetElectronRelIso(*electrons[i], coneSize::R03, corrType::rhoEA, effAreas);
     }
-    else{
-      pass = ( full5x5_sigmaIetaIeta < 0.028237 &&
-	       dEtaIn < 0.007057 &&
-	       dPhiIn < 0.030159 &&
-	       hOverE < 0.067778 &&
-	       ooEmooP < 0.098919 &&
-	       d0 < 0.027984 &&
-	       dZ < 0.133431 &&
-	       expectedMissingInnerHits <= 1 &&
-	       passConversionVeto &&
-	       relIso < 0.078265
-	       );
+
+    table.evaluate(block, workingPoints.data());
+
+    for( const auto& cutTableID: electronCutTableIDs_ ){
+      if( cutTableID.campaign != campaign || !(ids & leptonIDMask::bit(cutTableID.id)) ) continue;
+      const int w = table.workingPoint(cutTableID.workingPoint);
+      if( w < 0 ){
+	throw cms::Exception("InvalidElectronIDFile") << "No working point '" << cutTableID.workingPoint << "' for electronID " << cutTableID.id;
+      }
+      for( unsigned int i=0; i<electrons.size(); ++i ){
+	if( (workingPoints[i] >> w) & 1u ) masks[i] |= leptonIDMask::bit(cutTableID.id);
+      }
     }
-    break;
-  default:
-    break;
   }
+}
+
+
+bool MiniAODHelper::PassesElectronCutTable(const pat::Electron& iElectron, const electronID::electronID iElectronID, const ElectronIDCampaign campaign) const{
+
+  // false for the IDs of other campaigns
+  uint64_t ids = 0;
+  for( const auto& cutTableID: electronCutTableIDs_ ){
+    if( cutTableID.id == iElectronID && cutTableID.campaign == campaign ) ids = leptonIDMask::bit(iElectronID);
+  }
+  if( !ids ) return false;
 
-  return pass;
+  uint64_t mask = 0;
+  EvaluateElectronCutTables(std::vector<const pat::Electron*>(1, &iElectron), ids, &mask);
+  return mask != 0;
 }
 
-bool MiniAODHelper::PassElectronSpring15Id(const pat::Electron& iElectron, const electronID::electronID iElectronID) const{
 
-    double SCeta = (iElectron.superCluster().isAvailable()) ? iElectron.superCluster()->position().eta() : -99;
-    double absSCeta = fabs(SCeta);
+bool MiniAODHelper::PassElectron80XId(const pat::Electron& iElectron, const electronID::electronID iElectronID) const{
+  return PassesElectronCutTable(iElectron, iElectronID, summer16ElectronID);
+}
 
-    bool isEB = ( absSCeta < 1.479 );
-    double relIso = GetElectronRelIso(iElectron, coneSize::R03, corrType::rhoEA,effAreaType::spring15);
 
-    double full5x5_sigmaIetaIeta = iElectron.full5x5_sigmaIetaIeta();
-    double dEtaIn = fabs( iElectron.deltaEtaSuperClusterTrackAtVtx() );
-    double dPhiIn = fabs( iElectron.deltaPhiSuperClusterTrackAtVtx() );
-    double hOverE = iElectron.hcalOverEcal();
+bool MiniAODHelper::PassElectronPhys14Id(const pat::Electron& iElectron, const electronID::electronID iElectronID) const{
+  return PassesElectronCutTable(iElectron, iElectronID, phys14ElectronID);
+}
 
-    double ooEmooP = -999;
-    if( iElectron.ecalEnergy() == 0 ) ooEmooP = 1e30;
-    else if( !std::isfinite(iElectron.ecalEnergy()) ) ooEmooP = 1e30;
-    else ooEmooP = fabs(1.0/iElectron.ecalEnergy() - iElectron.eSuperClusterOverP()/iElectron.ecalEnergy() );
 
-    double d0 = -999;
-    double dZ = -999;
-    double expectedMissingInnerHits = -999;
-    if( iElectron.gsfTrack().isAvailable() ){
-	d0 = fabs(iElectron.gsfTrack()->dxy(vertex.position()));
-	dZ = fabs(iElectron.gsfTrack()->dz(vertex.position()));
-	expectedMissingInnerHits = iElectron.gsfTrack()->hitPattern().numberOfAllHits(reco::HitPattern::MISSING_INNER_HITS);
-    }
-
-    bool passConversionVeto = ( iElectron.passConversionVeto() );
-
-    bool pass = false;
-    switch(iElectronID){
-    case electronID::electronSpring15Veto:
-	if( isEB ){
-	    pass=(
-		  full5x5_sigmaIetaIeta < 0.0114  &&
-		  dEtaIn < 0.0152  &&
-		  dPhiIn < 0.216  &&
-		  hOverE < 0.181  &&
-		  relIso < 0.126  &&
-		  ooEmooP < 0.207  &&
-		  d0 < 0.0564  &&
-		  dZ < 0.472  &&
-		  expectedMissingInnerHits <= 2  &&
-		  passConversionVeto
-		  );
-	}
-	else{
-	    pass=(
-		  full5x5_sigmaIetaIeta < 0.0352  &&
-		  dEtaIn < 0.0113  &&
-		  dPhiIn < 0.237  &&
-		  hOverE < 0.116  &&
-		  relIso < 0.144  &&
-		  ooEmooP < 0.174  &&
-		  d0 < 0.222  &&
-		  dZ < 0.921  &&
-		  expectedMissingInnerHits <= 3  &&
-		  passConversionVeto
-		  );
-	}
-	break;
-
-    case electronID::electronSpring15L:
-	if( isEB ){
-	    pass=(
-		  full5x5_sigmaIetaIeta <= 0.0103  &&
-		  dEtaIn < 0.0105  &&
-		  dPhiIn < 0.115  &&
-		  hOverE < 0.104  &&
-		  relIso < 0.0893  &&
-		  ooEmooP < 0.102  &&
-		  d0 < 0.0261  &&
-		  dZ < 0.41  &&
-		  expectedMissingInnerHits <= 2  &&
-		  passConversionVeto
-		  );
-	}
-	else{
-	    pass=(
-		  full5x5_sigmaIetaIeta < 0.0301  &&
-		  dEtaIn < 0.00814  &&
-		  dPhiIn < 0.182  &&
-		  hOverE < 0.0897  &&
-		  relIso < 0.121  &&
-		  ooEmooP < 0.126  &&
-		  d0 < 0.118  &&
-		  dZ < 0.822  &&
-		  expectedMissingInnerHits <= 1  &&
-		  passConversionVeto
-		  );
-	}
-	break;
-
-    case electronID::electronSpring15M:
-	if( isEB ){
-	    pass=(
-		  full5x5_sigmaIetaIeta < 0.0101  &&
-		  dEtaIn < 0.0103  &&
-		  dPhiIn < 0.0336  &&
-		  hOverE < 0.0876  &&
-		  relIso < 0.0766  &&
-		  ooEmooP < 0.0174  &&
-		  d0 < 0.0118  &&
-		  dZ < 0.373  &&
-		  expectedMissingInnerHits <= 2  &&
-		  passConversionVeto
-		  );
-	}
-	else{
-	    pass=(
-		  full5x5_sigmaIetaIeta < 0.0283  &&
-		  dEtaIn < 0.00733  &&
-		  dPhiIn < 0.114  &&
-		  hOverE < 0.0678  &&
-		  relIso < 0.0678  &&
-		  ooEmooP < 0.0898  &&
-		  d0 < 0.0739  &&
-		  dZ < 0.602  &&
-		  expectedMissingInnerHits <= 1  &&
-		  passConversionVeto
-		  );
-	}
-	break;
-
-    case electronID::electronSpring15T:
-	if( isEB ){
-	    pass=(
-		  full5x5_sigmaIetaIeta < 0.0101 &&
-		  dEtaIn < 0.00926 &&
-		  dPhiIn < 0.0336 &&
-		  hOverE < 0.0597 &&
-		  relIso < 0.0354 &&
-		  ooEmooP < 0.012 &&
-		  d0 < 0.0111 &&
-		  dZ < 0.0466 &&
-		  expectedMissingInnerHits <= 2 &&
-		  passConversionVeto
-		  );
-	}
-	else{
-	    pass=(
-		  full5x5_sigmaIetaIeta < 0.0279 &&
-		  dEtaIn < 0.00724 &&
-		  dPhiIn < 0.0918 &&
-		  hOverE < 0.0615 &&
-		  relIso < 0.0646 &&
-		  ooEmooP < 0.00999 &&
-		  d0 < 0.0351 &&
-		  dZ < 0.417 &&
-		  expectedMissingInnerHits <= 1 &&
-		  passConversionVeto
-		  );
-	}
-	break;
+bool MiniAODHelper::PassElectronSpring15Id(const pat::Electron& iElectron, const electronID::electronID iElectronID) const{
+  return PassesElectronCutTable(iElectron, iElectronID, spring15ElectronID);
+}
 
-    default:
-	break;
-    }
 
-    return pass;
+namespace {
+  // MVA value cuts of the categories 3, 4 and 5
+  struct MVAidCuts {
+    float cut0, cut1, cut2;
+  };
+  const MVAidCuts mvaID80Cuts = { 0.988153, 0.967910, 0.841729 };
+  const MVAidCuts mvaID90Cuts = { 0.972153, 0.922126, 0.610764 };
+  // Values from : https://twiki.cern.ch/twiki/bin/view/CMS/MultivariateElectronIdentificationRun2?rev=26
+  const MVAidCuts nonTrigMVAid80Cuts = { 0.967083, 0.929117, 0.726311 };
+  const MVAidCuts nonTrigMVAid90Cuts = { 0.913286, 0.805013, 0.358969 };
+  const MVAidCuts generalPurposeMVA2016WP80Cuts = { 0.941, 0.899, 0.758 };
+  const MVAidCuts generalPurposeMVA2016WP90Cuts = { 0.837, 0.715, 0.357 };
 }
-// adds electron mva output as user float to electrons
+
+
+// MVA values and categories of the electrons
 // you have to run the mva id producer to get the value maps
 // https://twiki.cern.ch/twiki/bin/viewauth/CMS/MultivariateElectronIdentificationRun2#MVA_producer_based_recipe_AN1
+std::vector<ElectronMVAid> MiniAODHelper::GetElectronMVAids(const edm::View<pat::Electron>& electrons, const edm::ValueMap<float>& mvaValues, const edm::ValueMap<int>& mvaCategories) const {
+    std::vector<ElectronMVAid> mvaIDs(electrons.size());
+    for (size_t i = 0; i < electrons.size(); ++i){
+	const edm::Ptr<pat::Electron> electron = electrons.ptrAt(i);
+	mvaIDs[i].index = i;
+	mvaIDs[i].value = mvaValues[electron];
+	mvaIDs[i].category = mvaCategories[electron]; // category of electron (barrel <0.8, barrel >0, endcap)
+    }
+    return mvaIDs;
+}
+
+// adds electron mva output as user float to electrons
 vector<pat::Electron> MiniAODHelper::GetElectronsWithMVAid(edm::Handle<edm::View<pat::Electron> > electrons, edm::Handle<edm::ValueMap<float> > mvaValues, edm::Handle<edm::ValueMap<int> > mvaCategories) const {
-    // Loop over electrons
+    const std::vector<ElectronMVAid> mvaIDs = GetElectronMVAids(*electrons, *mvaValues, *mvaCategories);
     vector<pat::Electron> electrons_with_id;
-    for (size_t i = 0; i < electrons->size(); ++i){
-	// Look up MVA id and category
-	float mvaValue  = (*mvaValues)[electrons->ptrAt(i)]; //  MVA values
-	int mvaCategory = (*mvaCategories)[electrons->ptrAt(i)]; // category of electron (barrel <0.8, barrel >0, endcap)
+    electrons_with_id.reserve(mvaIDs.size());
+    for (const auto& mvaID: mvaIDs){
 	// add mva id to output collections
-	electrons_with_id.push_back(electrons->at(i));
-	electrons_with_id.back().addUserFloat("mvaValue",mvaValue);
-	electrons_with_id.back().addUserInt("mvaCategory",mvaCategory);
+	electrons_with_id.push_back(electrons->at(mvaID.index));
+	electrons_with_id.back().addUserFloat("mvaValue",mvaID.value);
+	electrons_with_id.back().addUserInt("mvaCategory",mvaID.category);
     }
     return electrons_with_id;
 }
+
+
+std::vector<uint64_t>
+MiniAODHelper::EvaluateElectronMVAids(const edm::View<pat::Electron>& electrons, const std::vector<ElectronMVAid>& mvaIDs, const uint64_t ids){
+
+  CheckVertexSetUp();
+
+  std::vector<uint64_t> masks(mvaIDs.size(), 0);
+  if( !(ids & ElectronMVAidIDs()) ) return masks;
+
+  for( unsigned int i=0; i<mvaIDs.size(); ++i ){
+    const pat::Electron& electron = electrons[mvaIDs[i].index];
+    // no electron in the barrel-endcap transition passes any ID
+    if( InElectronCrack(electron) ) continue;
+    masks[i] = EvaluateElectronMVAid(electron, mvaIDs[i], ids);
+  }
+
+  return masks;
+}
+
+
+uint64_t
+MiniAODHelper::ElectronMVAidIDs(){
+  using leptonIDMask::bit;
+  return bit(electronID::electronEndOf15MVA80) | bit(electronID::electronEndOf15MVA80iso0p1) | bit(electronID::electronEndOf15MVA80iso0p15)
+    | bit(electronID::electronEndOf15MVA90) | bit(electronID::electronEndOf15MVA90iso0p1) | bit(electronID::electronEndOf15MVA90iso0p15)
+    | bit(electronID::electronNonTrigMVAid80) | bit(electronID::electronNonTrigMVAid90)
+    | bit(electronID::electronGeneralPurposeMVA2016WP80) | bit(electronID::electronGeneralPurposeMVA2016WP90);
+}
+
+
+uint64_t
+MiniAODHelper::EvaluateElectronMVAid(const pat::Electron& iElectron, const ElectronMVAid& mvaID, const uint64_t ids) const{
+
+  using leptonIDMask::bit;
+  uint64_t mask = 0;
+
+  // the isolations, each computed at most once
+  const uint64_t spring15IsoIDs = bit(electronID::electronEndOf15MVA80iso0p1) | bit(electronID::electronEndOf15MVA80iso0p15)
+    | bit(electronID::electronEndOf15MVA90iso0p1) | bit(electronID::electronEndOf15MVA90iso0p15)
+    | bit(electronID::electronNonTrigMVAid80) | bit(electronID::electronNonTrigMVAid90);
+  const uint64_t spring16IsoIDs = bit(electronID::electronGeneralPurposeMVA2016WP80) | bit(electronID::electronGeneralPurposeMVA2016WP90);
+  const float relIsoSpring15 = (ids & spring15IsoIDs) ? GetElectronRelIso(iElectron, coneSize::R03, corrType::rhoEA, effAreaType::spring15) : 0.;
+  const float relIsoSpring16 = (ids & spring16IsoIDs) ? GetElectronRelIso(iElectron, coneSize::R03, corrType::rhoEA, effAreaType::spring16) : 0.;
+
+  // TODO: what is the correct isolation for electronEndOf15MVA80 and electronEndOf15MVA90?
+  const uint64_t mva80IDs = bit(electronID::electronEndOf15MVA80) | bit(electronID::electronEndOf15MVA80iso0p1) | bit(electronID::electronEndOf15MVA80iso0p15);
+  if( (ids & mva80IDs) && PassesMVAidPreselection(iElectron) && PassesMVAidCuts(mvaID,mvaID80Cuts.cut0,mvaID80Cuts.cut1,mvaID80Cuts.cut2) ){
+    mask |= ids & bit(electronID::electronEndOf15MVA80);
+    if( relIsoSpring15 <= 0.1 ) mask |= ids & bit(electronID::electronEndOf15MVA80iso0p1);
+    if( relIsoSpring15 <= 0.15 ) mask |= ids & bit(electronID::electronEndOf15MVA80iso0p15);
+  }
+  const uint64_t mva90IDs = bit(electronID::electronEndOf15MVA90) | bit(electronID::electronEndOf15MVA90iso0p1) | bit(electronID::electronEndOf15MVA90iso0p15);
+  if( (ids & mva90IDs) && PassesMVAidPreselection(iElectron) && PassesMVAidCuts(mvaID,mvaID90Cuts.cut0,mvaID90Cuts.cut1,mvaID90Cuts.cut2) ){
+    mask |= ids & bit(electronID::electronEndOf15MVA90);
+    if( relIsoSpring15 <= 0.1 ) mask |= ids & bit(electronID::electronEndOf15MVA90iso0p1);
+    if( relIsoSpring15 <= 0.15 ) mask |= ids & bit(electronID::electronEndOf15MVA90iso0p15);
+  }
+
+  if( (ids & bit(electronID::electronNonTrigMVAid80)) && relIsoSpring15 <= 0.15 && PassesMVAidCuts(mvaID,nonTrigMVAid80Cuts.cut0,nonTrigMVAid80Cuts.cut1,nonTrigMVAid80Cuts.cut2) ) mask |= bit(electronID::electronNonTrigMVAid80);
+  if( (ids & bit(electronID::electronNonTrigMVAid90)) && relIsoSpring15 <= 0.15 && PassesMVAidCuts(mvaID,nonTrigMVAid90Cuts.cut0,nonTrigMVAid90Cuts.cut1,nonTrigMVAid90Cuts.cut2) ) mask |= bit(electronID::electronNonTrigMVAid90);
+  if( (ids & bit(electronID::electronGeneralPurposeMVA2016WP80)) && relIsoSpring16 <= 0.15 && PassesMVAidCuts(mvaID,generalPurposeMVA2016WP80Cuts.cut0,generalPurposeMVA2016WP80Cuts.cut1,generalPurposeMVA2016WP80Cuts.cut2) ) mask |= bit(electronID::electronGeneralPurposeMVA2016WP80);
+  if( (ids & bit(electronID::electronGeneralPurposeMVA2016WP90)) && relIsoSpring16 <= 0.15 && PassesMVAidCuts(mvaID,generalPurposeMVA2016WP90Cuts.cut0,generalPurposeMVA2016WP90Cuts.cut1,generalPurposeMVA2016WP90Cuts.cut2) ) mask |= bit(electronID::electronGeneralPurposeMVA2016WP90);
+
+  return mask;
+}
+
+
 bool MiniAODHelper::InECALbarrel(const pat::Electron& iElectron) const{
     return abs(iElectron.superCluster()->position().eta()) < 1.4442;
 }
@@ -2239,80 +2646,128 @@ bool MiniAODHelper::PassesMVAidCuts(const pat::Electron& el, float cut0, float c
 	return false;
     }
     if( b_requirePreselection && !PassesMVAidPreselection(el)) return false;
-    bool pass=false;
-    int category =el.userInt("mvaCategory");
-    float value= el.userFloat("mvaValue");
-//     std::cout<<el.pt()<<" "<<el.eta()<<" "<<category<<" "<<value<<std::endl;
+    const ElectronMVAid mvaID = { 0, el.userFloat("mvaValue"), el.userInt("mvaCategory") };
+    return PassesMVAidCuts(mvaID, cut0, cut1, cut2);
+}
+
+bool MiniAODHelper::PassesMVAidCuts(const ElectronMVAid& mvaID, float cut0, float cut1, float cut2){
     // the categories 0 1 and 2 are for low pT electrons.
-    switch(category){
-	case 0: pass=false; break;
-	case 1: pass=false; break;
-	case 2: pass=false; break;
-        case 3: pass=value>cut0; break;
-        case 4: pass=value>cut1; break;
-        case 5: pass=value>cut2; break;
+    switch(mvaID.category){
+	case 0: return false;
+	case 1: return false;
+	case 2: return false;
+        case 3: return mvaID.value>cut0;
+        case 4: return mvaID.value>cut1;
+        case 5: return mvaID.value>cut2;
 	
-        default: std::cout << "unknown electron mva category pT eta "<< el.pt()<<" "<<el.eta() << std::endl;
+        default: std::cout << "unknown electron mva category " << mvaID.category << std::endl;
     }
-    return pass;
+    return false;
 }
 
 
 bool MiniAODHelper::PassesMVAid80(const pat::Electron& el) const{
-    return PassesMVAidCuts(el,0.988153,0.967910,0.841729);
+    return PassesMVAidCuts(el,mvaID80Cuts.cut0,mvaID80Cuts.cut1,mvaID80Cuts.cut2);
 }
 
 bool MiniAODHelper::PassesMVAid90(const pat::Electron& el) const{
-    return PassesMVAidCuts(el,0.972153,0.922126,0.610764);
+    return PassesMVAidCuts(el,mvaID90Cuts.cut0,mvaID90Cuts.cut1,mvaID90Cuts.cut2);
 }
 
 
 
 bool MiniAODHelper::PassesGeneralPurposeMVA2016WP80(const pat::Electron& el) const{
   const bool DO_NOT_REQUIRE_PRESELECTION = false;
-  return PassesMVAidCuts(el, 0.941 , 0.899 , 0.758 , DO_NOT_REQUIRE_PRESELECTION );// Values from : https://twiki.cern.ch/twiki/bin/view/CMS/MultivariateElectronIdentificationRun2?rev=26
+  return PassesMVAidCuts(el, generalPurposeMVA2016WP80Cuts.cut0, generalPurposeMVA2016WP80Cuts.cut1, generalPurposeMVA2016WP80Cuts.cut2, DO_NOT_REQUIRE_PRESELECTION );
 }
 
 bool MiniAODHelper::PassesGeneralPurposeMVA2016WP90(const pat::Electron& el) const{
   const bool DO_NOT_REQUIRE_PRESELECTION = false;
-  return PassesMVAidCuts(el, 0.837, 0.715, 0.357 , DO_NOT_REQUIRE_PRESELECTION );// Values from : https://twiki.cern.ch/twiki/bin/view/CMS/MultivariateElectronIdentificationRun2?rev=26
+  return PassesMVAidCuts(el, generalPurposeMVA2016WP90Cuts.cut0, generalPurposeMVA2016WP90Cuts.cut1, generalPurposeMVA2016WP90Cuts.cut2, DO_NOT_REQUIRE_PRESELECTION );
 }
 
 
 bool MiniAODHelper::PassesNonTrigMVAid80(const pat::Electron& el) const{
   const bool DO_NOT_REQUIRE_PRESELECTION = false;
-  return PassesMVAidCuts(el,0.967083,0.929117,0.726311, DO_NOT_REQUIRE_PRESELECTION );// Values from : https://twiki.cern.ch/twiki/bin/view/CMS/MultivariateElectronIdentificationRun2?rev=26
+  return PassesMVAidCuts(el, nonTrigMVAid80Cuts.cut0, nonTrigMVAid80Cuts.cut1, nonTrigMVAid80Cuts.cut2, DO_NOT_REQUIRE_PRESELECTION );
 }
 
 bool MiniAODHelper::PassesNonTrigMVAid90(const pat::Electron& el) const{
   const bool DO_NOT_REQUIRE_PRESELECTION = false;
-  return PassesMVAidCuts(el,0.913286, 0.805013, 0.358969, DO_NOT_REQUIRE_PRESELECTION ); // Values from : https://twiki.cern.ch/twiki/bin/view/CMS/MultivariateElectronIdentificationRun2?rev=26
+  return PassesMVAidCuts(el, nonTrigMVAid90Cuts.cut0, nonTrigMVAid90Cuts.cut1, nonTrigMVAid90Cuts.cut2, DO_NOT_REQUIRE_PRESELECTION );
 }
 
 void MiniAODHelper::addVetos(const reco::Candidate &cand) {
   for (unsigned int i = 0, n = cand.numberOfSourceCandidatePtrs(); i < n; ++i) {
     const reco::CandidatePtr &cp = cand.sourceCandidatePtr(i);
-    if (cp.isNonnull() && cp.isAvailable()) vetos_.push_back(&*cp);
+    if (cp.isNonnull() && cp.isAvailable()) {
+      vetos_.push_back(&*cp);
+      int key = PackedCandidateKey(&*cp);
+      if (key >= 0) vetoedKeys_[key] = true;
+    }
   }
 }
 
 void MiniAODHelper::clearVetos() {
   vetos_.clear();
+  vetoedKeys_.assign(allcands_ ? allcands_->size() : 0, false);
 }
 
-float MiniAODHelper::isoSumRaw(const std::vector<const pat::PackedCandidate *> & cands, const reco::Candidate &cand, float dR, float innerR, float threshold, SelfVetoPolicy::SelfVetoPolicy selfVeto, int pdgId) const
-{
-  float dR2 = dR*dR, innerR2 = innerR*innerR;
+// Position of cand in the packed candidate collection of the event, -1 if it is not part of it
+int MiniAODHelper::PackedCandidateKey(const reco::Candidate *cand) const {
+  return PackedCandidateKey(dynamic_cast<const pat::PackedCandidate *>(cand));
+}
 
-  std::vector<const reco::Candidate *> vetos(vetos_);
+int MiniAODHelper::PackedCandidateKey(const pat::PackedCandidate *p) const {
+  if (!p || !allcands_ || allcands_->empty()) return -1;
+  const pat::PackedCandidate *first = allcands_->data();
+  std::less<const pat::PackedCandidate *> less;
+  if (less(p, first) || !less(p, first + allcands_->size())) return -1;
+  return p - first;
+}
+
+// Collect the self-veto keys of cand in scratch.selfKeys and scratch.self,
+// following the policy. Only the bits of the previous call are reset; the
+// bitmap is sized for the event in SetPackedCandidates.
+void MiniAODHelper::FillSelfVetoKeys(const reco::Candidate &cand, SelfVetoPolicy::SelfVetoPolicy selfVeto, IsoScratch& scratch) const {
+  for (unsigned int key : scratch.selfKeys) scratch.self[key] = false;
+  scratch.selfKeys.clear();
+  for (unsigned int i = 0, n = cand.numberOfSourceCandidatePtrs(); i < n; ++i) {
+    if (selfVeto == SelfVetoPolicy::selfVetoNone) break;
+    const reco::CandidatePtr &cp = cand.sourceCandidatePtr(i);
+    if (cp.isNonnull() && cp.isAvailable()) {
+      int key = PackedCandidateKey(&*cp);
+      if (key >= 0) {
+        scratch.selfKeys.push_back(key);
+        scratch.self[key] = true;
+      }
+      if (selfVeto == SelfVetoPolicy::selfVetoFirst) break;
+    }
+  }
+}
+
+bool MiniAODHelper::IsVetoed(const unsigned int key, const IsoScratch& scratch) const {
+  return vetoedKeys_[key] || scratch.self[key];
+}
+
+bool MiniAODHelper::IsVetoedCandidate(const reco::Candidate *c, const reco::Candidate &cand, SelfVetoPolicy::SelfVetoPolicy selfVeto) const {
+  if (std::find(vetos_.begin(), vetos_.end(), c) != vetos_.end()) return true;
   for (unsigned int i = 0, n = cand.numberOfSourceCandidatePtrs(); i < n; ++i) {
     if (selfVeto == SelfVetoPolicy::selfVetoNone) break;
     const reco::CandidatePtr &cp = cand.sourceCandidatePtr(i);
     if (cp.isNonnull() && cp.isAvailable()) {
-      vetos.push_back(&*cp);
+      if (&*cp == c) return true;
       if (selfVeto == SelfVetoPolicy::selfVetoFirst) break;
     }
   }
+  return false;
+}
+
+float MiniAODHelper::isoSumRaw(const std::vector<const pat::PackedCandidate *> & cands, const reco::Candidate &cand, float dR, float innerR, float threshold, SelfVetoPolicy::SelfVetoPolicy selfVeto, int pdgId) const
+{
+  float dR2 = dR*dR, innerR2 = innerR*innerR;
+
+  FillSelfVetoKeys(cand, selfVeto, isoScratch_);
 
   typedef std::vector<const pat::PackedCandidate *>::const_iterator IT;
   IT candsbegin = std::lower_bound(cands.begin(), cands.end(), cand.eta() - dR, ByEta());
@@ -2327,16 +2782,67 @@ float MiniAODHelper::isoSumRaw(const std::vector<const pat::PackedCandidate *> &
     // cone
     float mydr2 = reco::deltaR2(**icharged, cand);
     if (mydr2 >= dR2 || mydr2 < innerR2) continue;
-    // veto
-    if (std::find(vetos.begin(), vetos.end(), *icharged) != vetos.end()) {
-      continue;
-    }
+    // veto, by key; candidates that are not part of the collection of
+    // SetPackedCandidates can only be compared by address
+    int key = PackedCandidateKey(*icharged);
+    if (key >= 0 ? IsVetoed(key, isoScratch_) : IsVetoedCandidate(*icharged, cand, selfVeto)) continue;
     // add to sum
     isosum += (*icharged)->pt();
   }
   return isosum;
 }
 
+// Same as above, but only the grid cells overlapping the cone are visited,
+// and the cone selection runs on the unpacked candidate arrays. Candidates
+// close to a cone boundary are decided with the exact double precision
+// cuts, and accepted candidates are summed in eta order, so the result is
+// identical to the band scan over the eta-sorted collection. Vetoes are
+// looked up by candidate key in the per-event veto bitmap. With puppiWeighted
+// each candidate enters with pt times its PUPPI weight.
+float MiniAODHelper::isoSumRaw(const PackedCandidateIndex & cands, const reco::Candidate &cand, float dR, float innerR, float threshold, SelfVetoPolicy::SelfVetoPolicy selfVeto, int pdgId, bool puppiWeighted) const
+{
+  return isoSumRaw(isoScratch_, cands, cand, dR, innerR, threshold, selfVeto, pdgId, puppiWeighted);
+}
+
+float MiniAODHelper::isoSumRaw(IsoScratch& scratch, const PackedCandidateIndex & cands, const reco::Candidate &cand, float dR, float innerR, float threshold, SelfVetoPolicy::SelfVetoPolicy selfVeto, int pdgId, bool puppiWeighted) const
+{
+  float dR2 = dR*dR, innerR2 = innerR*innerR;
+
+  FillSelfVetoKeys(cand, selfVeto, scratch);
+
+  // eta band of the lower_bound/upper_bound search in the overload above
+  float etaLo = cand.eta() - dR, etaHi = cand.eta() + dR;
+  float candEta = cand.eta(), candPhi = cand.phi();
+  float minPt = threshold > 0 ? threshold : 0;
+
+  scratch.accepted.clear();
+  scratch.recheck.clear();
+  cands.visitCone(etaLo, etaHi, cand.phi(), dR, [&] (unsigned int begin, unsigned int end) {
+    cands.selectInCone(begin, end, candEta, candPhi, dR2, innerR2, minPt, pdgId, scratch.accepted, scratch.recheck);
+  });
+  for (unsigned int i : scratch.recheck) {
+    const pat::PackedCandidate *c = cands.cand(i);
+    if (c->eta() < etaLo || etaHi < c->eta()) continue;
+    float mydr2 = reco::deltaR2(*c, cand);
+    if (mydr2 >= dR2 || mydr2 < innerR2) continue;
+    scratch.accepted.push_back(i);
+  }
+
+  scratch.hits.clear();
+  for (unsigned int i : scratch.accepted) {
+    // veto
+    if (IsVetoed(cands.key(i), scratch)) continue;
+    double pt = cands.pt(i);
+    if (puppiWeighted) pt *= cands.puppiWeight(i);
+    scratch.hits.push_back(std::make_pair(cands.rank(i), pt));
+  }
+
+  std::sort(scratch.hits.begin(), scratch.hits.end());
+  double isosum = 0;
+  for (const auto& hit : scratch.hits) isosum += hit.second;
+  return isosum;
+}
+
 //// tt+X categorization -----------------------------
 //// tt+b:  additionalJetEventId = 51
 //// tt+2b:  additionalJetEventId = 52
@@ -2802,94 +3308,168 @@ std::vector<pat::Jet> MiniAODHelper::GetDeltaRCleanedJets(
 
 	std::vector<pat::Jet> outputJets;
 
-	for( std::vector<pat::Jet>::const_iterator iJet = inputJets.begin(); iJet!=inputJets.end(); ++iJet ){
-
-	  bool isOverlap = false;
+	for( const auto& i: GetDeltaRCleanedJetIndices(inputJets, deltaRCut, inputElectrons, inputMuons) ) outputJets.push_back(inputJets[i]);
 
-	  TLorentzVector jet_p4;
-	  jet_p4.SetPxPyPzE(iJet->px(),iJet->py(),iJet->pz(),iJet->energy());
 
-	  for( std::vector<pat::Electron>::const_iterator iEle = inputElectrons.begin(); iEle != inputElectrons.end(); iEle++ ){
-	    TLorentzVector ele_p4;
-	    ele_p4.SetPxPyPzE(iEle->px(),iEle->py(),iEle->pz(),iEle->energy());
-	    double delta_tmp = jet_p4.DeltaR(ele_p4);
-	    if(delta_tmp < deltaRCut){
-	      isOverlap = true;
-	      break;
-	    }
-	  }
+	return outputJets;
+}
 
-	  if( isOverlap ) continue;
+/// JER function
 
-	  for( std::vector<pat::Muon>::const_iterator iMuon = inputMuons.begin(); iMuon != inputMuons.end(); iMuon++ ){
-	    TLorentzVector muon_p4;
-	    muon_p4.SetPxPyPzE(iMuon->px(),iMuon->py(),iMuon->pz(),iMuon->energy());
-	    double delta_tmp = jet_p4.DeltaR(muon_p4);
-	    if(delta_tmp < deltaRCut){
-	      isOverlap = true;
-	      break;
-	    }
-	  }
+// Matches through the gen jet index of the event, see GetGenJetIndex
+bool MiniAODHelper::GenJet_Match(const edm::Event& event, const pat::Jet& inputJet, const edm::Handle<reco::GenJetCollection>& genjets, reco::GenJet& matched_genjet, const double& Rcone) {
 
-	  if( isOverlap ) continue;
+  if( !genjets.isValid() ) return false;
 
-	  outputJets.push_back(*iJet);
+  const reco::GenJet* match = MatchGenJet(inputJet.pt(), inputJet.eta(), inputJet.phi(), GetJERResolution(inputJet.pt(), inputJet.eta()), genjets, GetGenJetIndex(event,genjets), Rcone);
+  if( !match ) return false;
+  matched_genjet = *match;
+  return true;
+}
 
-	}
+// Without the event the index cannot be cached, it is built for this call
+bool MiniAODHelper::GenJet_Match(const pat::Jet& inputJet, const edm::Handle<reco::GenJetCollection>& genjets, reco::GenJet& matched_genjet, const double& Rcone) {
 
+  if( !genjets.isValid() ) return false;
 
-	return outputJets;
+  GenJetIndex index;
+  index.build(*genjets);
+  const reco::GenJet* match = MatchGenJet(inputJet.pt(), inputJet.eta(), inputJet.phi(), GetJERResolution(inputJet.pt(), inputJet.eta()), genjets, index, Rcone);
+  if( !match ) return false;
+  matched_genjet = *match;
+  return true;
 }
 
-/// JER function
+// Same as GenJet_Match, for a jet with the given kinematics and pt resolution
+// (GetJERResolution). index must be built from *genjets. Returns the matched
+// gen jet, or 0 if there is none.
+const reco::GenJet* MiniAODHelper::MatchGenJet(const double pt, const double eta, const double phi, const float resolution, const edm::Handle<reco::GenJetCollection>& genjets, const GenJetIndex& index, const double Rcone) {
 
-bool MiniAODHelper::GenJet_Match(const pat::Jet& inputJet, const edm::Handle<reco::GenJetCollection>& genjets, reco::GenJet& matched_genjet, const double& Rcone) {
+  if( !genjets.isValid() )  return 0;
 
-        if( !genjets.isValid() )  return false;
-
-	double dpt_min=99999;
-    	double dpt;
-	double dR;
-	int genjet_match = 0;
-
-	// checking which genjets have dR < 0.2 and dpT < 3*sigma_mc for this particular jet
-	// if multiple genjets found satisfying this, then select the one with dpT minimum
-
-	for (reco::GenJetCollection::const_iterator iter=genjets->begin();iter!=genjets->end();++iter){
-      	dpt = fabs(inputJet.pt()-iter->pt());
-      	dR  = DeltaR( &inputJet , iter );
-   		if (dR<(Rcone/2)) {
-   			if ( jetdPtMatched(inputJet,*iter) ) {
-				genjet_match = 1;
-    				if (dpt <= dpt_min) {
-    					matched_genjet = *(iter);
-    					dpt_min = dpt;
-    				}
-    			}
-    		}
-	}
+  // checking which genjets have dR < 0.2 and dpT < 3*sigma_mc for this particular jet
+  // if multiple genjets found satisfying this, then select the one with dpT minimum
+  const int match = index.match(pt, eta, phi, Rcone, 3 * resolution * pt);
+
+  return match < 0 ? 0 : &(*genjets)[match];
+}
 
-	if (genjet_match==1)
-		return true;
-	else
-		return false;
+// Gen jet index of the event, built on the first request per event and gen jet collection
+const GenJetIndex& MiniAODHelper::GetGenJetIndex(const edm::Event& event, const edm::Handle<reco::GenJetCollection>& genjets) {
+  const reco::GenJetCollection* product = genjets.isValid() ? genjets.product() : 0;
+  if( product != genJetIndexProduct_ || event.id() != genJetIndexEvent_ ){
+    genJetIndex_.clear();
+    if( product ) genJetIndex_.build(*product);
+    genJetIndexProduct_ = product;
+    genJetIndexEvent_ = event.id();
+  }
+  return genJetIndex_;
 }
 
 bool MiniAODHelper::jetdPtMatched(const pat::Jet& inputJet, const reco::GenJet& genjet) {
+  return jetdPtMatched(inputJet.pt(), inputJet.eta(), genjet.pt());
+}
 
-  JME::JetParameters param;
-  param.setJetPt (inputJet.pt());
-  param.setJetEta(inputJet.eta());
-  param.setRho( useRho );
+bool MiniAODHelper::jetdPtMatched(const double pt, const double eta, const double genpt) {
 
-  const float reso = JER_ak4_resolution.getResolution( param );
   // check if the delta_pt is within 3-sigma.
-  if( fabs( inputJet.pt() - genjet.pt() ) < 3 * reso * inputJet.pt() ) {
+  if( fabs( pt - genpt ) < 3 * GetJERResolution(pt,eta) * pt ) {
     return true;
   }
   return false;
 }
 
+// Relative jet pt resolution, from the compiled table when the payload could
+// be compiled (see SetJER_SF_Tool)
+float MiniAODHelper::GetJERResolution(const double pt, const double eta) const {
+
+  if( jerTable_.hasResolution() ) return jerTable_.resolution(pt, eta, useRho);
+
+  JME::JetParameters param;
+  param.setJetPt (pt);
+  param.setJetEta(eta);
+  param.setRho( useRho );
+
+  return JER_ak4_resolution.getResolution( param );
+}
+
+// Core resolution scale factor for the JER variation iSysType
+float MiniAODHelper::GetJERScaleFactor(const double eta, const Systematics::Type iSysType) const {
+
+  const Variation variation
+    = (iSysType == Systematics::JERup   ) ?     Variation::UP
+    : (    iSysType == Systematics::JERdown ) ? Variation::DOWN
+    :                                       Variation::NOMINAL;
+
+  if( jerTable_.hasScaleFactor() ) {
+    float sf[3];
+    jerTable_.scaleFactors(eta, sf);
+    return sf[static_cast<size_t>(variation)];
+  }
+
+  JME::JetParameters jer_param = { {JME::Binning::JetEta, eta} } ;
+  return JER_ak4_resolutionSF.getScaleFactor(jer_param, variation);
+}
+
+// JER rescale factor of a jet with the given pt and eta
+//
+// instruction from https://twiki.cern.ch/twiki/bin/view/CMSPublic/WorkBookJetEnergyResolution?rev=15#CMSSW_7_6_X_and_CMSSW_8_0X
+// Jets without matched gen jet are smeared stochastically with gaus, a standard
+// normal deviate.
+double MiniAODHelper::GetJERRescaleFactor(const double pt, const double eta, const float resolution, const reco::GenJet* matched_genjet, const Systematics::Type iSysType, const double gaus) {
+
+  const double JET_core_resolution_scale_factor = GetJERScaleFactor(eta, iSysType);
+
+  if ( matched_genjet ) {
+    return max( 0.0,
+		1.0 + ( JET_core_resolution_scale_factor - 1.0  ) * ( pt - matched_genjet->pt() ) / pt ) ;
+    // Reference of this equation : https://github.com/cms-sw/cmssw/blob/CMSSW_8_0_25/PhysicsTools/PatUtils/interface/SmearedJetProducerT.h#L237
+  }
+
+  return max( 0.0,
+	      1.0
+	      + resolution * gaus // Gaus( 0, resolution )
+	      * sqrt( max ( 0.0 , - 1.0 + JET_core_resolution_scale_factor * JET_core_resolution_scale_factor) )
+	      );
+  //
+  // note : distribution of Gaus( 0, sigma ) * A and Gaus( 0, sigma * A ) result in the same.
+  //  
+}
+
+// The deviate is a pure function of the event id, the jet and the seed
+// (counter-based generator), so the smearing does not depend on the processing
+// order and the same jet is smeared identically by all the correction
+// functions. It does not depend on the systematic either: JERup/down only
+// change the scale factor, and the JES variations keep the nominal smearing.
+// The jet enters through the bits of its uncorrected eta and phi, which do not
+// depend on its position in the collection.
+double MiniAODHelper::GetJERGaussian(const edm::Event& event, const float eta, const float phi) const {
+  const CounterBasedRNG::Key key = {{ JERJetKey(eta,phi), jerSeed_ }};
+  return CounterBasedRNG::gaussian(JERCounter(event), key);
+}
+
+void MiniAODHelper::GetJERGaussians(const edm::Event& event, const std::vector<pat::Jet>& jets, std::vector<double>& out) const {
+  std::vector<uint32_t> jetKeys(jets.size());
+  for( unsigned int i=0; i<jets.size(); ++i ) jetKeys[i] = JERJetKey(jets[i].eta(),jets[i].phi());
+  out.resize(jets.size());
+  if( !out.empty() ) CounterBasedRNG::gaussians(JERCounter(event), &jetKeys[0], jerSeed_, jets.size(), &out[0]);
+}
+
+uint32_t MiniAODHelper::JERJetKey(const float eta, const float phi) {
+  uint32_t etaBits, phiBits;
+  memcpy(&etaBits, &eta, sizeof(etaBits));
+  memcpy(&phiBits, &phi, sizeof(phiBits));
+  return etaBits ^ (phiBits * 0x9E3779B1);
+}
+
+// The event id as counter; the jet and the seed are the two key words
+CounterBasedRNG::Counter MiniAODHelper::JERCounter(const edm::Event& event) {
+  const edm::EventID& id = event.id();
+  const uint64_t eventNumber = id.event();
+  const CounterBasedRNG::Counter counter = {{ uint32_t(eventNumber), uint32_t(eventNumber >> 32), uint32_t(id.luminosityBlock()), uint32_t(id.run()) }};
+  return counter;
+}
+
 double MiniAODHelper::getJERfactor( const int returnType, const double jetAbsETA, const double genjetPT, const double recojetPT){
 
   // CheckSetUp();
@@ -0,0 +1,180 @@
+// Per-event eta-phi binned index over packed PF candidates
+
+// system include files
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "MiniAOD/MiniAODHelper/interface/PackedCandidateIndex.h"
+
+// The AVX2 cone selection is compiled for its own target and picked at run
+// time, so the library still runs on CPUs without AVX2
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define PACKEDCANDIDATEINDEX_AVX2
+#endif
+
+
+PackedCandidateIndex::PackedCandidateIndex()
+  : cellStart_(nEtaBins_*nPhiBins_+1, 0) {}
+
+
+void PackedCandidateIndex::clear() {
+  cands_.clear();
+  rank_.clear();
+  key_.clear();
+  eta_.clear();
+  phi_.clear();
+  pt_.clear();
+  puppiWeight_.clear();
+  absPdgId_.clear();
+  std::fill(cellStart_.begin(), cellStart_.end(), 0);
+}
+
+
+// Candidates beyond the grid acceptance are collected in the edge bins,
+// so the binning stays monotonic in eta
+int PackedCandidateIndex::etaBin(const double eta) const {
+  if( !(eta > etaMin_) ) return 0;
+  if( eta >= etaMax_ ) return nEtaBins_-1;
+  const int bin = int((eta-etaMin_)/(etaMax_-etaMin_)*nEtaBins_);
+  return bin < nEtaBins_ ? bin : nEtaBins_-1;
+}
+
+
+int PackedCandidateIndex::phiBin(const double phi) const {
+  const int bin = int(std::floor((phi+M_PI)/(2*M_PI)*nPhiBins_));
+  return ((bin % nPhiBins_) + nPhiBins_) % nPhiBins_;
+}
+
+
+// Counting sort into cells. Filling in input (eta) order keeps every cell
+// eta-ordered, which lets isolation sums be accumulated in the same order
+// as a plain scan over the eta-sorted input. Each candidate is unpacked
+// exactly once here.
+void PackedCandidateIndex::build(const std::vector<const pat::PackedCandidate *>& etaSortedCands, const pat::PackedCandidate * first) {
+  const unsigned int n = etaSortedCands.size();
+  const unsigned int nCells = nEtaBins_*nPhiBins_;
+
+  std::vector<unsigned int> cell(n);
+  std::fill(cellStart_.begin(), cellStart_.end(), 0);
+  for( unsigned int i=0; i<n; ++i ){
+    const pat::PackedCandidate *p = etaSortedCands[i];
+    cell[i] = etaBin(p->eta())*nPhiBins_ + phiBin(p->phi());
+    ++cellStart_[cell[i]+1];
+  }
+  for( unsigned int c=0; c<nCells; ++c ) cellStart_[c+1] += cellStart_[c];
+
+  cands_.resize(n);
+  rank_.resize(n);
+  key_.resize(n);
+  eta_.resize(n);
+  phi_.resize(n);
+  pt_.resize(n);
+  puppiWeight_.resize(n);
+  absPdgId_.resize(n);
+  std::vector<unsigned int> fill(cellStart_.begin(), cellStart_.end()-1);
+  for( unsigned int i=0; i<n; ++i ){
+    const pat::PackedCandidate *p = etaSortedCands[i];
+    const unsigned int pos = fill[cell[i]]++;
+    cands_[pos] = p;
+    rank_[pos] = i;
+    key_[pos] = p - first;
+    eta_[pos] = p->eta();
+    phi_[pos] = p->phi();
+    pt_[pos] = p->pt();
+    puppiWeight_[pos] = p->puppiWeight();
+    absPdgId_[pos] = std::abs(p->pdgId());
+  }
+}
+
+
+#ifdef PACKEDCANDIDATEINDEX_AVX2
+namespace {
+
+  // selectInCone over blocks of 8 positions from begin, returns the first
+  // position it did not handle. The masks reproduce the scalar comparisons
+  // lane by lane, so both paths select the same positions in the same order.
+  __attribute__((target("avx2")))
+  unsigned int selectInConeAVX2(const float* etas, const float* phis, const float* pts, const int* absPdgIds,
+				const unsigned int begin, const unsigned int end,
+				const float eta, const float phi, const float dR2, const float innerR2,
+				const float threshold, const int pdgId, const float tolerance,
+				std::vector<unsigned int>& accepted, std::vector<unsigned int>& recheck) {
+    const bool checkInner = (innerR2 > 0);
+    const __m256 vEta = _mm256_set1_ps(eta);
+    const __m256 vPhi = _mm256_set1_ps(phi);
+    const __m256 vDR2 = _mm256_set1_ps(dR2);
+    const __m256 vInnerR2 = _mm256_set1_ps(innerR2);
+    const __m256 vThreshold = _mm256_set1_ps(threshold);
+    const __m256 vTolerance = _mm256_set1_ps(tolerance);
+    const __m256 vPi = _mm256_set1_ps(float(M_PI));
+    const __m256 vMinusPi = _mm256_set1_ps(float(-M_PI));
+    const __m256 vTwoPi = _mm256_set1_ps(float(2*M_PI));
+    const __m256 vAbsMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    const __m256i vPdgId = _mm256_set1_epi32(pdgId);
+
+    unsigned int i = begin;
+    for( ; i+8<=end; i+=8 ){
+      const __m256 dEta = _mm256_sub_ps(_mm256_loadu_ps(etas+i), vEta);
+      __m256 dPhi = _mm256_sub_ps(_mm256_loadu_ps(phis+i), vPhi);
+      const __m256 above = _mm256_cmp_ps(dPhi, vPi, _CMP_GT_OQ);
+      const __m256 below = _mm256_cmp_ps(dPhi, vMinusPi, _CMP_LT_OQ);
+      dPhi = _mm256_add_ps(_mm256_sub_ps(dPhi, _mm256_and_ps(above, vTwoPi)), _mm256_and_ps(below, vTwoPi));
+      const __m256 d2 = _mm256_add_ps(_mm256_mul_ps(dEta, dEta), _mm256_mul_ps(dPhi, dPhi));
+
+      __m256 pass = _mm256_cmp_ps(_mm256_loadu_ps(pts+i), vThreshold, _CMP_NLT_UQ);
+      if( pdgId > 0 ){
+	const __m256i ids = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(absPdgIds+i));
+	pass = _mm256_and_ps(pass, _mm256_castsi256_ps(_mm256_cmpeq_epi32(ids, vPdgId)));
+      }
+      __m256 near = _mm256_cmp_ps(_mm256_and_ps(_mm256_sub_ps(d2, vDR2), vAbsMask), vTolerance, _CMP_LT_OQ);
+      __m256 inCone = _mm256_cmp_ps(d2, vDR2, _CMP_LT_OQ);
+      if( checkInner ){
+	near = _mm256_or_ps(near, _mm256_cmp_ps(_mm256_and_ps(_mm256_sub_ps(d2, vInnerR2), vAbsMask), vTolerance, _CMP_LT_OQ));
+	inCone = _mm256_and_ps(inCone, _mm256_cmp_ps(d2, vInnerR2, _CMP_NLT_UQ));
+      }
+
+      unsigned int acceptBits = _mm256_movemask_ps(_mm256_andnot_ps(near, _mm256_and_ps(inCone, pass)));
+      unsigned int recheckBits = _mm256_movemask_ps(_mm256_and_ps(near, pass));
+      for( ; acceptBits; acceptBits &= acceptBits-1 ) accepted.push_back(i+__builtin_ctz(acceptBits));
+      for( ; recheckBits; recheckBits &= recheckBits-1 ) recheck.push_back(i+__builtin_ctz(recheckBits));
+    }
+    return i;
+  }
+
+  bool hasAVX2() {
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+  }
+
+}
+#endif
+
+
+void PackedCandidateIndex::selectInCone(const unsigned int begin, const unsigned int end,
+					const float eta, const float phi, const float dR2, const float innerR2,
+					const float threshold, const int pdgId,
+					std::vector<unsigned int>& accepted, std::vector<unsigned int>& recheck) const {
+  const float tolerance = rounding(dR2);
+  const bool checkInner = (innerR2 > 0);
+
+  unsigned int i = begin;
+#ifdef PACKEDCANDIDATEINDEX_AVX2
+  if( hasAVX2() ) i = selectInConeAVX2(eta_.data(), phi_.data(), pt_.data(), absPdgId_.data(), begin, end, eta, phi, dR2, innerR2, threshold, pdgId, tolerance, accepted, recheck);
+#endif
+
+  // scalar fallback, also handles the remainder of the vector loop
+  for( ; i<end; ++i ){
+    if( pt_[i] < threshold ) continue;
+    if( pdgId > 0 && absPdgId_[i] != pdgId ) continue;
+    const float d2 = deltaR2(i, eta, phi);
+    if( std::fabs(d2-dR2) < tolerance || (checkInner && std::fabs(d2-innerR2) < tolerance) ){
+      recheck.push_back(i);
+    }
+    else if( d2 < dR2 && !(checkInner && d2 < innerR2) ){
+      accepted.push_back(i);
+    }
+  }
+}
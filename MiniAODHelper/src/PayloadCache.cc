@@ -0,0 +1,364 @@
+// Precompiled binary form of the JEC/JER txt payloads
+
+// system include files
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "FWCore/Utilities/interface/Exception.h"
+
+#include "MiniAOD/MiniAODHelper/interface/PayloadCache.h"
+
+
+namespace {
+  const char blobMagic[8] = {'M','A','O','D','J','E','C','\0'};
+  const uint32_t blobByteOrder = 0x01020304; // blobs are written in native byte order
+
+  // Layout: Header, then the payload of payloadSize bytes,
+  //   uint32 nSections
+  //   per section: uint32 length + name, uint32 length + definitions, uint32 nRows,
+  //                per row: uint32 n + n doubles
+  struct Header {
+    char magic[8];
+    uint32_t byteOrder;
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    uint64_t payloadSize;
+    uint64_t payloadChecksum;
+  };
+
+  // 64-bit FNV-1a
+  uint64_t checksum(const char* data, const size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for( size_t i=0; i<size; ++i ){
+      hash ^= static_cast<unsigned char>(data[i]);
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  // Read-only mapping of a whole file, null if it cannot be mapped
+  std::shared_ptr<const char> mapFile(const std::string& fileName, size_t& size) {
+    size = 0;
+    const int fd = ::open(fileName.c_str(), O_RDONLY);
+    if( fd < 0 ) return std::shared_ptr<const char>();
+    struct stat st;
+    if( ::fstat(fd, &st) != 0 || st.st_size <= 0 ){
+      ::close(fd);
+      return std::shared_ptr<const char>();
+    }
+    const size_t length = st.st_size;
+    void* address = ::mmap(0, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if( address == MAP_FAILED ) return std::shared_ptr<const char>();
+    size = length;
+    return std::shared_ptr<const char>(static_cast<const char*>(address), [length](const char* p) {
+	::munmap(const_cast<char*>(p), length);
+      });
+  }
+
+  // Size and modification time of the txt file, which identify the version
+  // of it that a blob was made from without reading it
+  bool sourceStamp(const std::string& txtFile, uint64_t& size, int64_t& mtime) {
+    struct stat st;
+    if( ::stat(txtFile.c_str(), &st) != 0 ) return false;
+    size = st.st_size;
+    mtime = st.st_mtime;
+    return true;
+  }
+
+  // Bounds-checked sequential reads from the payload
+  class Reader {
+  public:
+    Reader(const char* data, const size_t size, const size_t pos = 0) : data_(data), size_(size), pos_(pos) {}
+    size_t pos() const { return pos_; }
+    bool skip(const size_t n) {
+      if( n > size_-pos_ ) return false;
+      pos_ += n;
+      return true;
+    }
+    template <typename T> bool read(T& value) {
+      if( sizeof(T) > size_-pos_ ) return false;
+      std::memcpy(&value, data_+pos_, sizeof(T));
+      pos_ += sizeof(T);
+      return true;
+    }
+    bool read(std::string& value) {
+      uint32_t n;
+      if( !read(n) || n > size_-pos_ ) return false;
+      value.assign(data_+pos_, n);
+      pos_ += n;
+      return true;
+    }
+  private:
+    const char* data_;
+    size_t size_;
+    size_t pos_;
+  };
+
+  template <typename T> void append(std::string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  void append(std::string& out, const std::string& value) {
+    append(out, uint32_t(value.size()));
+    out.append(value);
+  }
+}
+
+
+std::string PayloadCache::blobName(const std::string& txtFile) {
+  const std::string extension = ".txt";
+  if( txtFile.size() >= extension.size() && txtFile.compare(txtFile.size()-extension.size(), extension.size(), extension) == 0 ){
+    return txtFile.substr(0, txtFile.size()-extension.size()) + ".bin";
+  }
+  return txtFile + ".bin";
+}
+
+
+// Sections and records are taken from JetCorrectorParameters itself, so the
+// blob holds exactly the values a txt parse would give
+bool PayloadCache::readText(const std::string& txtFile, std::vector<Section>& sections, std::string& error) {
+  sections.clear();
+
+  std::ifstream input(txtFile.c_str());
+  if( !input ){
+    error = "cannot read " + txtFile;
+    return false;
+  }
+
+  std::vector<std::string> names;
+  std::map<std::string, std::string> definitions;
+  std::vector<std::vector<double> > table;
+  std::string current = "";
+  std::string line;
+  while( std::getline(input, line) ){
+    const size_t first = line.find_first_not_of(" \t\r");
+    if( first == std::string::npos || line[first] == '#' ) continue;
+    if( line[first] == '[' ){
+      const size_t end = line.find(']', first);
+      if( end == std::string::npos ){
+	error = "malformed section header '" + line + "'";
+	return false;
+      }
+      current = line.substr(first+1, end-first-1);
+      names.push_back(current);
+      continue;
+    }
+    if( line[first] == '{' ){
+      const size_t end = line.find('}', first);
+      if( end == std::string::npos ){
+	error = "malformed definitions '" + line + "'";
+	return false;
+      }
+      definitions[current] = line.substr(first+1, end-first-1);
+      continue;
+    }
+    if( !definitions.empty() ) continue; // records are read by JetCorrectorParameters
+
+    std::istringstream tokens(line);
+    std::vector<double> row;
+    std::string token;
+    while( tokens >> token ){
+      std::istringstream number(token);
+      double value;
+      if( !(number >> value) || !number.eof() ){
+	error = "not a number: '" + token + "'";
+	return false;
+      }
+      row.push_back(value);
+    }
+    table.push_back(row);
+  }
+
+  if( definitions.empty() ){ // plain table
+    if( !names.empty() ){
+      error = "sections without definitions";
+      return false;
+    }
+    sections.resize(1);
+    sections[0].rows.swap(table);
+    return true;
+  }
+
+  if( names.empty() ) names.push_back("");
+  for( std::vector<std::string>::const_iterator name = names.begin(); name != names.end(); ++name ){
+    if( definitions.find(*name) == definitions.end() ){
+      error = "no definitions in section '" + *name + "'";
+      return false;
+    }
+    try {
+      const JetCorrectorParameters parameters(txtFile, *name);
+      const unsigned int nVar = parameters.definitions().nBinVar();
+
+      Section section;
+      section.name = *name;
+      section.definitions = definitions[*name];
+      section.rows.resize(parameters.size());
+      for( unsigned int i=0; i<parameters.size(); ++i ){
+	const JetCorrectorParameters::Record& record = parameters.record(i);
+	std::vector<double>& row = section.rows[i];
+	for( unsigned int v=0; v<nVar; ++v ) row.push_back(record.xMin(v));
+	for( unsigned int v=0; v<nVar; ++v ) row.push_back(record.xMax(v));
+	row.insert(row.end(), record.parameters().begin(), record.parameters().end());
+      }
+      sections.push_back(section);
+    } catch (cms::Exception& e) {
+      error = "section '" + *name + "': " + e.what();
+      return false;
+    }
+  }
+  return true;
+}
+
+
+bool PayloadCache::compile(const std::string& txtFile, std::string& error) {
+  std::vector<Section> sections;
+  if( !readText(txtFile, sections, error) ) return false;
+
+  std::string payload;
+  append(payload, uint32_t(sections.size()));
+  for( std::vector<Section>::const_iterator section = sections.begin(); section != sections.end(); ++section ){
+    append(payload, section->name);
+    append(payload, section->definitions);
+    append(payload, uint32_t(section->rows.size()));
+    for( std::vector<std::vector<double> >::const_iterator row = section->rows.begin(); row != section->rows.end(); ++row ){
+      append(payload, uint32_t(row->size()));
+      payload.append(reinterpret_cast<const char*>(row->data()), row->size()*sizeof(double));
+    }
+  }
+
+  Header header;
+  std::memcpy(header.magic, blobMagic, sizeof(blobMagic));
+  header.byteOrder = blobByteOrder;
+  header.version = version;
+  if( !sourceStamp(txtFile, header.sourceSize, header.sourceMtime) ){
+    error = "cannot stat " + txtFile;
+    return false;
+  }
+  header.payloadSize = payload.size();
+  header.payloadChecksum = checksum(payload.data(), payload.size());
+
+  // write next to the final name and rename, so that readers never see a partial blob
+  const std::string blobFile = blobName(txtFile);
+  const std::string tmpFile = blobFile + ".tmp";
+  {
+    std::ofstream output(tmpFile.c_str(), std::ios::binary | std::ios::trunc);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.write(payload.data(), payload.size());
+    if( !output ){
+      error = "cannot write " + tmpFile;
+      return false;
+    }
+  }
+  if( std::rename(tmpFile.c_str(), blobFile.c_str()) != 0 ){
+    std::remove(tmpFile.c_str());
+    error = "cannot write " + blobFile;
+    return false;
+  }
+  return true;
+}
+
+
+bool PayloadCache::open(const std::string& txtFile) {
+  close();
+
+  size_t size = 0;
+  std::shared_ptr<const char> data = mapFile(blobName(txtFile), size);
+  if( !data || size < sizeof(Header) ) return false;
+
+  Header header;
+  std::memcpy(&header, data.get(), sizeof(header));
+  if( std::memcmp(header.magic, blobMagic, sizeof(blobMagic)) != 0 || header.byteOrder != blobByteOrder ||
+      header.version != version || header.payloadSize != size-sizeof(Header) ) return false;
+
+  uint64_t sourceSize;
+  int64_t sourceMtime;
+  if( !sourceStamp(txtFile, sourceSize, sourceMtime) || sourceSize != header.sourceSize || sourceMtime != header.sourceMtime ) return false;
+
+  const char* payload = data.get()+sizeof(Header);
+  const size_t payloadSize = header.payloadSize;
+  if( checksum(payload, payloadSize) != header.payloadChecksum ) return false;
+
+  // index the sections; the rows are only read on request
+  std::map<std::string, SectionIndex> sections;
+  Reader reader(payload, payloadSize);
+  uint32_t nSections;
+  if( !reader.read(nSections) ) return false;
+  for( uint32_t i=0; i<nSections; ++i ){
+    std::string name;
+    SectionIndex index;
+    uint32_t nRows;
+    if( !reader.read(name) || !reader.read(index.definitions) ) return false;
+    index.rows = reader.pos();
+    if( !reader.read(nRows) ) return false;
+    for( uint32_t row=0; row<nRows; ++row ){
+      uint32_t n;
+      if( !reader.read(n) || !reader.skip(size_t(n)*sizeof(double)) ) return false;
+    }
+    sections[name] = index;
+  }
+  if( reader.pos() != payloadSize ) return false;
+
+  data_ = data;
+  size_ = size;
+  sections_.swap(sections);
+  return true;
+}
+
+
+void PayloadCache::close() {
+  data_.reset();
+  size_ = 0;
+  sections_.clear();
+}
+
+
+bool PayloadCache::rows(const std::string& name, std::vector<std::vector<double> >& out) const {
+  const std::map<std::string, SectionIndex>::const_iterator it = sections_.find(name);
+  if( it == sections_.end() ) return false;
+
+  // the layout was checked in open
+  Reader reader(data_.get()+sizeof(Header), size_-sizeof(Header), it->second.rows);
+  uint32_t nRows;
+  reader.read(nRows);
+  out.resize(nRows);
+  for( uint32_t i=0; i<nRows; ++i ){
+    uint32_t n;
+    reader.read(n);
+    out[i].resize(n);
+    for( uint32_t j=0; j<n; ++j ) reader.read(out[i][j]);
+  }
+  return true;
+}
+
+
+bool PayloadCache::jetCorrectorParameters(const std::string& name, JetCorrectorParameters& out) const {
+  const std::map<std::string, SectionIndex>::const_iterator it = sections_.find(name);
+  if( it == sections_.end() || it->second.definitions.empty() ) return false;
+
+  std::vector<std::vector<double> > table;
+  rows(name, table);
+
+  const JetCorrectorParameters::Definitions definitions(it->second.definitions);
+  const unsigned int nVar = definitions.nBinVar();
+  std::vector<JetCorrectorParameters::Record> records;
+  records.reserve(table.size());
+  for( std::vector<std::vector<double> >::const_iterator row = table.begin(); row != table.end(); ++row ){
+    if( row->size() < 2*nVar ) return false;
+    const std::vector<float> xMin(row->begin(), row->begin()+nVar);
+    const std::vector<float> xMax(row->begin()+nVar, row->begin()+2*nVar);
+    const std::vector<float> parameters(row->begin()+2*nVar, row->end());
+    records.push_back(JetCorrectorParameters::Record(nVar, xMin, xMax, parameters));
+  }
+  out = JetCorrectorParameters(definitions, records);
+  return true;
+}
@@ -0,0 +1,205 @@
+// EventSetup-free jet energy corrector
+
+// system include files
+#include <algorithm>
+
+#include "FWCore/Utilities/interface/Exception.h"
+
+#include "MiniAOD/MiniAODHelper/interface/StandaloneJetCorrector.h"
+#include "MiniAOD/MiniAODHelper/interface/PayloadCache.h"
+
+
+namespace {
+  const unsigned int maxParVars = 4; // x, y, z, t
+  const unsigned int maxParameters = 32;
+
+  // first of the ascending, non-overlapping bins [min,max) that contains value, -1 if none
+  inline int findBin(const float* min, const float* max, const unsigned int n, const float value) {
+    const unsigned int i = std::upper_bound(max, max+n, value) - max;
+    if( i == n || !(value >= min[i]) ) return -1;
+    return i;
+  }
+}
+
+
+StandaloneJetCorrector::StandaloneJetCorrector(const std::vector<std::string>& txtFiles) {
+  for( const auto& txtFile: txtFiles ){
+    JetCorrectorParameters parameters;
+    PayloadCache cache;
+    if( !cache.open(txtFile) || !cache.jetCorrectorParameters("",parameters) ) {
+      parameters = JetCorrectorParameters(txtFile);
+    }
+    addLevel(parameters);
+  }
+}
+
+
+void StandaloneJetCorrector::addLevel(const JetCorrectorParameters& parameters) {
+  const JetCorrectorParameters::Definitions& definitions = parameters.definitions();
+  if( definitions.isResponse() ){
+    throw cms::Exception("UnsupportedJetCorrection") << "Response payloads (" << definitions.level() << ") are not supported";
+  }
+
+  Level level;
+  for( unsigned int i=0; i<definitions.nBinVar()+definitions.nParVar(); ++i ){
+    const bool bin = i < definitions.nBinVar();
+    const std::string name = bin ? definitions.binVar(i) : definitions.parVar(i-definitions.nBinVar());
+    Variable variable;
+    if( name == "JetEta" ) variable = JetEta;
+    else if( name == "JetPt" ) variable = JetPt;
+    else if( name == "JetA" ) variable = JetA;
+    else if( name == "Rho" ) variable = Rho;
+    else throw cms::Exception("UnsupportedJetCorrection") << "Variable '" << name << "' of " << definitions.level() << " is not supported";
+    (bin ? level.binVars : level.parVars).push_back(variable);
+  }
+
+  if( !level.formula.compile(definitions.formula()) ){
+    throw cms::Exception("UnsupportedJetCorrection") << "Cannot compile formula '" << definitions.formula() << "' of " << definitions.level();
+  }
+  const unsigned int nBin = level.binVars.size();
+  const unsigned int nParVar = level.parVars.size();
+  level.nPar = level.formula.nParameters();
+  level.nRecords = parameters.size();
+  if( nParVar > maxParVars || level.formula.nVariables() > nParVar || level.nPar > maxParameters ){
+    throw cms::Exception("UnsupportedJetCorrection") << "Formula '" << definitions.formula() << "' of " << definitions.level() << " does not match its variables";
+  }
+
+  for( unsigned int r=0; r<parameters.size(); ++r ){
+    const JetCorrectorParameters::Record& record = parameters.record(r);
+    const std::vector<float>& p = record.parameters();
+    if( p.size() < 2*nParVar+level.nPar ){
+      throw cms::Exception("UnsupportedJetCorrection") << "Record " << r << " of " << definitions.level() << " has too few parameters";
+    }
+    for( unsigned int v=0; v<nBin; ++v ){
+      level.xMin.push_back(record.xMin(v));
+      level.xMax.push_back(record.xMax(v));
+    }
+    for( unsigned int v=0; v<nParVar; ++v ){
+      level.parMin.push_back(p[2*v]);
+      level.parMax.push_back(p[2*v+1]);
+    }
+    level.par.insert(level.par.end(), p.begin()+2*nParVar, p.begin()+2*nParVar+level.nPar);
+  }
+
+  sortLevel(level);
+  levels_.push_back(level);
+}
+
+
+// Enables the binary search if the records are ordered such that it finds
+// the same record as the search for the first containing one
+void StandaloneJetCorrector::sortLevel(Level& level) {
+  level.sorted = false;
+  level.groupMin.clear();
+  level.groupMax.clear();
+  level.groupOffset.clear();
+
+  const unsigned int nBin = level.binVars.size();
+  if( nBin == 0 || nBin > 2 ) return;
+  for( unsigned int r=0; r<level.nRecords; ++r ){
+    const float min0 = level.xMin[r*nBin], max0 = level.xMax[r*nBin];
+    const bool newGroup = nBin == 1 || level.groupMin.empty() || min0 != level.groupMin.back() || max0 != level.groupMax.back();
+    if( newGroup ){
+      if( !(min0 < max0) || (!level.groupMin.empty() && !(min0 >= level.groupMax.back())) ) return;
+      level.groupMin.push_back(min0);
+      level.groupMax.push_back(max0);
+      level.groupOffset.push_back(r);
+    }
+    if( nBin == 2 ){
+      const float min1 = level.xMin[r*nBin+1], max1 = level.xMax[r*nBin+1];
+      if( !(min1 < max1) || (!newGroup && !(min1 >= level.xMax[(r-1)*nBin+1])) ) return;
+    }
+  }
+  level.groupOffset.push_back(level.nRecords);
+  level.sorted = true;
+}
+
+
+int StandaloneJetCorrector::findRecord(const Level& level, const float* values) {
+  const unsigned int nBin = level.binVars.size();
+
+  if( level.sorted ){
+    const float value0 = values[level.binVars[0]];
+    const int group = findBin(&level.groupMin[0], &level.groupMax[0], level.groupMin.size(), value0);
+    if( group < 0 ) return -1;
+    if( nBin == 1 ) return group;
+
+    // within the group, the records are ascending in the second variable
+    const float value1 = values[level.binVars[1]];
+    const unsigned int begin = level.groupOffset[group], end = level.groupOffset[group+1];
+    int first = begin, count = end-begin;
+    while( count > 0 ){ // first record with value1 < xMax
+      const int step = count/2;
+      if( !(value1 < level.xMax[(first+step)*nBin+1]) ){
+	first += step+1;
+	count -= step+1;
+      }
+      else count = step;
+    }
+    if( first == int(end) || !(value1 >= level.xMin[first*nBin+1]) ) return -1;
+    return first;
+  }
+
+  // as JetCorrectorParameters::binIndex
+  for( unsigned int r=0; r<level.nRecords; ++r ){
+    unsigned int v = 0;
+    for( ; v<nBin; ++v ){
+      const float value = values[level.binVars[v]];
+      if( !(value >= level.xMin[r*nBin+v] && value < level.xMax[r*nBin+v]) ) break;
+    }
+    if( v == nBin ) return r;
+  }
+  return -1;
+}
+
+
+// as SimpleJetCorrector::correction without interpolation
+float StandaloneJetCorrector::levelCorrection(const Level& level, const float* values) {
+  const int r = findRecord(level, values);
+  if( r < 0 ) return 1.;
+
+  const unsigned int nParVar = level.parVars.size();
+  double x[maxParVars] = {};
+  for( unsigned int v=0; v<nParVar; ++v ){
+    const float value = values[level.parVars[v]];
+    const float min = level.parMin[r*nParVar+v], max = level.parMax[r*nParVar+v];
+    x[v] = value < min ? min : value > max ? max : value;
+  }
+  return level.formula(x, level.par.data() + r*level.nPar);
+}
+
+
+float StandaloneJetCorrector::correction(const float pt, const float eta, const float area, const float rho) const {
+  float out;
+  corrections(1, &pt, &eta, &area, rho, &out);
+  return out;
+}
+
+
+void StandaloneJetCorrector::corrections(const unsigned int n, const float* pt, const float* eta, const float* area, const float rho, float* out) const {
+  // per jet: JetEta, JetPt, JetA, Rho
+  std::vector<float> values(4*n);
+  for( unsigned int i=0; i<n; ++i ){
+    values[4*i+JetEta] = eta[i];
+    values[4*i+JetPt] = pt[i];
+    values[4*i+JetA] = area[i];
+    values[4*i+Rho] = rho;
+    out[i] = 1.;
+  }
+
+  // as FactorizedJetCorrector: the next level sees the corrected pt
+  for( const auto& level: levels_ ){
+    for( unsigned int i=0; i<n; ++i ){
+      const float factor = levelCorrection(level, &values[4*i]);
+      out[i] *= factor;
+      values[4*i+JetPt] *= factor;
+    }
+  }
+}
+
+
+void StandaloneJetCorrector::corrections(const std::vector<float>& pt, const std::vector<float>& eta, const std::vector<float>& area, const float rho, std::vector<float>& out) const {
+  out.resize(pt.size());
+  if( pt.empty() ) return;
+  corrections(pt.size(), &pt[0], &eta[0], &area[0], rho, &out[0]);
+}
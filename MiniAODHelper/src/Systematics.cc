@@ -1,130 +1,77 @@
-#include <map>
 #include <string>
 
 #include "MiniAOD/MiniAODHelper/interface/Systematics.h"
 #include "FWCore/Utilities/interface/Exception.h"
 
-std::map<Systematics::Type,std::string> Systematics::typeStringMap_ = std::map<Systematics::Type,std::string>();
-std::map<std::string,Systematics::Type> Systematics::stringTypeMap_ = std::map<std::string,Systematics::Type>();
-std::map<Systematics::Type,std::string> Systematics::typeLabelMap_  = std::map<Systematics::Type,std::string>();
+constexpr Systematics::Traits Systematics::traits_[];
 
 
-void Systematics::init() {
-  add( JESup,JESdown,"JES","Uncertainty");
-  add( JERup,JERdown,"JER","JER");
-  add( JESAbsoluteStatup,        JESAbsoluteStatdown,        "JESAbsoluteStat",          "AbsoluteStat"        );             
-  add( JESAbsoluteScaleup,       JESAbsoluteScaledown,       "JESAbsoluteScale",         "AbsoluteScale"       );             
-  add( JESAbsoluteFlavMapup,     JESAbsoluteFlavMapdown,     "JESAbsoluteFlavMap",       "AbsoluteFlavMap"     );                             
-  add( JESAbsoluteMPFBiasup,     JESAbsoluteMPFBiasdown,     "JESAbsoluteMPFBias",       "AbsoluteMPFBias"     );                             
-  add( JESFragmentationup,       JESFragmentationdown,       "JESFragmentation",         "Fragmentation"       );             
-  add( JESSinglePionECALup,      JESSinglePionECALdown,      "JESSinglePionECAL",        "SinglePionECAL"      );                             
-  add( JESSinglePionHCALup,      JESSinglePionHCALdown,      "JESSinglePionHCAL",        "SinglePionHCAL"      );                             
-  add( JESFlavorQCDup,           JESFlavorQCDdown,           "JESFlavorQCD",             "FlavorQCD"           );                        
-  add( JESTimePtEtaup,           JESTimePtEtadown,           "JESTimePtEta",             "TimePtEta"           );                        
-  add( JESRelativeJEREC1up,      JESRelativeJEREC1down,      "JESRelativeJEREC1",        "RelativeJEREC1"      );                             
-  add( JESRelativeJEREC2up,      JESRelativeJEREC2down,      "JESRelativeJEREC2",        "RelativeJEREC2"      );                             
-  add( JESRelativeJERHFup,       JESRelativeJERHFdown,       "JESRelativeJERHF",         "RelativeJERHF"       );             
-  add( JESRelativePtBBup,        JESRelativePtBBdown,        "JESRelativePtBB",          "RelativePtBB"        );             
-  add( JESRelativePtEC1up,       JESRelativePtEC1down,       "JESRelativePtEC1",         "RelativePtEC1"       );             
-  add( JESRelativePtEC2up,       JESRelativePtEC2down,       "JESRelativePtEC2",         "RelativePtEC2"       );             
-  add( JESRelativePtHFup,        JESRelativePtHFdown,        "JESRelativePtHF",          "RelativePtHF"        );             
-  add( JESRelativeBalup,         JESRelativeBaldown,         "JESRelativeBal",           "RelativeBal"         );                        
-  add( JESRelativeFSRup,         JESRelativeFSRdown,         "JESRelativeFSR",           "RelativeFSR"         );                        
-  add( JESRelativeStatFSRup,     JESRelativeStatFSRdown,     "JESRelativeStatFSR",       "RelativeStatFSR"     );                             
-  add( JESRelativeStatECup,      JESRelativeStatECdown,      "JESRelativeStatEC",        "RelativeStatEC"      );                             
-  add( JESRelativeStatHFup,      JESRelativeStatHFdown,      "JESRelativeStatHF",        "RelativeStatHF"      );                             
-  add( JESPileUpDataMCup,        JESPileUpDataMCdown,        "JESPileUpDataMC",          "PileUpDataMC"        );             
-  add( JESPileUpPtRefup,         JESPileUpPtRefdown,         "JESPileUpPtRef",           "PileUpPtRef"         );                        
-  add( JESPileUpPtBBup,          JESPileUpPtBBdown,          "JESPileUpPtBB",            "PileUpPtBB"          );                        
-  add( JESPileUpPtEC1up,         JESPileUpPtEC1down,         "JESPileUpPtEC1",           "PileUpPtEC1"         );                        
-  add( JESPileUpPtEC2up,         JESPileUpPtEC2down,         "JESPileUpPtEC2",           "PileUpPtEC2"         );                        
-  add( JESPileUpPtHFup,          JESPileUpPtHFdown,          "JESPileUpPtHF",            "PileUpPtHF"          );                        
-  add( JESPileUpMuZeroup,        JESPileUpMuZerodown,        "JESPileUpMuZero",          "PileUpMuZero"        );             
-  add( JESPileUpEnvelopeup,      JESPileUpEnvelopedown,      "JESPileUpEnvelope",        "PileUpEnvelope"      );                             
-  add( JESSubTotalPileUpup,      JESSubTotalPileUpdown,      "JESSubTotalPileUp",        "SubTotalPileUp"      );                             
-  add( JESSubTotalRelativeup,    JESSubTotalRelativedown,    "JESSubTotalRelative",      "SubTotalRelative"    );                             
-  add( JESSubTotalPtup,          JESSubTotalPtdown,          "JESSubTotalPt",            "SubTotalPt"          );                        
-  add( JESSubTotalScaleup,       JESSubTotalScaledown,       "JESSubTotalScale",         "SubTotalScale"       );             
-  add( JESSubTotalAbsoluteup,    JESSubTotalAbsolutedown,    "JESSubTotalAbsolute",      "SubTotalAbsolute"    );                             
-  add( JESSubTotalMCup,          JESSubTotalMCdown,          "JESSubTotalMC",            "SubTotalMC"          );                        
-  add( JESTotalup,               JESTotaldown,               "JESTotal",                 "Total"               );                 
-  add( JESTotalNoFlavorup,       JESTotalNoFlavordown,       "JESTotalNoFlavor",         "TotalNoFlavor"       );             
-  add( JESTotalNoTimeup,         JESTotalNoTimedown,         "JESTotalNoTime",           "TotalNoTime"         );                        
-  add( JESTotalNoFlavorNoTimeup, JESTotalNoFlavorNoTimedown, "JESTotalNoFlavorNoTime",   "TotalNoFlavorNoTime" );                    
-  add( JESFlavorZJetup,          JESFlavorZJetdown,          "JESFlavorZJet",            "FlavorZJet"          );                        
-  add( JESFlavorPhotonJetup,     JESFlavorPhotonJetdown,     "JESFlavorPhotonJet",       "FlavorPhotonJet"     );                             
-  add( JESFlavorPureGluonup,     JESFlavorPureGluondown,     "JESFlavorPureGluon",       "FlavorPureGluon"     );                             
-  add( JESFlavorPureQuarkup,     JESFlavorPureQuarkdown,     "JESFlavorPureQuark",       "FlavorPureQuark"     );                             
-  add( JESFlavorPureCharmup,     JESFlavorPureCharmdown,     "JESFlavorPureCharm",       "FlavorPureCharm"     );                             
-  add( JESFlavorPureBottomup,    JESFlavorPureBottomdown,    "JESFlavorPureBottom",      "FlavorPureBottom"    );                             
-  add( JESTimeRunBCDup,          JESTimeRunBCDdown,          "JESTimeRunBCD",            "TimeRunBCD"          );                  
-  add( JESTimeRunEFup,           JESTimeRunEFdown,           "JESTimeRunEF",             "TimeRunEF"           );                        
-  add( JESTimeRunGup,            JESTimeRunGdown,            "JESTimeRunG",              "TimeRunG"            );                                 
-  add( JESTimeRunHup,            JESTimeRunHdown,            "JESTimeRunH",              "TimeRunH"            );                                          
-}
-
-bool Systematics::isInit() {
-  return typeStringMap_.size()>1;
-}
-
-void Systematics::add(Systematics::Type typeUp, Systematics::Type typeDn, const std::string& name, const std::string& label) {
-  typeStringMap_[typeUp] = name+"up";
-  typeStringMap_[typeDn] = name+"down";
-  stringTypeMap_[name+"up"] = typeUp;
-  stringTypeMap_[name+"down"] = typeDn;
-  typeLabelMap_[typeUp] = label;
-  typeLabelMap_[typeDn] = label;
+namespace {
+  constexpr bool checkTraits(const unsigned int i = 0) {
+    return i == Systematics::nTypes || (Systematics::traits(Systematics::Type(i)).type == Systematics::Type(i) && checkTraits(i+1));
+  }
+  static_assert(checkTraits(), "Systematics::traits_ does not match Systematics::Type");
 }
 
 
 Systematics::Type Systematics::get(const std::string& name) {
   if( name == "" ) return NA;
 
-  if( !isInit() ) init();
-
-  std::map<std::string,Systematics::Type>::const_iterator it = stringTypeMap_.find(name);
-  if( it == stringTypeMap_.end() ) {
-    throw cms::Exception("InvalidUncertaintyName") << "No uncertainty with name '" << name << "'";
-    return Systematics::NA;
-  } else {
-    return it->second;
+  for( unsigned int i=1; i<nTypes; ++i ){
+    if( name == traits_[i].name ) return traits_[i].type;
   }
+  throw cms::Exception("InvalidUncertaintyName") << "No uncertainty with name '" << name << "'";
+  return Systematics::NA;
 }
 
 std::string Systematics::toString(const Type type) {
-  if( type == NA ) return "";
-
-  if( !isInit() ) init();
-
-  std::map<Systematics::Type,std::string>::const_iterator it = typeStringMap_.find(type);
-  if( it == typeStringMap_.end() ) {
+  if( unsigned(type) >= nTypes ) {
     throw cms::Exception("InvalidUncertaintyType") << "No uncertainty with index '" << type << "'";
     return "";
-  } else {
-    return it->second;
   }
+  return traits_[type].name;
 }
 
-bool Systematics::isJECUncertaintyUp(const Type type) {
-  const std::string str = toString(type);
-  return str.find("JES")==0 && str.find("up")==str.size()-2;
+std::string Systematics::GetJECUncertaintyLabel(const Type type) {
+  return traits(type).label;
 }
 
-bool Systematics::isJECUncertaintyDown(const Type type) {
-  const std::string str = toString(type);
-  return str.find("JES")==0 && str.find("down") == str.size()-4;
+
+SystematicSet SystematicSet::all() {
+  SystematicSet set;
+  for( unsigned int i=1; i<Systematics::nTypes; ++i ) set.insert(Systematics::Type(i));
+  return set;
 }
 
-bool Systematics::isJECUncertainty(const Type type) {
-  return isJECUncertaintyUp(type) || isJECUncertaintyDown(type);
+SystematicSet SystematicSet::family(const Systematics::Family family) {
+  SystematicSet set;
+  for( unsigned int i=1; i<Systematics::nTypes; ++i ){
+    if( Systematics::family(Systematics::Type(i)) == family ) set.insert(Systematics::Type(i));
+  }
+  return set;
 }
 
-std::string Systematics::GetJECUncertaintyLabel(const Type type) {
-  if( !isInit() ) init();
-  std::map<Systematics::Type,std::string>::const_iterator it = typeLabelMap_.find(type);
-  if( it == typeLabelMap_.end() ) {
-    return "";
-  } else {
-    return it->second;
+SystematicSet SystematicSet::up() {
+  SystematicSet set;
+  for( unsigned int i=1; i<Systematics::nTypes; ++i ){
+    if( Systematics::isUp(Systematics::Type(i)) ) set.insert(Systematics::Type(i));
+  }
+  return set;
+}
+
+SystematicSet SystematicSet::down() {
+  SystematicSet set;
+  for( unsigned int i=1; i<Systematics::nTypes; ++i ){
+    if( Systematics::isDown(Systematics::Type(i)) ) set.insert(Systematics::Type(i));
+  }
+  return set;
+}
+
+std::vector<Systematics::Type> SystematicSet::types() const {
+  std::vector<Systematics::Type> result;
+  result.reserve(size());
+  for( unsigned int i=0; i<Systematics::nTypes; ++i ){
+    if( bits_.test(i) ) result.push_back(Systematics::Type(i));
   }
+  return result;
 }
@@ -0,0 +1,251 @@
+// Event selection for many systematic variations with shared invariant stages
+
+// system include files
+#include <algorithm>
+
+#include "DataFormats/Math/interface/deltaR.h"
+#include "FWCore/Utilities/interface/Exception.h"
+
+#include "MiniAOD/MiniAODHelper/interface/SystematicsScheduler.h"
+
+
+namespace {
+  // stages read by each stage, as bitmask
+  const unsigned int stageInputs[SystematicsScheduler::nStages] = {
+    0,                                               // LeptonSelection
+    1u<<SystematicsScheduler::LeptonSelection,       // JetCleaning
+    0,                                               // JetID
+    0,                                               // JetCorrection
+    1u<<SystematicsScheduler::JetCleaning | 1u<<SystematicsScheduler::JetID | 1u<<SystematicsScheduler::JetCorrection, // JetSelection
+    1u<<SystematicsScheduler::JetSelection           // CSVWeight
+  };
+}
+
+
+SystematicsScheduler::SystematicsScheduler(MiniAODHelper& helper, const std::vector<Systematics::Type>& variations)
+  : helper_(helper) {
+  dependencies_[JetCorrection] = SystematicSet::family(Systematics::JES) | SystematicSet::family(Systematics::JER);
+  dependencies_[CSVWeight] = SystematicSet::family(Systematics::CSV);
+
+  types_.push_back(Systematics::NA);
+  for( const auto& type: variations ){
+    if( std::find(types_.begin(), types_.end(), type) == types_.end() ) types_.push_back(type);
+  }
+  schedule();
+}
+
+
+void SystematicsScheduler::setMuonSelection(const float minPt, const muonID::muonID id, const coneSize::coneSize cone, const corrType::corrType corr, const float maxEta) {
+  selectMuons_ = true;
+  muonMinPt_ = minPt;
+  muonID_ = id;
+  muonCone_ = cone;
+  muonCorr_ = corr;
+  muonMaxEta_ = maxEta;
+}
+
+
+void SystematicsScheduler::setElectronSelection(const float minPt, const electronID::electronID id, const float maxEta) {
+  selectElectrons_ = true;
+  electronMinPt_ = minPt;
+  electronID_ = id;
+  electronMaxEta_ = maxEta;
+}
+
+
+void SystematicsScheduler::setJetCleaning(const double deltaR) {
+  cleaningDeltaR_ = deltaR;
+}
+
+
+void SystematicsScheduler::setJetCorrection(const bool doJES, const bool doJER) {
+  doJES_ = doJES;
+  doJER_ = doJER;
+}
+
+
+void SystematicsScheduler::setJetSelection(const float minPt, const float maxAbsEta, const jetID::jetID id, const char csvWP) {
+  jetMinPt_ = minPt;
+  jetMaxAbsEta_ = maxAbsEta;
+  jetID_ = id;
+  csvWP_ = csvWP;
+}
+
+
+void SystematicsScheduler::setDependencies(const Stage stage, const SystematicSet& types) {
+  dependencies_[stage] = types;
+  schedule();
+}
+
+
+bool SystematicsScheduler::dependsOn(const Stage stage, const Systematics::Type type) const {
+  return (variation(type).stages >> stage) & 1u;
+}
+
+
+// Stages to run per variation, the columns of the correction table and the
+// jet selection slots
+void SystematicsScheduler::schedule() {
+  variations_.clear();
+  variationOf_.assign(Systematics::nTypes, -1);
+  tableTypes_.clear();
+  unsigned int nJetSelections = 1;
+
+  for( const auto& type: types_ ){
+    Variation variation = { type, 0, -1, 0, 1., 1., 1., 1. };
+    if( type != Systematics::NA ){
+      for( unsigned int stage=0; stage<nStages; ++stage ){
+	const bool inputs = variation.stages & stageInputs[stage];
+	if( inputs || dependencies_[stage].contains(type) ) variation.stages |= 1u<<stage;
+      }
+    }
+    if( variation.stages & (1u<<JetCorrection) ){
+      variation.tableColumn = tableTypes_.size();
+      tableTypes_.push_back(type);
+    }
+    if( variation.stages & (1u<<JetSelection) ) variation.jets = nJetSelections++;
+
+    variationOf_[type] = variations_.size();
+    variations_.push_back(variation);
+  }
+  jetSelections_.resize(nJetSelections);
+}
+
+
+const SystematicsScheduler::Variation& SystematicsScheduler::variation(const Systematics::Type type) const {
+  const int v = unsigned(type) < variationOf_.size() ? variationOf_[type] : -1;
+  if( v < 0 ){
+    throw cms::Exception("InvalidSystematicsVariation") << "Variation '" << Systematics::toString(type) << "' was not scheduled";
+  }
+  return variations_[v];
+}
+
+
+// iSys of CSVHelper::getCSVWeight
+int SystematicsScheduler::csvSystematic(const Systematics::Type type) {
+  switch( type ){
+  case Systematics::JESup:           return 7;
+  case Systematics::JESdown:         return 8;
+  case Systematics::CSVLFup:         return 9;
+  case Systematics::CSVLFdown:       return 10;
+  case Systematics::CSVHFup:         return 11;
+  case Systematics::CSVHFdown:       return 12;
+  case Systematics::CSVHFStats1up:   return 13;
+  case Systematics::CSVHFStats1down: return 14;
+  case Systematics::CSVHFStats2up:   return 15;
+  case Systematics::CSVHFStats2down: return 16;
+  case Systematics::CSVLFStats1up:   return 17;
+  case Systematics::CSVLFStats1down: return 18;
+  case Systematics::CSVLFStats2up:   return 19;
+  case Systematics::CSVLFStats2down: return 20;
+  case Systematics::CSVCErr1up:      return 21;
+  case Systematics::CSVCErr1down:    return 22;
+  case Systematics::CSVCErr2up:      return 23;
+  case Systematics::CSVCErr2down:    return 24;
+  default:                           return 0;
+  }
+}
+
+
+void SystematicsScheduler::run(const edm::Event& event, const edm::EventSetup& setup,
+			       const std::vector<pat::Muon>& muons, const std::vector<pat::Electron>& electrons,
+			       const std::vector<pat::Jet>& jets, const edm::Handle<reco::GenJetCollection>& genjets) {
+
+  /// Lepton selection
+  muons_.clear();
+  electrons_.clear();
+  if( selectMuons_ ){
+    for( unsigned int i=0; i<muons.size(); ++i ){
+      if( helper_.isGoodMuon(muons[i], muonMinPt_, muonMaxEta_, muonID_, muonCone_, muonCorr_) ) muons_.push_back(i);
+    }
+  }
+  if( selectElectrons_ ){
+    for( unsigned int i=0; i<electrons.size(); ++i ){
+      if( helper_.isGoodElectron(electrons[i], electronMinPt_, electronMaxEta_, electronID_) ) electrons_.push_back(i);
+    }
+  }
+
+  /// Jet cleaning and jet ID: the direction, the energy fractions and the CSV
+  /// value do not change with the corrections
+  jetViews_ = helper_.GetJetViews(jets);
+  goodJets_.clear();
+  const double dR2 = cleaningDeltaR_*cleaningDeltaR_;
+  for( unsigned int i=0; i<jets.size(); ++i ){
+    const CorrectedJetView& view = jetViews_[i];
+    bool isOverlap = false;
+    for( unsigned int k=0; k<electrons_.size() && !isOverlap; ++k ){
+      isOverlap = reco::deltaR2(view.eta, view.phi, electrons[electrons_[k]].eta(), electrons[electrons_[k]].phi()) < dR2;
+    }
+    for( unsigned int k=0; k<muons_.size() && !isOverlap; ++k ){
+      isOverlap = reco::deltaR2(view.eta, view.phi, muons[muons_[k]].eta(), muons[muons_[k]].phi()) < dR2;
+    }
+    if( isOverlap ) continue;
+    if( helper_.isGoodJet(view, jets[i], 0., jetMaxAbsEta_, jetID_, csvWP_) ) goodJets_.push_back(i);
+  }
+
+  /// Jet corrections of all variations
+  const MiniAODHelper::JetCorrectionTable table = helper_.GetJetCorrectionTable(jets, event, setup, genjets, tableTypes_, doJES_, doJER_);
+
+  for( auto& variation: variations_ ){
+    const bool nominal = variation.type == Systematics::NA;
+
+    /// Jet selection: only the pt threshold depends on the corrections
+    if( nominal || variation.stages & (1u<<JetSelection) ){
+      JetSelection& selection = jetSelections_[variation.jets];
+      selection.jets.clear();
+      selection.factors.clear();
+      for( const auto& i: goodJets_ ){
+	const float factor = variation.tableColumn < 0 ? table.nominalFactors[i] : table.factor(i, variation.tableColumn);
+	if( jetViews_[i].pt*factor < jetMinPt_ ) continue;
+	selection.jets.push_back(i);
+	selection.factors.push_back(factor);
+      }
+    }
+
+    /// CSV weight
+    if( !csvHelper_ ) continue;
+    if( !nominal && !(variation.stages & (1u<<CSVWeight)) ){
+      const Variation& nominalVariation = variations_[0];
+      variation.csvWeight = nominalVariation.csvWeight;
+      variation.csvWeightHF = nominalVariation.csvWeightHF;
+      variation.csvWeightLF = nominalVariation.csvWeightLF;
+      variation.csvWeightCF = nominalVariation.csvWeightCF;
+      continue;
+    }
+    const JetSelection& selection = jetSelections_[variation.jets];
+    std::vector<double> pts, etas, csvs;
+    std::vector<int> flavors;
+    for( unsigned int k=0; k<selection.jets.size(); ++k ){
+      const unsigned int i = selection.jets[k];
+      pts.push_back(jetViews_[i].pt*selection.factors[k]);
+      etas.push_back(jetViews_[i].eta);
+      csvs.push_back(jetViews_[i].csv);
+      flavors.push_back(jets[i].hadronFlavour());
+    }
+    variation.csvWeight = csvHelper_->getCSVWeight(pts, etas, csvs, flavors, csvSystematic(variation.type),
+						   variation.csvWeightHF, variation.csvWeightLF, variation.csvWeightCF);
+  }
+}
+
+
+const std::vector<unsigned int>& SystematicsScheduler::jets(const Systematics::Type type) const {
+  return jetSelections_[variation(type).jets].jets;
+}
+
+
+const std::vector<float>& SystematicsScheduler::jetFactors(const Systematics::Type type) const {
+  return jetSelections_[variation(type).jets].factors;
+}
+
+
+double SystematicsScheduler::csvWeight(const Systematics::Type type) const {
+  return variation(type).csvWeight;
+}
+
+
+void SystematicsScheduler::csvWeights(const Systematics::Type type, double& hf, double& lf, double& cf) const {
+  const Variation& v = variation(type);
+  hf = v.csvWeightHF;
+  lf = v.csvWeightLF;
+  cf = v.csvWeightCF;
+}
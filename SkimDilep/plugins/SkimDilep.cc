@@ -247,8 +247,9 @@ SkimDilep::filter(edm::Event& iEvent, const edm::EventSetup& iSetup)
   int numTightMuons = 0, numLooseMuons = 0;
 
   if( pfmuons.isValid() ){
-    selectedMuonsTight = miniAODhelper.GetSelectedMuons(*pfmuons, 20., muonID::muonTight);
-    selectedMuonsLoose = miniAODhelper.GetSelectedMuons(*pfmuons, 10., muonID::muonLoose);
+    const std::vector<uint64_t> muonMasks = miniAODhelper.EvaluateMuonIDs(*pfmuons, leptonIDMask::bit(muonID::muonTight) | leptonIDMask::bit(muonID::muonLoose));
+    selectedMuonsTight = miniAODhelper.GetSelectedMuons(*pfmuons, muonMasks, 20., muonID::muonTight);
+    selectedMuonsLoose = miniAODhelper.GetSelectedMuons(*pfmuons, muonMasks, 10., muonID::muonLoose);
 
     numTightMuons = selectedMuonsTight.size();
     numLooseMuons = selectedMuonsLoose.size();
@@ -261,8 +262,9 @@ SkimDilep::filter(edm::Event& iEvent, const edm::EventSetup& iSetup)
 
   int numTightElectrons = 0, numLooseElectrons = 0;
   if( pfelectrons.isValid() ){
-    selectedElectronsTight = miniAODhelper.GetSelectedElectrons(*pfelectrons, 20., electronID::electronTight);
-    selectedElectronsLoose = miniAODhelper.GetSelectedElectrons(*pfelectrons, 10., electronID::electronLoose);
+    const std::vector<uint64_t> electronMasks = miniAODhelper.EvaluateElectronIDs(*pfelectrons, leptonIDMask::bit(electronID::electronTight) | leptonIDMask::bit(electronID::electronLoose));
+    selectedElectronsTight = miniAODhelper.GetSelectedElectrons(*pfelectrons, electronMasks, 20., electronID::electronTight);
+    selectedElectronsLoose = miniAODhelper.GetSelectedElectrons(*pfelectrons, electronMasks, 10., electronID::electronLoose);
     
     numTightElectrons = selectedElectronsTight.size();
     numLooseElectrons = selectedElectronsLoose.size();